@@ -0,0 +1,156 @@
+/********************************************************************
+ *                                                                  *
+ * THIS FILE IS PART OF THE OggVorbis SOFTWARE CODEC SOURCE CODE.   *
+ * USE, DISTRIBUTION AND REPRODUCTION OF THIS LIBRARY SOURCE IS     *
+ * GOVERNED BY A BSD-STYLE SOURCE LICENSE INCLUDED WITH THIS SOURCE *
+ * IN 'COPYING'. PLEASE READ THESE TERMS BEFORE DISTRIBUTING.       *
+ *                                                                  *
+ * THE OggVorbis SOURCE CODE IS (C) COPYRIGHT 1994-2009             *
+ * by the Xiph.Org Foundation http://www.xiph.org/                  *
+ *                                                                  *
+ ********************************************************************
+
+ function: synthetic streams for the benchmarks and self-tests
+
+ ********************************************************************/
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <math.h>
+#include "vorbis/codec.h"
+#include "vorbis/vorbisenc.h"
+#include "bench_corpus.h"
+
+#ifndef M_PI
+#  define M_PI 3.14159265358979323846
+#endif
+
+void bench_write(bench_buffer *b,const unsigned char *data,long bytes){
+  if(b->bytes+bytes>b->storage){
+    b->storage=(b->bytes+bytes)*2;
+    b->data=realloc(b->data,b->storage);
+    if(!b->data){
+      fprintf(stderr,"out of memory\n");
+      exit(1);
+    }
+  }
+  memcpy(b->data+b->bytes,data,bytes);
+  b->bytes+=bytes;
+}
+
+static unsigned long rng;
+
+static float noise(void){
+  rng=rng*1664525UL+1013904223UL;
+  return (float)((rng>>8)&0xffff)/32768.f-1.f;
+}
+
+/* a few slowly gliding partials per channel, and every so often a
+   noise burst for the encoder to use short blocks on */
+static void make_signal(float **pcm,int channels,long rate,long start,
+                        long n){
+  int c;
+  long i;
+  for(c=0;c<channels;c++){
+    double f0=110.*(c+1)*(1.+.01*c);
+    for(i=0;i<n;i++){
+      double t=(double)(start+i)/rate;
+      double v=.3*sin(2*M_PI*f0*t+3.*sin(2*M_PI*.3*t))+
+        .15*sin(2*M_PI*f0*2.01*t)+
+        .08*sin(2*M_PI*f0*4.98*t+c);
+      long beat=(start+i)%(rate/2);
+      if(beat<rate/40)v+=.4*noise()*(1.-(double)beat/(rate/40));
+      v+=.01*noise();
+      pcm[c][i]=(float)v;
+    }
+  }
+}
+
+static void flush_pages(ogg_stream_state *os,bench_buffer *out,int force){
+  ogg_page og;
+  while(force?ogg_stream_flush(os,&og):ogg_stream_pageout(os,&og)){
+    bench_write(out,og.header,og.header_len);
+    bench_write(out,og.body,og.body_len);
+  }
+}
+
+void bench_encode(const bench_link *l,int serialno,double seconds,
+                  bench_buffer *out){
+  vorbis_info      vi;
+  vorbis_comment   vc;
+  vorbis_dsp_state vd;
+  vorbis_block     vb;
+  ogg_stream_state os;
+  ogg_packet       op,op_comm,op_code;
+  long             total=(long)(seconds*l->rate),done=0;
+
+  vorbis_info_init(&vi);
+  if(vorbis_encode_init_vbr(&vi,l->channels,l->rate,l->quality)){
+    fprintf(stderr,"cannot encode %dch %ldHz q%g\n",
+            l->channels,l->rate,l->quality*10);
+    exit(1);
+  }
+  vorbis_comment_init(&vc);
+  vorbis_comment_add_tag(&vc,"ENCODER","libvorbis bench");
+  vorbis_analysis_init(&vd,&vi);
+  vorbis_block_init(&vd,&vb);
+  ogg_stream_init(&os,serialno);
+
+  vorbis_analysis_headerout(&vd,&vc,&op,&op_comm,&op_code);
+  ogg_stream_packetin(&os,&op);
+  ogg_stream_packetin(&os,&op_comm);
+  ogg_stream_packetin(&os,&op_code);
+  flush_pages(&os,out,1);
+
+  /* the same audio for the same settings, whatever the stream */
+  rng=1;
+  while(1){
+    long n=total-done;
+    if(n>1024)n=1024;
+    if(n>0){
+      make_signal(vorbis_analysis_buffer(&vd,(int)n),l->channels,l->rate,
+                  done,n);
+      done+=n;
+    }
+    vorbis_analysis_wrote(&vd,(int)n);
+    while(vorbis_analysis_blockout(&vd,&vb)==1){
+      vorbis_analysis(&vb,NULL);
+      vorbis_bitrate_addblock(&vb);
+      while(vorbis_bitrate_flushpacket(&vd,&op)){
+        ogg_stream_packetin(&os,&op);
+        flush_pages(&os,out,0);
+      }
+    }
+    if(!n)break;
+  }
+  flush_pages(&os,out,1);
+
+  ogg_stream_clear(&os);
+  vorbis_block_clear(&vb);
+  vorbis_dsp_clear(&vd);
+  vorbis_comment_clear(&vc);
+  vorbis_info_clear(&vi);
+}
+
+size_t bench_source_read(void *ptr,size_t size,size_t nmemb,void *ds){
+  bench_source *s=ds;
+  long bytes=(long)(size*nmemb);
+  if(bytes>s->b->bytes-s->pos)bytes=s->b->bytes-s->pos;
+  memcpy(ptr,s->b->data+s->pos,bytes);
+  s->pos+=bytes;
+  return size?bytes/size:0;
+}
+
+int bench_source_seek(void *ds,ogg_int64_t offset,int whence){
+  bench_source *s=ds;
+  if(whence==SEEK_CUR)offset+=s->pos;
+  else if(whence==SEEK_END)offset+=s->b->bytes;
+  if(offset<0 || offset>s->b->bytes)return -1;
+  s->pos=(long)offset;
+  return 0;
+}
+
+long bench_source_tell(void *ds){
+  return ((bench_source *)ds)->pos;
+}
@@ -0,0 +1,56 @@
+/********************************************************************
+ *                                                                  *
+ * THIS FILE IS PART OF THE OggVorbis SOFTWARE CODEC SOURCE CODE.   *
+ * USE, DISTRIBUTION AND REPRODUCTION OF THIS LIBRARY SOURCE IS     *
+ * GOVERNED BY A BSD-STYLE SOURCE LICENSE INCLUDED WITH THIS SOURCE *
+ * IN 'COPYING'. PLEASE READ THESE TERMS BEFORE DISTRIBUTING.       *
+ *                                                                  *
+ * THE OggVorbis SOURCE CODE IS (C) COPYRIGHT 1994-2009             *
+ * by the Xiph.Org Foundation http://www.xiph.org/                  *
+ *                                                                  *
+ ********************************************************************
+
+ function: synthetic streams for the benchmarks and self-tests
+
+ ********************************************************************/
+
+#ifndef _V_BENCH_CORPUS_H_
+#define _V_BENCH_CORPUS_H_
+
+#include <stddef.h>
+#include "ogg/ogg.h"
+
+typedef struct {
+  int   channels;
+  long  rate;
+  float quality; /* for vorbis_encode_init_vbr: q-1 is -.1, q10 is 1. */
+} bench_link;
+
+/* a growable byte buffer */
+typedef struct {
+  unsigned char *data;
+  long           bytes;
+  long           storage;
+} bench_buffer;
+
+extern void bench_write(bench_buffer *b,const unsigned char *data,
+                        long bytes);
+
+/* appends seconds of audio encoded with the settings of l, as one
+   logical stream; the signal comes from a fixed seed, so the same
+   settings always give the same bytes */
+extern void bench_encode(const bench_link *l,int serialno,double seconds,
+                         bench_buffer *out);
+
+/* a read position in a bench_buffer, for the ov_callbacks below */
+typedef struct {
+  const bench_buffer *b;
+  long                pos;
+} bench_source;
+
+extern size_t bench_source_read(void *ptr,size_t size,size_t nmemb,
+                                void *ds);
+extern int    bench_source_seek(void *ds,ogg_int64_t offset,int whence);
+extern long   bench_source_tell(void *ds);
+
+#endif
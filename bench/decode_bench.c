@@ -0,0 +1,570 @@
+/********************************************************************
+ *                                                                  *
+ * THIS FILE IS PART OF THE OggVorbis SOFTWARE CODEC SOURCE CODE.   *
+ * USE, DISTRIBUTION AND REPRODUCTION OF THIS LIBRARY SOURCE IS     *
+ * GOVERNED BY A BSD-STYLE SOURCE LICENSE INCLUDED WITH THIS SOURCE *
+ * IN 'COPYING'. PLEASE READ THESE TERMS BEFORE DISTRIBUTING.       *
+ *                                                                  *
+ * THE OggVorbis SOURCE CODE IS (C) COPYRIGHT 1994-2009             *
+ * by the Xiph.Org Foundation http://www.xiph.org/                  *
+ *                                                                  *
+ ********************************************************************
+
+ function: decode benchmark over a synthetic corpus
+
+ ********************************************************************/
+
+/* Encodes a fixed set of streams with vorbisenc (mono, stereo and
+   5.1; 8 to 48kHz; q-1 to q10; a chained file; one read through a
+   source that cannot seek), then times decoding each from memory
+   with ov_read, ov_read_float and bare vorbis_synthesis.  The input
+   signal comes from a fixed seed, so the corpus is the same from run
+   to run of one build.  The fused mode is synth with
+   vorbis_synthesis_fused() turned on, to compare against.
+
+   decode_bench [-s seconds] [-r repeats] [-m modes] [-t threads]
+                [-c opens] [-o name] [-w dir]
+
+   -s  seconds of audio per stream (default 20)
+   -r  decodes per measurement; the fastest counts (default 3)
+   -m  any of read,float,synth,fused (default the first three)
+   -t  also decode each seekable stream with ov_decode_parallel() on
+       1 to this many threads
+   -c  also time this many rounds of ov_open_memory(), a short read
+       and ov_clear() on each stream, from the C heap and from an arena
+   -o  only streams whose name contains this
+   -w  also write the corpus to dir as .ogg files
+
+   For each stream and mode it prints how many times faster than real
+   time the decode ran, the wall time per decoded sample (counting
+   each channel) and the peak resident set size of the decode.  The
+   parallel decodes, "par" and the thread count, also print their
+   speedup over a serial ov_read_format() decode of the stream from
+   memory, and say so if their PCM differs from it.  The open/clear
+   churn prints the time per round with the heap and with a bump
+   arena made current by ogg_allocator_use() and reset after each
+   ov_clear(), and the arena's high water mark. */
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <time.h>
+#include "vorbis/codec.h"
+#include "vorbis/vorbisfile.h"
+#include "bench_corpus.h"
+
+#ifdef __linux__
+#  include <sys/resource.h>
+#endif
+
+#define MAXLINKS 3
+
+typedef struct {
+  const char *name;
+  int         seekable;
+  int         links;
+  bench_link  link[MAXLINKS];
+} bench_stream;
+
+static const bench_stream corpus[]={
+  {"mono-8k-q-1",      1,1,{{1, 8000,-.1f}}},
+  {"mono-22k-q2",      1,1,{{1,22050, .2f}}},
+  {"stereo-16k-q0",    1,1,{{2,16000, 0.f}}},
+  {"stereo-32k-q3",    1,1,{{2,32000, .3f}}},
+  {"stereo-44k-q-1",   1,1,{{2,44100,-.1f}}},
+  {"stereo-44k-q5",    1,1,{{2,44100, .5f}}},
+  {"stereo-44k-q10",   1,1,{{2,44100,  1.f}}},
+  {"stereo-48k-q7",    1,1,{{2,48000, .7f}}},
+  {"5.1-48k-q4",       1,1,{{6,48000, .4f}}},
+  {"5.1-44k-q10",      1,1,{{6,44100,  1.f}}},
+  {"chain-3links",     1,3,{{2,44100, .3f},{1,22050,.1f},{6,48000,.5f}}},
+  {"stream-44k-q5",    0,1,{{2,44100, .5f}}},
+};
+#define STREAMS ((int)(sizeof(corpus)/sizeof(*corpus)))
+
+#define MODE_READ  1
+#define MODE_FLOAT 2
+#define MODE_SYNTH 4
+#define MODE_FUSED 8
+
+/* the decodes; each returns channel samples, and keeps a sum of a
+   few of them so nothing is optimized away **************************/
+
+typedef struct {
+  ogg_int64_t samples; /* counting each channel */
+  double      seconds; /* of audio */
+  double      check;
+} bench_result;
+
+static int open_stream(const bench_stream *st,const bench_buffer *b,
+                       bench_source *s,OggVorbis_File *vf){
+  ov_callbacks cb={bench_source_read,bench_source_seek,NULL,
+                   bench_source_tell};
+  s->b=b;
+  s->pos=0;
+  if(!st->seekable){
+    cb.seek_func=NULL;
+    cb.tell_func=NULL;
+  }
+  return ov_open_callbacks(s,vf,NULL,0,cb);
+}
+
+static void decode_read(const bench_stream *st,const bench_buffer *b,
+                        bench_result *r){
+  OggVorbis_File vf;
+  bench_source   s;
+  char           pcm[8192];
+  int            link=-1;
+  long           ret;
+
+  if(open_stream(st,b,&s,&vf)){
+    fprintf(stderr,"%s: cannot open\n",st->name);
+    exit(1);
+  }
+  while((ret=ov_read(&vf,pcm,sizeof(pcm),0,2,1,&link))>0){
+    vorbis_info *vi=ov_info(&vf,-1);
+    r->samples+=ret/2;
+    r->seconds+=(double)ret/(2*vi->channels)/vi->rate;
+    r->check+=pcm[0]+pcm[ret-1];
+  }
+  ov_clear(&vf);
+}
+
+static void decode_float(const bench_stream *st,const bench_buffer *b,
+                         bench_result *r){
+  OggVorbis_File vf;
+  bench_source   s;
+  float        **pcm;
+  int            link=-1;
+  long           ret;
+
+  if(open_stream(st,b,&s,&vf)){
+    fprintf(stderr,"%s: cannot open\n",st->name);
+    exit(1);
+  }
+  while((ret=ov_read_float(&vf,&pcm,4096,&link))>0){
+    vorbis_info *vi=ov_info(&vf,-1);
+    r->samples+=ret*vi->channels;
+    r->seconds+=(double)ret/vi->rate;
+    r->check+=pcm[0][0]+pcm[vi->channels-1][ret-1];
+  }
+  ov_clear(&vf);
+}
+
+/* libogg and libvorbis alone, as an application without vorbisfile
+   would; a new link starts at each beginning of stream page */
+static void decode_synth1(const bench_stream *st,const bench_buffer *b,
+                          bench_result *r,int fused){
+  ogg_sync_state   oy;
+  ogg_stream_state os;
+  ogg_page         og;
+  ogg_packet       op;
+  vorbis_info      vi;
+  vorbis_comment   vc;
+  vorbis_dsp_state vd;
+  vorbis_block     vb;
+  int              headers=-1; /* -1 no link yet, 3 decoding */
+  long             pos=0;
+
+  (void)st;
+  ogg_sync_init(&oy);
+  while(1){
+    int ret=ogg_sync_pageout(&oy,&og);
+    if(ret==0){
+      long bytes=b->bytes-pos;
+      if(bytes>4096)bytes=4096;
+      if(!bytes)break;
+      memcpy(ogg_sync_buffer(&oy,bytes),b->data+pos,bytes);
+      ogg_sync_wrote(&oy,bytes);
+      pos+=bytes;
+      continue;
+    }
+    if(ret<0)continue;
+
+    if(ogg_page_bos(&og)){
+      if(headers>=0){
+        if(headers==3){
+          vorbis_block_clear(&vb);
+          vorbis_dsp_clear(&vd);
+        }
+        ogg_stream_clear(&os);
+        vorbis_comment_clear(&vc);
+        vorbis_info_clear(&vi);
+      }
+      ogg_stream_init(&os,ogg_page_serialno(&og));
+      vorbis_info_init(&vi);
+      vorbis_comment_init(&vc);
+      headers=0;
+    }
+    if(headers<0)continue;
+
+    ogg_stream_pagein(&os,&og);
+    while(ogg_stream_packetout(&os,&op)>0){
+      float **pcm;
+      int     n;
+      if(headers<3){
+        if(vorbis_synthesis_headerin(&vi,&vc,&op)){
+          fprintf(stderr,"%s: bad header\n",st->name);
+          exit(1);
+        }
+        if(++headers==3){
+          vorbis_synthesis_init(&vd,&vi);
+          vorbis_synthesis_fused(&vd,fused);
+          vorbis_block_init(&vd,&vb);
+        }
+        continue;
+      }
+      if(vorbis_synthesis(&vb,&op)==0)
+        vorbis_synthesis_blockin(&vd,&vb);
+      while((n=vorbis_synthesis_pcmout(&vd,&pcm))>0){
+        r->samples+=(ogg_int64_t)n*vi.channels;
+        r->seconds+=(double)n/vi.rate;
+        r->check+=pcm[0][0]+pcm[vi.channels-1][n-1];
+        vorbis_synthesis_read(&vd,n);
+      }
+    }
+  }
+  if(headers>=0){
+    if(headers==3){
+      vorbis_block_clear(&vb);
+      vorbis_dsp_clear(&vd);
+    }
+    ogg_stream_clear(&os);
+    vorbis_comment_clear(&vc);
+    vorbis_info_clear(&vi);
+  }
+  ogg_sync_clear(&oy);
+}
+
+static void decode_synth(const bench_stream *st,const bench_buffer *b,
+                         bench_result *r){
+  decode_synth1(st,b,r,0);
+}
+
+static void decode_fused(const bench_stream *st,const bench_buffer *b,
+                         bench_result *r){
+  decode_synth1(st,b,r,1);
+}
+
+/* segment-parallel decoding, 16 bit, against the serial decode it
+   must match; the hash is FNV-1a over the PCM as written out */
+
+typedef struct {
+  ogg_int64_t  samples;
+  double       seconds;
+  ogg_uint32_t hash;
+} bench_pcm;
+
+static void pcm_add(bench_pcm *p,const char *pcm,long bytes,
+                    const vorbis_info *vi){
+  long i;
+  for(i=0;i<bytes;i++)p->hash=(p->hash^(unsigned char)pcm[i])*16777619U;
+  p->samples+=bytes/2;
+  p->seconds+=(double)bytes/(2*vi->channels)/vi->rate;
+}
+
+typedef struct {
+  OggVorbis_File *vf;
+  bench_pcm       pcm;
+} bench_par;
+
+static int parallel_write(void *arg,const char *pcm,long bytes,int link){
+  bench_par *p=arg;
+  pcm_add(&p->pcm,pcm,bytes,ov_info(p->vf,link));
+  return 0;
+}
+
+/* threads 0 is the serial decode */
+static void decode_parallel(const bench_stream *st,const bench_buffer *b,
+                            int threads,bench_pcm *r){
+  OggVorbis_File vf;
+  bench_par      p;
+
+  if(ov_open_memory(b->data,b->bytes,&vf)){
+    fprintf(stderr,"%s: cannot open\n",st->name);
+    exit(1);
+  }
+  memset(&p,0,sizeof(p));
+  p.vf=&vf;
+  p.pcm.hash=2166136261U;
+  if(threads){
+    int ret=ov_decode_parallel(&vf,threads,OV_FMT_S16,NULL,NULL,
+                               parallel_write,&p);
+    if(ret){
+      fprintf(stderr,"%s: parallel decode failed (%d)\n",st->name,ret);
+      exit(1);
+    }
+  }else{
+    char pcm[8192];
+    int  link=-1;
+    long ret;
+    while((ret=ov_read_format(&vf,pcm,sizeof(pcm),OV_FMT_S16,&link))>0)
+      pcm_add(&p.pcm,pcm,ret,ov_info(&vf,-1));
+  }
+  ov_clear(&vf);
+  *r=p.pcm;
+}
+
+/* open/clear churn; the arena hands out 16 byte aligned blocks from
+   one buffer and never frees, so it is reset between decoders */
+
+#define CHURN_PCM   16384    /* bytes read between open and clear */
+#define CHURN_ARENA (16<<20)
+
+typedef struct {
+  unsigned char *base;
+  size_t         top;
+  size_t         peak;
+} bench_arena;
+
+static void *arena_alloc(void *ctx,size_t bytes){
+  bench_arena *a=ctx;
+  void *ret;
+  bytes=(bytes+15)&~(size_t)15;
+  if(bytes>CHURN_ARENA-a->top)return NULL;
+  ret=a->base+a->top;
+  a->top+=bytes;
+  if(a->top>a->peak)a->peak=a->top;
+  return ret;
+}
+
+static ogg_uint32_t churn_round(const bench_stream *st,const bench_buffer *b,
+                                const ogg_allocator *allocator){
+  const ogg_allocator *prev=ogg_allocator_use(allocator);
+  OggVorbis_File vf;
+  bench_pcm      p;
+  char           pcm[4096];
+  int            link=-1;
+  long           ret;
+  int            failed=ov_open_memory(b->data,b->bytes,&vf);
+
+  ogg_allocator_use(prev);
+  if(failed){
+    fprintf(stderr,"%s: cannot open%s\n",st->name,
+            allocator?" in the arena":"");
+    exit(1);
+  }
+  memset(&p,0,sizeof(p));
+  p.hash=2166136261U;
+  while(p.samples*2<CHURN_PCM &&
+        (ret=ov_read(&vf,pcm,sizeof(pcm),0,2,1,&link))>0)
+    pcm_add(&p,pcm,ret,ov_info(&vf,-1));
+  ov_clear(&vf);
+  return p.hash;
+}
+
+/* measuring ********************************************************/
+
+static double now(void){
+  struct timespec t;
+  clock_gettime(CLOCK_MONOTONIC,&t);
+  return t.tv_sec+t.tv_nsec*1e-9;
+}
+
+/* start a fresh peak RSS where the kernel allows it (Linux 4.0 on) */
+static void peak_reset(void){
+  FILE *f=fopen("/proc/self/clear_refs","w");
+  if(f){
+    fputs("5",f);
+    fclose(f);
+  }
+}
+
+/* peak resident set, in kB; the process' lifetime peak where it
+   cannot be reset */
+static long peak_kb(void){
+  FILE *f=fopen("/proc/self/status","r");
+  long kb=-1;
+  if(f){
+    char line[256];
+    while(fgets(line,sizeof(line),f))
+      if(!strncmp(line,"VmHWM:",6)){
+        kb=atol(line+6);
+        break;
+      }
+    fclose(f);
+  }
+#ifdef __linux__
+  if(kb<0){
+    struct rusage ru;
+    if(!getrusage(RUSAGE_SELF,&ru))kb=ru.ru_maxrss;
+  }
+#endif
+  return kb;
+}
+
+static void measure(const bench_stream *st,const bench_buffer *b,int mode,
+                    int repeats,ogg_int64_t *samples){
+  void (*decode)(const bench_stream *,const bench_buffer *,
+                 bench_result *)=
+    mode==MODE_READ?decode_read:mode==MODE_FLOAT?decode_float:
+    mode==MODE_SYNTH?decode_synth:decode_fused;
+  const char *name=
+    mode==MODE_READ?"read":mode==MODE_FLOAT?"float":
+    mode==MODE_SYNTH?"synth":"fused";
+  bench_result r;
+  double best=-1;
+  long kb;
+  int i;
+
+  peak_reset();
+  for(i=0;i<repeats;i++){
+    double t0;
+    memset(&r,0,sizeof(r));
+    t0=now();
+    decode(st,b,&r);
+    t0=now()-t0;
+    if(best<0 || t0<best)best=t0;
+  }
+  kb=peak_kb();
+
+  printf("%-16s %-6s %10.1f %10.2f %9ld",
+         st->name,name,r.seconds/best,best*1e9/r.samples,kb);
+  /* all the modes must see the same audio */
+  if(*samples>=0 && *samples!=r.samples)
+    printf("  (%lld samples, not %lld)",
+           (long long)r.samples,(long long)*samples);
+  printf("\n");
+  *samples=r.samples;
+}
+
+static void measure_parallel(const bench_stream *st,const bench_buffer *b,
+                             int threads,int repeats){
+  bench_pcm serial,r;
+  double    base=-1;
+  int       t,i;
+
+  for(t=0;t<=threads;t++){
+    double best=-1;
+    long   kb;
+
+    peak_reset();
+    for(i=0;i<repeats;i++){
+      double t0=now();
+      decode_parallel(st,b,t,&r);
+      t0=now()-t0;
+      if(best<0 || t0<best)best=t0;
+    }
+    kb=peak_kb();
+    if(!t){
+      serial=r;
+      base=best;
+      continue;
+    }
+
+    printf("%-16s par%-3d %10.1f %10.2f %9ld %6.2fx",
+           st->name,t,r.seconds/best,best*1e9/r.samples,kb,base/best);
+    if(r.samples!=serial.samples || r.hash!=serial.hash)
+      printf("  (PCM differs from the serial decode)");
+    printf("\n");
+  }
+}
+
+static void measure_churn(const bench_stream *st,const bench_buffer *b,
+                          int opens,int repeats){
+  bench_arena   a;
+  ogg_allocator arena={arena_alloc,NULL,NULL};
+  ogg_uint32_t  heap_hash=0,arena_hash=0;
+  double        best[2]={-1,-1};
+  int           r,i,k;
+
+  a.base=malloc(CHURN_ARENA);
+  a.top=a.peak=0;
+  arena.ctx=&a;
+  if(!a.base){
+    fprintf(stderr,"out of memory\n");
+    exit(1);
+  }
+
+  for(r=0;r<repeats;r++)
+    for(k=0;k<2;k++){
+      double t0=now();
+      for(i=0;i<opens;i++){
+        ogg_uint32_t h=churn_round(st,b,k?&arena:NULL);
+        if(k){
+          arena_hash=h;
+          a.top=0;
+        }else
+          heap_hash=h;
+      }
+      t0=now()-t0;
+      if(best[k]<0 || t0<best[k])best[k]=t0;
+    }
+
+  printf("%-16s churn  heap %8.1f us, arena %8.1f us (%.2fx), "
+         "arena peak %ld kB%s\n",st->name,best[0]*1e6/opens,
+         best[1]*1e6/opens,best[0]/best[1],(long)(a.peak>>10),
+         heap_hash!=arena_hash?"  (PCM differs)":"");
+  free(a.base);
+}
+
+int main(int argc,char **argv){
+  double      seconds=20;
+  int         repeats=3;
+  int         modes=MODE_READ|MODE_FLOAT|MODE_SYNTH;
+  int         threads=0;
+  int         opens=0;
+  const char *only=NULL;
+  const char *dir=NULL;
+  int         i,j;
+
+  for(i=1;i<argc;i++){
+    if(i+1<argc && !strcmp(argv[i],"-s"))seconds=atof(argv[++i]);
+    else if(i+1<argc && !strcmp(argv[i],"-r"))repeats=atoi(argv[++i]);
+    else if(i+1<argc && !strcmp(argv[i],"-t"))threads=atoi(argv[++i]);
+    else if(i+1<argc && !strcmp(argv[i],"-c"))opens=atoi(argv[++i]);
+    else if(i+1<argc && !strcmp(argv[i],"-o"))only=argv[++i];
+    else if(i+1<argc && !strcmp(argv[i],"-w"))dir=argv[++i];
+    else if(i+1<argc && !strcmp(argv[i],"-m")){
+      const char *m=argv[++i];
+      modes=(strstr(m,"read")?MODE_READ:0)|
+        (strstr(m,"float")?MODE_FLOAT:0)|
+        (strstr(m,"synth")?MODE_SYNTH:0)|
+        (strstr(m,"fused")?MODE_FUSED:0);
+    }else{
+      fprintf(stderr,"usage: %s [-s seconds] [-r repeats] "
+              "[-m read,float,synth,fused] [-t threads] [-c opens] "
+              "[-o name] [-w dir]\n",argv[0]);
+      return 1;
+    }
+  }
+  if(seconds<=0 || repeats<1 || threads<0 || opens<0 ||
+     (!modes && !threads && !opens)){
+    fprintf(stderr,"nothing to do\n");
+    return 1;
+  }
+
+  printf("%-16s %-6s %10s %10s %9s%s\n",
+         "stream","mode","x-realtime","ns/sample","peak kB",
+         threads?" speedup":"");
+  for(i=0;i<STREAMS;i++){
+    const bench_stream *st=corpus+i;
+    bench_buffer        b={NULL,0,0};
+    ogg_int64_t         samples=-1;
+
+    if(only && !strstr(st->name,only))continue;
+    for(j=0;j<st->links;j++)
+      bench_encode(st->link+j,1000*i+j+1,seconds,&b);
+
+    if(dir){
+      char  path[1024];
+      FILE *f;
+      sprintf(path,"%.1000s/%s.ogg",dir,st->name);
+      f=fopen(path,"wb");
+      if(!f || fwrite(b.data,1,b.bytes,f)!=(size_t)b.bytes){
+        fprintf(stderr,"cannot write %s\n",path);
+        return 1;
+      }
+      fclose(f);
+    }
+
+    if(modes&MODE_READ)measure(st,&b,MODE_READ,repeats,&samples);
+    if(modes&MODE_FLOAT)measure(st,&b,MODE_FLOAT,repeats,&samples);
+    if(modes&MODE_SYNTH)measure(st,&b,MODE_SYNTH,repeats,&samples);
+    if(modes&MODE_FUSED)measure(st,&b,MODE_FUSED,repeats,&samples);
+    if(threads && st->seekable)measure_parallel(st,&b,threads,repeats);
+    if(opens && st->seekable)measure_churn(st,&b,opens,repeats);
+    free(b.data);
+  }
+  return 0;
+}
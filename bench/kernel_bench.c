@@ -0,0 +1,777 @@
+/********************************************************************
+ *                                                                  *
+ * THIS FILE IS PART OF THE OggVorbis SOFTWARE CODEC SOURCE CODE.   *
+ * USE, DISTRIBUTION AND REPRODUCTION OF THIS LIBRARY SOURCE IS     *
+ * GOVERNED BY A BSD-STYLE SOURCE LICENSE INCLUDED WITH THIS SOURCE *
+ * IN 'COPYING'. PLEASE READ THESE TERMS BEFORE DISTRIBUTING.       *
+ *                                                                  *
+ * THE OggVorbis SOURCE CODE IS (C) COPYRIGHT 1994-2009             *
+ * by the Xiph.Org Foundation http://www.xiph.org/                  *
+ *                                                                  *
+ ********************************************************************
+
+ function: microbenchmarks of the hot decode kernels
+
+ ********************************************************************/
+
+/* Decodes one stream packet by packet, doing what mapping0_inverse
+   does one step at a time and keeping the input of each step, then
+   times the kernels one by one over those inputs: the bit reader,
+   codeword and VQ decode, floor rendering, decoupling, the MDCT both
+   ways, the real FFT the encoder uses, page sync and CRC, the
+   overlap-add, and the PCM packers behind ov_read_format and
+   ov_read_filter, alone and with the overlap-add as they do it.
+
+   kernel_bench [-i file.ogg] [-n channels] [-s seconds] [-r repeats]
+                [-k name] [-b baseline] [-c baseline] [-t percent]
+
+   -i  take the inputs from the first link of this file; otherwise
+       from a stream encoded on the spot
+   -n  channels of that stream: 1 (44.1kHz q5), 2 (44.1kHz q5, the
+       default) or 6 (5.1, 48kHz q4, with three coupling steps)
+   -s  seconds of audio to encode (default 10)
+   -r  measurements per kernel; the fastest counts (default 5)
+   -k  only kernels whose name contains this
+   -b  write the results to a baseline file
+   -c  compare with a baseline file written by -b
+   -t  with -c, the slowdown in percent that counts as a regression
+       (default 10)
+
+   The codeword kernels decode the stream's own packets with each of
+   its books in turn; the bits are real, though not the ones each book
+   would see in a decode.  With -c the exit status is 1 if any kernel
+   regressed, so a script can run it against a baseline from a known
+   good build.
+
+   Built with -DVORBIS_DECODE_TABLE_STATS=ON, it first prints for each
+   book how the codewords of the captured decode were resolved: from
+   the first table, from a second level table, or by search.  A large
+   search share on a book with long codewords says the table budget
+   is too small for it. */
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <time.h>
+#include "vorbis/codec.h"
+#include "vorbis/vorbisfile.h"
+#include "codec_internal.h"
+#include "codebook.h"
+#include "registry.h"
+#include "misc.h"
+#include "mdct.h"
+#include "smallft.h"
+#include "window.h"
+#include "pcmpack.h"
+#include "bench_corpus.h"
+
+/* the captured inputs **********************************************/
+
+typedef struct {
+  int            W;      /* short or long block */
+  int            floor;  /* floor number, for floor inputs */
+  long           n;      /* bytes, lines or samples */
+  unsigned char *packet;
+  int           *memo;   /* floor1 posts, from inverse1 */
+  float         *x;
+  float         *y;
+} kb_input;
+
+typedef struct {
+  kb_input *v;
+  long      count;
+  long      storage;
+} kb_list;
+
+static kb_input *list_add(kb_list *l){
+  if(l->count==l->storage){
+    l->storage=l->storage?l->storage*2:256;
+    l->v=realloc(l->v,sizeof(*l->v)*l->storage);
+    if(!l->v){
+      fprintf(stderr,"out of memory\n");
+      exit(1);
+    }
+  }
+  memset(l->v+l->count,0,sizeof(*l->v));
+  return l->v+l->count++;
+}
+
+static void *copy(const void *p,size_t bytes){
+  void *ret=malloc(bytes);
+  if(!ret){
+    fprintf(stderr,"out of memory\n");
+    exit(1);
+  }
+  memcpy(ret,p,bytes);
+  return ret;
+}
+
+static bench_buffer     stream;
+static vorbis_info      vi;
+static vorbis_dsp_state vd;
+static vorbis_block     vb;
+
+static kb_list packets; /* audio packets */
+static kb_list floors;  /* residue and floor1 memo, before inverse2 */
+static kb_list pairs;   /* magnitude and angle, before decoupling */
+static kb_list spectra; /* before the inverse MDCT */
+static kb_list blocks;  /* after the inverse MDCT */
+
+static float **pcm;     /* decoded audio, one vector per channel */
+static long    frames;
+
+/* keeps the results live */
+double kb_sink;
+
+/* the work of mapping0_inverse, saving the inputs of each step */
+static void capture_packet(ogg_packet *op){
+  codec_setup_info     *ci=vi.codec_setup;
+  private_state        *b=vd.backend_state;
+  vorbis_info_mapping0 *info;
+  void                 *memo[256];
+  float                *bundle[256];
+  int                   nonzero[256];
+  int                   zero[256];
+  kb_input             *in;
+  long                  n;
+  int                   i,j;
+
+  in=list_add(&packets);
+  in->n=op->bytes;
+  in->packet=copy(op->packet,op->bytes);
+
+  if(vorbis_synthesis_trackonly(&vb,op))return;
+  if(ci->map_type[ci->mode_param[vb.mode]->mapping]!=0)return;
+  info=(vorbis_info_mapping0 *)ci->map_param[ci->mode_param[vb.mode]->
+                                             mapping];
+  n=vb.pcmend=ci->blocksizes[vb.W];
+  vb.pcm=_vorbis_block_alloc(&vb,sizeof(*vb.pcm)*vi.channels);
+  for(i=0;i<vi.channels;i++)
+    vb.pcm[i]=_vorbis_block_alloc(&vb,sizeof(*vb.pcm[i])*n);
+
+  for(i=0;i<vi.channels;i++){
+    int floor=info->floorsubmap[info->chmuxlist[i]];
+    memo[i]=_floor_P[ci->floor_type[floor]]->inverse1(&vb,b->flr[floor]);
+    nonzero[i]=memo[i]!=NULL;
+    memset(vb.pcm[i],0,sizeof(*vb.pcm[i])*n/2);
+  }
+  for(i=0;i<info->coupling_steps;i++){
+    if(nonzero[info->coupling_mag[i]] ||
+       nonzero[info->coupling_ang[i]]){
+      nonzero[info->coupling_mag[i]]=1;
+      nonzero[info->coupling_ang[i]]=1;
+    }
+  }
+  for(i=0;i<info->submaps;i++){
+    int ch_in_bundle=0;
+    for(j=0;j<vi.channels;j++){
+      if(info->chmuxlist[j]==i){
+        zero[ch_in_bundle]=nonzero[j];
+        bundle[ch_in_bundle++]=vb.pcm[j];
+      }
+    }
+    _residue_P[ci->residue_type[info->residuesubmap[i]]]->
+      inverse(&vb,b->residue[info->residuesubmap[i]],
+              bundle,zero,ch_in_bundle);
+  }
+
+  for(i=info->coupling_steps-1;i>=0;i--){
+    float *pcmM=vb.pcm[info->coupling_mag[i]];
+    float *pcmA=vb.pcm[info->coupling_ang[i]];
+    if(nonzero[info->coupling_mag[i]]){
+      in=list_add(&pairs);
+      in->n=n/2;
+      in->x=copy(pcmM,sizeof(*pcmM)*n/2);
+      in->y=copy(pcmA,sizeof(*pcmA)*n/2);
+    }
+    mapping0_decouple(pcmM,pcmA,n/2);
+  }
+
+  for(i=0;i<vi.channels;i++){
+    int floor=info->floorsubmap[info->chmuxlist[i]];
+    if(!memo[i])continue;
+    if(ci->floor_type[floor]==1){
+      vorbis_look_floor1 *look=(vorbis_look_floor1 *)b->flr[floor];
+      in=list_add(&floors);
+      in->W=vb.W;
+      in->floor=floor;
+      in->n=n/2;
+      in->memo=copy(memo[i],sizeof(int)*look->posts);
+      in->x=copy(vb.pcm[i],sizeof(*vb.pcm[i])*n/2);
+    }
+    _floor_P[ci->floor_type[floor]]->
+      inverse2(&vb,b->flr[floor],memo[i],vb.pcm[i]);
+
+    in=list_add(&spectra);
+    in->W=vb.W;
+    in->n=n;
+    in->x=copy(vb.pcm[i],sizeof(*vb.pcm[i])*n/2);
+    mdct_backward(b->transform[vb.W][0],vb.pcm[i],vb.pcm[i]);
+
+    in=list_add(&blocks);
+    in->W=vb.W;
+    in->n=n;
+    in->x=copy(vb.pcm[i],sizeof(*vb.pcm[i])*n);
+  }
+}
+
+/* sets up a decoder for the first link of the stream and captures
+   every audio packet of it */
+static void capture(void){
+  ogg_sync_state   oy;
+  ogg_stream_state os;
+  ogg_page         og;
+  ogg_packet       op;
+  vorbis_comment   vc;
+  int              headers=-1;
+
+  ogg_sync_init(&oy);
+  memcpy(ogg_sync_buffer(&oy,stream.bytes),stream.data,stream.bytes);
+  ogg_sync_wrote(&oy,stream.bytes);
+  vorbis_info_init(&vi);
+  vorbis_comment_init(&vc);
+
+  while(ogg_sync_pageout(&oy,&og)>0){
+    if(ogg_page_bos(&og)){
+      if(headers>=0)break;
+      ogg_stream_init(&os,ogg_page_serialno(&og));
+      headers=0;
+    }
+    if(headers<0 || ogg_stream_pagein(&os,&og))continue;
+    while(ogg_stream_packetout(&os,&op)>0){
+      if(headers<3){
+        if(vorbis_synthesis_headerin(&vi,&vc,&op)){
+          fprintf(stderr,"not a Vorbis stream\n");
+          exit(1);
+        }
+        if(++headers==3){
+          vorbis_synthesis_init(&vd,&vi);
+          vorbis_block_init(&vd,&vb);
+        }
+        continue;
+      }
+      capture_packet(&op);
+    }
+  }
+  if(headers<3){
+    fprintf(stderr,"no Vorbis stream\n");
+    exit(1);
+  }
+  ogg_stream_clear(&os);
+  ogg_sync_clear(&oy);
+  vorbis_comment_clear(&vc);
+
+  /* and the audio of the same link, for the packers */
+  {
+    OggVorbis_File vf;
+    float        **out;
+    int            link=-1,i;
+    long           ret,storage=0;
+
+    if(ov_open_memory(stream.data,stream.bytes,&vf)){
+      fprintf(stderr,"cannot open the stream\n");
+      exit(1);
+    }
+    pcm=calloc(vi.channels,sizeof(*pcm));
+    while((ret=ov_read_float(&vf,&out,4096,&link))>0 && link==0){
+      if(frames+ret>storage){
+        storage=(frames+ret)*2;
+        for(i=0;i<vi.channels;i++)
+          pcm[i]=realloc(pcm[i],sizeof(**pcm)*storage);
+      }
+      for(i=0;i<vi.channels;i++)
+        memcpy(pcm[i]+frames,out[i],sizeof(**pcm)*ret);
+      frames+=ret;
+    }
+    ov_clear(&vf);
+  }
+}
+
+/* the kernels; each makes one pass over its inputs and returns how
+   many units of work that was *************************************/
+
+/* field widths, much as a packet header, floor and residue mix them */
+static const int widths[16]={1,8,4,1,7,12,3,16,1,6,24,2,10,5,1,9};
+
+static long run_oggpack_read(int arg){
+  oggpack_buffer opb;
+  long           calls=0,i,j;
+  (void)arg;
+  for(i=0;i<packets.count;i++){
+    oggpack_readinit(&opb,packets.v[i].packet,packets.v[i].n);
+    for(j=0;;j++){
+      long v=oggpack_read(&opb,widths[j&15]);
+      if(v<0)break;
+      kb_sink+=v;
+    }
+    calls+=j;
+  }
+  return calls;
+}
+
+static long run_oggpack_look(int arg){
+  oggpack_buffer opb;
+  long           calls=0,i,j;
+  (void)arg;
+  for(i=0;i<packets.count;i++){
+    oggpack_readinit(&opb,packets.v[i].packet,packets.v[i].n);
+    for(j=0;;j++){
+      long v=oggpack_look(&opb,widths[j&15]);
+      if(v<0)break;
+      oggpack_adv(&opb,widths[j&15]);
+      kb_sink+=v;
+    }
+    calls+=j;
+  }
+  return calls;
+}
+
+static long run_book_decode(int arg){
+  codec_setup_info *ci=vi.codec_setup;
+  oggpack_buffer    opb;
+  oggpack_cache     opc;
+  long              words=0,i,j,k;
+  (void)arg;
+  for(i=0;i<ci->books;i++){
+    codebook *book=ci->fullbooks+i;
+    if(book->used_entries<=0)continue;
+    for(j=0;j<packets.count;j++){
+      long bits=packets.v[j].n*8;
+      oggpack_readinit(&opb,packets.v[j].packet,packets.v[j].n);
+      oggpack_cache_init(&opc,&opb);
+      for(k=0;k<bits;k++){
+        long entry=vorbis_book_decode(book,&opc);
+        if(entry<0)break;
+        kb_sink+=entry;
+      }
+      words+=k;
+    }
+  }
+  return words;
+}
+
+/* arg is the channel count for decodevv_add, 1 for decodev_add or 0
+   for decodevs_add */
+static long run_book_decodev(int arg){
+  codec_setup_info *ci=vi.codec_setup;
+  oggpack_buffer    opb;
+  oggpack_cache     opc;
+  float             work[2][256];
+  float            *a[2];
+  int               ch=arg?arg:1;
+  long              values=0,i,j,k;
+
+  a[0]=work[0];
+  a[1]=work[1];
+  for(i=0;i<ci->books;i++){
+    codebook *book=ci->fullbooks+i;
+    long      n;
+    if(book->used_entries<=0 || !book->valuelist)continue;
+    n=book->dim*8*ch;
+    if(n>256)n=book->dim*ch;
+    if(n>256)continue;
+    for(j=0;j<packets.count;j++){
+      long bits=packets.v[j].n*8;
+      memset(work,0,sizeof(work));
+      oggpack_readinit(&opb,packets.v[j].packet,packets.v[j].n);
+      oggpack_cache_init(&opc,&opb);
+      for(k=0;k<bits;k++){
+        long ret=arg==0?
+          vorbis_book_decodevs_add(book,work[0],&opc,(int)n):
+          arg==1?
+          vorbis_book_decodev_add(book,work[0],&opc,(int)n):
+          vorbis_book_decodevv_add(book,a,0,arg,&opc,(int)n);
+        if(ret<0)break;
+      }
+      values+=k*n;
+      kb_sink+=work[0][0]+work[ch-1][n/ch-1];
+    }
+  }
+  return values;
+}
+
+static long run_floor1_inverse2(int arg){
+  private_state *b=vd.backend_state;
+  float          work[4096];
+  long           lines=0,i;
+  (void)arg;
+  for(i=0;i<floors.count;i++){
+    kb_input *in=floors.v+i;
+    memcpy(work,in->x,sizeof(*work)*in->n);
+    vb.W=in->W;
+    _floor_P[1]->inverse2(&vb,b->flr[in->floor],in->memo,work);
+    kb_sink+=work[0];
+    lines+=in->n;
+  }
+  return lines;
+}
+
+static long run_decouple(int arg){
+  float work[2][4096];
+  long  lines=0,i;
+  (void)arg;
+  for(i=0;i<pairs.count;i++){
+    kb_input *in=pairs.v+i;
+    memcpy(work[0],in->x,sizeof(**work)*in->n);
+    memcpy(work[1],in->y,sizeof(**work)*in->n);
+    mapping0_decouple(work[0],work[1],in->n);
+    kb_sink+=work[0][0]+work[1][in->n-1];
+    lines+=in->n;
+  }
+  return lines;
+}
+
+static long run_mdct_backward(int arg){
+  private_state *b=vd.backend_state;
+  float          out[8192];
+  long           samples=0,i;
+  (void)arg;
+  for(i=0;i<spectra.count;i++){
+    kb_input *in=spectra.v+i;
+    mdct_backward(b->transform[in->W][0],in->x,out);
+    kb_sink+=out[0];
+    samples+=in->n;
+  }
+  return samples;
+}
+
+static long run_mdct_forward(int arg){
+  private_state *b=vd.backend_state;
+  float          out[4096];
+  long           samples=0,i;
+  (void)arg;
+  for(i=0;i<blocks.count;i++){
+    kb_input *in=blocks.v+i;
+    mdct_forward(b->transform[in->W][0],in->x,out);
+    kb_sink+=out[0];
+    samples+=in->n;
+  }
+  return samples;
+}
+
+static long run_drft_forward(int arg){
+  static drft_lookup fft[2];
+  static int         ready;
+  codec_setup_info  *ci=vi.codec_setup;
+  float              work[8192];
+  long               samples=0,i;
+  (void)arg;
+  if(!ready){
+    drft_init(fft,ci->blocksizes[0]);
+    drft_init(fft+1,ci->blocksizes[1]);
+    ready=1;
+  }
+  for(i=0;i<blocks.count;i++){
+    kb_input *in=blocks.v+i;
+    memcpy(work,in->x,sizeof(*work)*in->n);
+    drft_forward(fft+in->W,work);
+    kb_sink+=work[1];
+    samples+=in->n;
+  }
+  return samples;
+}
+
+/* the whole stream through the page sync, as vorbisfile feeds it */
+static long run_pageseek(int arg){
+  static ogg_sync_state oy;
+  static int            ready;
+  ogg_page              og;
+  long                  pos=0;
+  (void)arg;
+  if(!ready){
+    ogg_sync_init(&oy);
+    ready=1;
+  }
+  ogg_sync_reset(&oy);
+  while(pos<stream.bytes){
+    long bytes=stream.bytes-pos;
+    if(bytes>4096)bytes=4096;
+    memcpy(ogg_sync_buffer(&oy,bytes),stream.data+pos,bytes);
+    ogg_sync_wrote(&oy,bytes);
+    pos+=bytes;
+    while(ogg_sync_pageseek(&oy,&og)>0)
+      kb_sink+=og.body_len;
+  }
+  return stream.bytes;
+}
+
+/* arg is the OV_FMT_ format */
+static long run_pack(int arg){
+  unsigned char out[4096*4*8];
+  float        *src[256];
+  long          pos,step=4096*8/vi.channels;
+  int           i;
+  for(pos=0;pos<frames;pos+=step){
+    long n=frames-pos;
+    if(n>step)n=step;
+    for(i=0;i<vi.channels;i++)src[i]=pcm[i]+pos;
+    _ov_pcm_pack(out,src,vi.channels,n,arg);
+    kb_sink+=out[0];
+  }
+  return frames*vi.channels;
+}
+
+/* the overlap-add, the audio lapped with itself a long block later
+   over the long window; arg is the OV_FMT_ format to pack it to as
+   it goes, or 0 to leave it as floats */
+static long run_lap(int arg){
+  private_state    *b=vd.backend_state;
+  codec_setup_info *ci=vi.codec_setup;
+  const float      *w=_vorbis_window_get(b->window[1]);
+  long              n=ci->blocksizes[1]/2;
+  long              step=4096*8/vi.channels;
+  unsigned char     out[4096*4*8];
+  float             work[4096];
+  float            *prev[256],*cur[256];
+  long              pos,j,k,samples=0;
+  int               i;
+  for(pos=0;pos+2*n<=frames;pos+=n){
+    for(j=0;j<n;j+=k){
+      k=n-j;
+      if(k>step)k=step;
+      for(i=0;i<vi.channels;i++){
+        prev[i]=pcm[i]+pos+j;
+        cur[i]=pcm[i]+pos+n+j;
+      }
+      if(arg){
+        _ov_pcm_pack_lap(out,prev,cur,w+j,w+n-1-j,vi.channels,k,arg);
+        kb_sink+=out[0];
+      }else{
+        for(i=0;i<vi.channels;i++){
+          _vorbis_lap(work,prev[i],cur[i],w+j,w+n-1-j,k);
+          kb_sink+=work[0];
+        }
+      }
+    }
+    samples+=n*vi.channels;
+  }
+  return samples;
+}
+
+typedef struct {
+  const char *name;
+  const char *unit;
+  long      (*run)(int arg);
+  int         arg;
+} kb_kernel;
+
+static const kb_kernel kernels[]={
+  {"oggpack_read",         "call",   run_oggpack_read,    0},
+  {"oggpack_look",         "call",   run_oggpack_look,    0},
+  {"book_decode",          "word",   run_book_decode,     0},
+  {"book_decodev_add",     "value",  run_book_decodev,    1},
+  {"book_decodevs_add",    "value",  run_book_decodev,    0},
+  {"book_decodevv_add",    "value",  run_book_decodev,    2},
+  {"floor1_inverse2",      "line",   run_floor1_inverse2, 0},
+  {"mapping0_decouple",    "line",   run_decouple,        0},
+  {"mdct_backward",        "sample", run_mdct_backward,   0},
+  {"mdct_forward",         "sample", run_mdct_forward,    0},
+  {"drft_forward",         "sample", run_drft_forward,    0},
+  {"ogg_sync_pageseek",    "byte",   run_pageseek,        0},
+  {"pack_s16",             "sample", run_pack, OV_FMT_S16},
+  {"pack_s16be",           "sample", run_pack, OV_FMT_S16|OV_FMT_BIGENDIAN},
+  {"pack_u16",             "sample", run_pack, OV_FMT_S16|OV_PCM_UNSIGNED},
+  {"pack_s24",             "sample", run_pack, OV_FMT_S24},
+  {"pack_s32",             "sample", run_pack, OV_FMT_S32},
+  {"pack_float",           "sample", run_pack, OV_FMT_FLOAT},
+  {"lap",                  "sample", run_lap,   0},
+  {"lap_pack_s16",         "sample", run_lap,   OV_FMT_S16},
+  {"lap_pack_float",       "sample", run_lap,   OV_FMT_FLOAT},
+};
+#define KERNELS ((int)(sizeof(kernels)/sizeof(*kernels)))
+
+#ifdef VORBIS_DECODE_TABLE_STATS
+/* the decode table counters, which capture() has run up */
+static void table_stats(void){
+  codec_setup_info *ci=vi.codec_setup;
+  long              sum[3]={0,0,0};
+  int               i;
+
+  printf("%-6s %7s %6s %6s %8s %7s %7s %7s\n","book","entries","maxlen",
+         "bits","words","first","second","search");
+  for(i=0;i<ci->books;i++){
+    codebook *book=ci->fullbooks+i;
+    long      n=book->dec_firsthits+book->dec_secondhits+book->dec_searches;
+    if(!n)continue;
+    printf("%-6d %7ld %6d %6d %8ld %6.1f%% %6.1f%% %6.1f%%\n",i,
+           book->used_entries,book->dec_maxlength,book->dec_firsttablen,n,
+           book->dec_firsthits*100./n,book->dec_secondhits*100./n,
+           book->dec_searches*100./n);
+    sum[0]+=book->dec_firsthits;
+    sum[1]+=book->dec_secondhits;
+    sum[2]+=book->dec_searches;
+  }
+  if(sum[0]+sum[1]+sum[2]){
+    double n=sum[0]+sum[1]+sum[2];
+    printf("%-6s %7s %6s %6s %8.0f %6.1f%% %6.1f%% %6.1f%%\n\n","all",
+           "","","",n,sum[0]*100./n,sum[1]*100./n,sum[2]*100./n);
+  }
+}
+#endif
+
+/* measuring ********************************************************/
+
+/* each measurement runs passes for at least this long */
+#define MIN_SECONDS .05
+
+static double now(void){
+  struct timespec t;
+  clock_gettime(CLOCK_MONOTONIC,&t);
+  return t.tv_sec+t.tv_nsec*1e-9;
+}
+
+/* the fastest of repeats measurements, in ns per unit; -1 if the
+   inputs have none of the kernel's work in them */
+static double measure(const kb_kernel *k,int repeats){
+  double best=-1;
+  long   passes=1;
+  int    i;
+
+  /* warm the caches and find how many passes fill MIN_SECONDS */
+  while(1){
+    double t0=now();
+    long   j;
+    for(j=0;j<passes;j++)
+      if(k->run(k->arg)<=0)return -1;
+    if(now()-t0>=MIN_SECONDS)break;
+    passes*=2;
+  }
+
+  for(i=0;i<repeats;i++){
+    double t0=now(),ns;
+    long   units=0,j;
+    for(j=0;j<passes;j++)units+=k->run(k->arg);
+    ns=(now()-t0)*1e9/units;
+    if(best<0 || ns<best)best=ns;
+  }
+  return best;
+}
+
+/* a baseline file holds a line of kernel name and ns per unit for
+   each kernel measured */
+static double baseline_find(FILE *f,const char *name){
+  char   line[256],key[64];
+  double ns;
+  rewind(f);
+  while(fgets(line,sizeof(line),f))
+    if(sscanf(line,"%63s %lf",key,&ns)==2 && !strcmp(key,name))
+      return ns;
+  return -1;
+}
+
+int main(int argc,char **argv){
+  const char *input=NULL;
+  const char *only=NULL;
+  const char *save=NULL;
+  const char *compare=NULL;
+  int         channels=2;
+  double      seconds=10;
+  double      threshold=10;
+  int         repeats=5;
+  int         regressions=0;
+  FILE       *out=NULL;
+  FILE       *base=NULL;
+  int         i;
+
+  for(i=1;i<argc;i++){
+    if(i+1<argc && !strcmp(argv[i],"-i"))input=argv[++i];
+    else if(i+1<argc && !strcmp(argv[i],"-n"))channels=atoi(argv[++i]);
+    else if(i+1<argc && !strcmp(argv[i],"-s"))seconds=atof(argv[++i]);
+    else if(i+1<argc && !strcmp(argv[i],"-r"))repeats=atoi(argv[++i]);
+    else if(i+1<argc && !strcmp(argv[i],"-k"))only=argv[++i];
+    else if(i+1<argc && !strcmp(argv[i],"-b"))save=argv[++i];
+    else if(i+1<argc && !strcmp(argv[i],"-c"))compare=argv[++i];
+    else if(i+1<argc && !strcmp(argv[i],"-t"))threshold=atof(argv[++i]);
+    else{
+      fprintf(stderr,"usage: %s [-i file.ogg] [-n 1|2|6] [-s seconds] "
+              "[-r repeats] [-k name] [-b baseline] [-c baseline] "
+              "[-t percent]\n",argv[0]);
+      return 1;
+    }
+  }
+  if(seconds<=0 || repeats<1 || threshold<0 ||
+     (channels!=1 && channels!=2 && channels!=6)){
+    fprintf(stderr,"nothing to do\n");
+    return 1;
+  }
+
+  if(input){
+    FILE         *f=fopen(input,"rb");
+    unsigned char buf[4096];
+    size_t        bytes;
+    if(!f){
+      fprintf(stderr,"cannot open %s\n",input);
+      return 1;
+    }
+    while((bytes=fread(buf,1,sizeof(buf),f))>0)
+      bench_write(&stream,buf,(long)bytes);
+    fclose(f);
+  }else{
+    bench_link l={2,44100,.5f};
+    if(channels==6){
+      l.rate=48000;
+      l.quality=.4f;
+    }
+    l.channels=channels;
+    bench_encode(&l,1,seconds,&stream);
+  }
+  capture();
+
+  if(compare && !(base=fopen(compare,"r"))){
+    fprintf(stderr,"cannot read %s\n",compare);
+    return 1;
+  }
+  if(save && !(out=fopen(save,"w"))){
+    fprintf(stderr,"cannot write %s\n",save);
+    return 1;
+  }
+
+  printf("%dch %ldHz, %ld packets, %ld frames\n",
+         vi.channels,vi.rate,packets.count,frames);
+#ifdef VORBIS_DECODE_TABLE_STATS
+  table_stats();
+#endif
+  printf("%-18s %-6s %10s",
+         "kernel","unit","ns/unit");
+  if(base)printf(" %10s %8s",
+                 "baseline","change");
+  printf("\n");
+
+  for(i=0;i<KERNELS;i++){
+    const kb_kernel *k=kernels+i;
+    double           ns;
+
+    if(only && !strstr(k->name,only))continue;
+    ns=measure(k,repeats);
+    if(ns<0){
+      printf("%-18s %-6s %10s\n",k->name,k->unit,"-");
+      continue;
+    }
+    printf("%-18s %-6s %10.3f",k->name,k->unit,ns);
+    if(out)fprintf(out,"%s %.4f\n",k->name,ns);
+    if(base){
+      double was=baseline_find(base,k->name);
+      if(was>0){
+        double change=(ns/was-1.)*100.;
+        printf(" %10.3f %+7.1f%%",was,change);
+        if(change>threshold){
+          printf("  REGRESSED");
+          regressions++;
+        }
+      }
+    }
+    printf("\n");
+  }
+
+  if(out)fclose(out);
+  if(base){
+    fclose(base);
+    if(regressions)
+      printf("%d kernel%s slower than the baseline by over %g%%\n",
+             regressions,regressions>1?"s":"",threshold);
+  }
+  vorbis_block_clear(&vb);
+  vorbis_dsp_clear(&vd);
+  vorbis_info_clear(&vi);
+  return regressions?1:0;
+}
@@ -29,6 +29,16 @@ typedef struct {
   size_t iov_len;
 } ogg_iovec_t;
 
+/* a source of memory for the libraries; see ogg_allocator_use().
+   alloc should return blocks aligned as malloc's are.  free may be
+   NULL for an arena released in one go once everything drawn from it
+   is dead.  The allocator must outlive every block it hands out. */
+typedef struct ogg_allocator {
+  void *(*alloc)(void *ctx,size_t bytes);
+  void  (*free)(void *ctx,void *ptr);
+  void   *ctx;
+} ogg_allocator;
+
 typedef struct {
   long endbyte;
   int  endbit;
@@ -82,6 +92,9 @@ typedef struct {
                              layer) also knows about the gap */
   ogg_int64_t   granulepos;
 
+  unsigned char *body_store; /* own body buffer while body_data points
+                                into a page given to
+                                ogg_stream_pagein_ref() */
 } ogg_stream_state;
 
 /* ogg_packet is used to encapsulate the data and metadata belonging
@@ -111,8 +124,24 @@ typedef struct {
   int unsynced;
   int headerbytes;
   int bodybytes;
+
+  int crcbytes;      /* bytes of the page at returned already in crc */
+  ogg_uint32_t crc;
+
+  int external;      /* data belongs to the app; see ogg_sync_attach() */
+
+  const ogg_allocator *allocator; /* current at ogg_sync_init() */
 } ogg_sync_state;
 
+/* Ogg MEMORY ***************************************************/
+
+extern const ogg_allocator *ogg_allocator_use(const ogg_allocator *a);
+extern const ogg_allocator *ogg_allocator_current(void);
+extern void    *ogg_malloc(size_t bytes);
+extern void    *ogg_calloc(size_t count,size_t bytes);
+extern void    *ogg_realloc(void *ptr,size_t bytes);
+extern void     ogg_free(void *ptr);
+
 /* Ogg BITSTREAM PRIMITIVES: bitstream ************************/
 
 extern void  oggpack_writeinit(oggpack_buffer *b);
@@ -173,9 +202,15 @@ extern int      ogg_sync_check(ogg_sync_state *oy);
 
 extern char    *ogg_sync_buffer(ogg_sync_state *oy, long size);
 extern int      ogg_sync_wrote(ogg_sync_state *oy, long bytes);
+extern int      ogg_sync_write(ogg_sync_state *oy, const char *buffer, long bytes);
+extern int      ogg_sync_attach(ogg_sync_state *oy, const char *buffer, long bytes);
+extern int      ogg_sync_reserve(ogg_sync_state *oy, long bytes);
+extern int      ogg_sync_seek(ogg_sync_state *oy, long pos);
 extern long     ogg_sync_pageseek(ogg_sync_state *oy,ogg_page *og);
 extern int      ogg_sync_pageout(ogg_sync_state *oy, ogg_page *og);
 extern int      ogg_stream_pagein(ogg_stream_state *os, ogg_page *og);
+extern int      ogg_stream_pagein_ref(ogg_stream_state *os, ogg_page *og);
+extern int      ogg_stream_reserve(ogg_stream_state *os,long bytes,long segments);
 extern int      ogg_stream_packetout(ogg_stream_state *os,ogg_packet *op);
 extern int      ogg_stream_packetpeek(ogg_stream_state *os,ogg_packet *op);
 
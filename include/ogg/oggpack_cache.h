@@ -0,0 +1,168 @@
+/********************************************************************
+ *                                                                  *
+ * THIS FILE IS PART OF THE Ogg CONTAINER SOURCE CODE.              *
+ * USE, DISTRIBUTION AND REPRODUCTION OF THIS LIBRARY SOURCE IS     *
+ * GOVERNED BY A BSD-STYLE SOURCE LICENSE INCLUDED WITH THIS SOURCE *
+ * IN 'COPYING'. PLEASE READ THESE TERMS BEFORE DISTRIBUTING.       *
+ *                                                                  *
+ * THE OggVorbis SOURCE CODE IS (C) COPYRIGHT 1994-2014             *
+ * by the Xiph.Org Foundation http://www.xiph.org/                  *
+ *                                                                  *
+ ********************************************************************
+
+  function: inlinable cached bit reader for hot decode loops
+
+ ********************************************************************/
+#ifndef _OGGPACK_CACHE_H
+#define _OGGPACK_CACHE_H
+
+#include <ogg/ogg.h>
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+#ifdef __GNUC__
+#  define OGGPACK_INLINE static __inline__
+#elif defined(_MSC_VER)
+#  define OGGPACK_INLINE static __inline
+#else
+#  define OGGPACK_INLINE static
+#endif
+
+/* An oggpack_cache sits on top of an oggpack_buffer that is being read
+   and keeps up to 64 not-yet-consumed bits in a register sized
+   accumulator.  The accumulator is refilled a whole word at a time as
+   long as at least eight bytes of packet remain, so the common
+   look/adv/read path is a compare, a mask and a shift; only the last
+   few bytes of a packet are fed in byte by byte.
+
+   Usage is bracketed: oggpack_cache_init() takes over the buffer's
+   current position and oggpack_cache_sync() writes the position back,
+   after which the plain oggpack_* calls may be used again.  The
+   oggpack_buffer must not be touched in between.
+
+   Results, including end-of-packet behaviour, are identical to the
+   oggpack_look/oggpack_adv/oggpack_read calls they replace: a look
+   past the end returns -1 and leaves the position alone, an adv or
+   read past the end puts the buffer into the overflow state (which
+   bits < 0 stands for here) and every later call fails.  As with the
+   oggpack_* versions, 0 <= bits <= 32. */
+
+typedef struct {
+  ogg_uint64_t    acc;   /* unconsumed bits, next bit in the lsb */
+  int             bits;  /* valid bits in acc; -1 once overflowed */
+  unsigned char  *ptr;   /* next byte not yet in acc */
+  unsigned char  *end;   /* one past the last byte of the packet */
+  oggpack_buffer *b;
+} oggpack_cache;
+
+OGGPACK_INLINE void oggpack_cache_refill(oggpack_cache *c){
+  if(c->end-c->ptr>=8){
+    const unsigned char *p=c->ptr;
+    ogg_uint64_t w=
+      (ogg_uint64_t)p[0]     | (ogg_uint64_t)p[1]<<8  |
+      (ogg_uint64_t)p[2]<<16 | (ogg_uint64_t)p[3]<<24 |
+      (ogg_uint64_t)p[4]<<32 | (ogg_uint64_t)p[5]<<40 |
+      (ogg_uint64_t)p[6]<<48 | (ogg_uint64_t)p[7]<<56;
+    int n=(64-c->bits)>>3;
+
+    if(n==8){
+      c->acc=w;
+    }else{
+      c->acc|=(w&(((ogg_uint64_t)1<<(n<<3))-1))<<c->bits;
+    }
+    c->bits+=n<<3;
+    c->ptr+=n;
+  }else{
+    while(c->bits<=56 && c->ptr<c->end){
+      c->acc|=(ogg_uint64_t)*c->ptr++<<c->bits;
+      c->bits+=8;
+    }
+  }
+}
+
+OGGPACK_INLINE void oggpack_cache_overflow(oggpack_cache *c){
+  c->acc=0;
+  c->bits=-1;
+  c->ptr=c->end;
+}
+
+OGGPACK_INLINE void oggpack_cache_init(oggpack_cache *c,oggpack_buffer *b){
+  c->b=b;
+  c->acc=0;
+  c->bits=0;
+  c->end=b->buffer+b->storage;
+
+  if(b->endbyte>=b->storage && b->endbit){
+    /* buffer already overflowed */
+    oggpack_cache_overflow(c);
+    return;
+  }
+
+  c->ptr=b->ptr;
+  if(b->endbit){
+    oggpack_cache_refill(c);
+    c->acc>>=b->endbit;
+    c->bits-=b->endbit;
+  }
+}
+
+/* hands the read position back to the underlying oggpack_buffer */
+OGGPACK_INLINE void oggpack_cache_sync(oggpack_cache *c){
+  oggpack_buffer *b=c->b;
+
+  if(c->bits<0){
+    b->ptr=NULL;
+    b->endbyte=b->storage;
+    b->endbit=1;
+  }else{
+    long pos=(long)(c->ptr-b->buffer)*8-c->bits;
+    b->endbyte=pos>>3;
+    b->endbit=(int)(pos&7);
+    b->ptr=b->buffer+b->endbyte;
+  }
+}
+
+/* Read in bits without advancing the bitptr */
+OGGPACK_INLINE long oggpack_cache_look(oggpack_cache *c,int bits){
+  if(c->bits<bits){
+    oggpack_cache_refill(c);
+    if(c->bits<bits)return(-1);
+  }
+  return((long)(c->acc&(((ogg_uint64_t)1<<bits)-1)));
+}
+
+OGGPACK_INLINE void oggpack_cache_adv(oggpack_cache *c,int bits){
+  if(c->bits<bits){
+    oggpack_cache_refill(c);
+    if(c->bits<bits){
+      oggpack_cache_overflow(c);
+      return;
+    }
+  }
+  c->acc>>=bits;
+  c->bits-=bits;
+}
+
+OGGPACK_INLINE long oggpack_cache_read(oggpack_cache *c,int bits){
+  long ret;
+
+  if(c->bits<bits){
+    oggpack_cache_refill(c);
+    if(c->bits<bits){
+      oggpack_cache_overflow(c);
+      return(-1L);
+    }
+  }
+  ret=(long)(c->acc&(((ogg_uint64_t)1<<bits)-1));
+  c->acc>>=bits;
+  c->bits-=bits;
+  return(ret);
+}
+
+#ifdef __cplusplus
+}
+#endif
+
+#endif  /* _OGGPACK_CACHE_H */
@@ -83,8 +83,32 @@ typedef struct vorbis_dsp_state{
   ogg_int64_t res_bits;
 
   void       *backend_state;
+  const ogg_allocator *allocator; /* current at init */
 } vorbis_dsp_state;
 
+/* time spent in and calls made to one decode stage */
+typedef struct {
+  ogg_int64_t ns;
+  ogg_int64_t calls;
+} vorbis_stage;
+
+/* decode stage timings, kept when libvorbis is built with
+   VORBIS_PROFILE; see vorbis_synthesis_profile() */
+typedef struct {
+  vorbis_stage synthesis;    /* vorbis_synthesis(), all of the below */
+  vorbis_stage floor_unpack; /* reading the floors from the packet */
+  vorbis_stage residue;      /* reading the residue */
+  vorbis_stage decouple;     /* channel decoupling, unless fused */
+  vorbis_stage floor;        /* floor curves applied to the residue,
+                                and the decoupling when fused; see
+                                vorbis_synthesis_fused() */
+  vorbis_stage downmix;      /* see vorbis_synthesis_downmix() */
+  vorbis_stage imdct;        /* inverse MDCT */
+  vorbis_stage blockin;      /* vorbis_synthesis_blockin(): window and
+                                overlap-add, which vorbisfile's integer
+                                reads leave to their packing */
+} vorbis_profile;
+
 typedef struct vorbis_block{
   /* necessary stream state for linking to the framing abstraction */
   float  **pcm;       /* this is a pointer into local storage */
@@ -213,9 +237,20 @@ extern int      vorbis_synthesis_pcmout(vorbis_dsp_state *v,float ***pcm);
 extern int      vorbis_synthesis_lapout(vorbis_dsp_state *v,float ***pcm);
 extern int      vorbis_synthesis_read(vorbis_dsp_state *v,int samples);
 extern long     vorbis_packet_blocksize(vorbis_info *vi,ogg_packet *op);
+extern long     vorbis_synthesis_reserve(vorbis_block *vb);
 
 extern int      vorbis_synthesis_halfrate(vorbis_info *v,int flag);
 extern int      vorbis_synthesis_halfrate_p(vorbis_info *v);
+extern int      vorbis_synthesis_rate_shift(vorbis_info *v,int shift);
+extern int      vorbis_synthesis_threads(vorbis_dsp_state *v,int threads);
+extern int      vorbis_synthesis_profile(vorbis_dsp_state *v,
+                                         vorbis_profile *stats,int reset);
+extern int      vorbis_synthesis_downmix(vorbis_dsp_state *v,int channels,
+                                         const float *matrix);
+extern int      vorbis_synthesis_fused(vorbis_dsp_state *v,int flag);
+
+/* share decoded setup headers between decoders; max_idle<0 is off */
+extern int      vorbis_synthesis_setup_cache(int max_idle);
 
 /* Vorbis ERRORS and return codes ***********************************/
 
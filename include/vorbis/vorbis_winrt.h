@@ -123,6 +123,16 @@ namespace Vorbisfile {
 			[Windows::Foundation::Metadata::DefaultOverloadAttribute]
 			Windows::Storage::Streams::IBuffer^ Read(int length, int *bitstream);
 
+			/* Fill buffer up to its Capacity, reusing it rather than
+			 * allocating; returns the bytes read, 0 at end of stream.
+			 * Like Read(), stops early at a link boundary; ReadStatus
+			 * then has the OV_FILL_* bits for what comes next.
+			 */
+			unsigned int ReadInto(Windows::Storage::Streams::IBuffer^ buffer);
+			[Windows::Foundation::Metadata::DefaultOverloadAttribute]
+			unsigned int ReadInto(Windows::Storage::Streams::IBuffer^ buffer, int *bitstream);
+			property int ReadStatus { int get(); }
+
 			static void Crosslap(OggVorbisFile^ oldFile, OggVorbisFile^ newFile);
 
 			void RawSeek(ogg_int64_t pos);
@@ -168,6 +178,7 @@ namespace Vorbisfile {
 			::OggVorbis_File *vf_;
 			Windows::Storage::Streams::IRandomAccessStream^ file_stream_;
 			Windows::Storage::Streams::DataReader^ file_reader_;
+			int read_status_;
 		};
 
 	}
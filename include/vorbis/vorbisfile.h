@@ -102,6 +102,50 @@ static ov_callbacks OV_CALLBACKS_STREAMONLY_NOCLOSE = {
 
 #endif
 
+/* datasource I/O counters; see ov_io_stats() */
+typedef struct {
+  ogg_int64_t read_calls;  /* read_func calls */
+  ogg_int64_t read_bytes;  /* bytes they returned */
+  ogg_int64_t seek_calls;  /* seek_func calls to reposition the stream */
+  long        window;      /* size of the next read_func request */
+} ov_iostats;
+
+/* what the seek calls cost; see ov_seek_stats() */
+typedef struct {
+  long        probes;        /* datasource seeks made by the last seek */
+  ogg_int64_t bytes;         /* bytes it read */
+  ogg_int64_t seeks;         /* seek calls since the open or last reset */
+  ogg_int64_t total_probes;
+  ogg_int64_t total_bytes;
+} ov_seekstats;
+
+/* where decode time goes, when the libraries are built with
+   VORBIS_PROFILE; see ov_profile_stats() */
+typedef struct {
+  vorbis_stage   packet; /* fetching, framing and decoding packets */
+  vorbis_stage   pack;   /* converting and interleaving for the read calls,
+                            and the overlap-add for the integer ones */
+  vorbis_profile decode; /* libvorbis' share of packet */
+} ov_profile;
+
+/* sample formats for ov_read_format().  OR in OV_FMT_BIGENDIAN for
+   big-endian samples and OV_FMT_WAVEORDER to get the channels in
+   WAVE/SMPTE order (FL FR FC LFE BL BR SL SR) rather than Vorbis
+   order.  Integer formats are signed; OV_FMT_S24 is packed three
+   bytes to a sample; OV_FMT_FLOAT is unscaled, unclipped IEEE float
+   as ov_read_float() returns it, interleaved. */
+#define OV_FMT_S16        1
+#define OV_FMT_S24        2
+#define OV_FMT_S32        3
+#define OV_FMT_FLOAT      4
+#define OV_FMT_BIGENDIAN  0x100
+#define OV_FMT_WAVEORDER  0x200
+
+/* ov_read_fill() status bits */
+#define OV_FILL_EOF       1  /* the stream ended; the next call returns 0 */
+#define OV_FILL_LINK      2  /* the next call starts a new link */
+#define OV_FILL_FORMAT    4  /* ...with a different channel count or rate */
+
 #define  NOTOPEN   0
 #define  PARTOPEN  1
 #define  OPENED    2
@@ -143,6 +187,44 @@ typedef struct OggVorbis_File {
 
   ov_callbacks callbacks;
 
+  /* read-ahead; _get_data() asks read_func for read_window bytes,
+     which grows from read_min towards read_max while reading
+     sequentially */
+  long             read_min;
+  long             read_max;
+  long             read_window;
+  ov_iostats       iostats;
+
+  /* granulepos pages seen so far, sorted by offset, for bracketing
+     later seeks; at most index_max entries */
+  struct ov_seekentry *index;
+  long             index_fill;
+  long             index_storage;
+  long             index_max;
+
+  ogg_int64_t      buffer_end; /* source offset the sync buffer ends at,
+                                  -1 until the first seek */
+
+  int              seek_depth; /* nesting of seek calls being measured */
+  ov_iostats       seek_mark;  /* iostats when the outermost one began */
+  ov_seekstats     seekstats;
+
+  int              fill_error; /* hole ov_read_fill() has yet to report */
+
+  int              threads;    /* see ov_threads() */
+  struct vorbis_pool *pool;    /* their workers, kept across decoders */
+
+  float           *downmix;    /* see ov_downmix() */
+  int              downmix_in;
+  int              downmix_out;
+
+  int              realtime;   /* see ov_realtime() */
+
+  const ogg_allocator *allocator; /* current at open; see
+                                     ogg_allocator_use() */
+
+  ov_profile       profile;    /* see ov_profile_stats() */
+
 } OggVorbis_File;
 
 
@@ -151,6 +233,8 @@ extern int ov_fopen(const char *path,OggVorbis_File *vf);
 extern int ov_open(FILE *f,OggVorbis_File *vf,const char *initial,long ibytes);
 extern int ov_open_callbacks(void *datasource, OggVorbis_File *vf,
                 const char *initial, long ibytes, ov_callbacks callbacks);
+extern int ov_open_memory(const void *data, size_t bytes, OggVorbis_File *vf);
+extern int ov_open_mmap(const char *path, OggVorbis_File *vf);
 
 extern int ov_test(FILE *f,OggVorbis_File *vf,const char *initial,long ibytes);
 extern int ov_test_callbacks(void *datasource, OggVorbis_File *vf,
@@ -193,10 +277,32 @@ extern long ov_read_filter(OggVorbis_File *vf,char *buffer,int length,
                           void (*filter)(float **pcm,long channels,long samples,void *filter_param),void *filter_param);
 extern long ov_read(OggVorbis_File *vf,char *buffer,int length,
                     int bigendianp,int word,int sgned,int *bitstream);
+extern long ov_read_format(OggVorbis_File *vf,char *buffer,int length,
+                           int format,int *bitstream);
+extern long ov_read_fill(OggVorbis_File *vf,char *buffer,int length,
+                         int format,int *bitstream,int *status);
+extern int ov_decode_parallel(OggVorbis_File *vf,int threads,int format,
+                       int (*open_func)(void *arg,OggVorbis_File *vf),
+                       void *open_arg,
+                       int (*write_func)(void *arg,const char *pcm,
+                                         long bytes,int link),
+                       void *write_arg);
 extern int ov_crosslap(OggVorbis_File *vf1,OggVorbis_File *vf2);
 
 extern int ov_halfrate(OggVorbis_File *vf,int flag);
 extern int ov_halfrate_p(OggVorbis_File *vf);
+extern int ov_rate_shift(OggVorbis_File *vf,int shift);
+extern int ov_threads(OggVorbis_File *vf,int threads);
+extern int ov_downmix(OggVorbis_File *vf,int in_channels,int channels,
+                      const float *matrix);
+extern int ov_channels(OggVorbis_File *vf,int i);
+extern int ov_realtime(OggVorbis_File *vf,int flag);
+
+extern int ov_readahead(OggVorbis_File *vf,long min_bytes,long max_bytes);
+extern int ov_io_stats(OggVorbis_File *vf,ov_iostats *stats,int reset);
+extern int ov_seek_index(OggVorbis_File *vf,long max_bytes);
+extern int ov_seek_stats(OggVorbis_File *vf,ov_seekstats *stats,int reset);
+extern int ov_profile_stats(OggVorbis_File *vf,ov_profile *stats,int reset);
 
 #ifdef __cplusplus
 }
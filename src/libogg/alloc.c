@@ -0,0 +1,117 @@
+/********************************************************************
+ *                                                                  *
+ * THIS FILE IS PART OF THE Ogg CONTAINER SOURCE CODE.              *
+ * USE, DISTRIBUTION AND REPRODUCTION OF THIS LIBRARY SOURCE IS     *
+ * GOVERNED BY A BSD-STYLE SOURCE LICENSE INCLUDED WITH THIS SOURCE *
+ * IN 'COPYING'. PLEASE READ THESE TERMS BEFORE DISTRIBUTING.       *
+ *                                                                  *
+ * THE OggVorbis SOURCE CODE IS (C) COPYRIGHT 1994-2014             *
+ * by the Xiph.Org Foundation http://www.xiph.org/                  *
+ *                                                                  *
+ ********************************************************************
+
+  function: runtime choice of allocator
+
+ ********************************************************************/
+
+/* Every allocation the libraries make goes through ogg_malloc() and
+   friends (_ogg_malloc and so on in os_types.h), which draw from the
+   allocator current on the calling thread: the C library heap unless
+   ogg_allocator_use() says otherwise.  Each block is prefixed with
+   the allocator it came from, so it always goes back there, whatever
+   is current when it is freed or resized.  Objects that outlive a
+   call (ogg_sync_state, vorbis_dsp_state, OggVorbis_File) note the
+   allocator current when they are set up and make it current again
+   for their own later allocations. */
+
+#include <stdlib.h>
+#include <string.h>
+#include <ogg/ogg.h>
+
+#if defined(_MSC_VER)
+#  define OGG_THREAD __declspec(thread)
+#elif defined(__GNUC__)
+#  define OGG_THREAD __thread
+#else
+#  define OGG_THREAD /* one allocator for all threads */
+#endif
+
+/* the prefix; as large as the strictest alignment malloc gives */
+typedef union {
+  struct {
+    const ogg_allocator *allocator; /* NULL for the heap */
+    size_t               bytes;
+  } h;
+  double align[2];
+} ogg_block;
+
+static OGG_THREAD const ogg_allocator *current=NULL;
+
+const ogg_allocator *ogg_allocator_use(const ogg_allocator *a){
+  const ogg_allocator *prev=current;
+  current=a;
+  return prev;
+}
+
+const ogg_allocator *ogg_allocator_current(void){
+  return current;
+}
+
+static void *_block_init(ogg_block *b,const ogg_allocator *a,size_t bytes){
+  if(!b)return NULL;
+  b->h.allocator=a;
+  b->h.bytes=bytes;
+  return b+1;
+}
+
+void *ogg_malloc(size_t bytes){
+  const ogg_allocator *a=current;
+  if(bytes>(size_t)-1-sizeof(ogg_block))return NULL;
+  if(a)
+    return _block_init(a->alloc(a->ctx,bytes+sizeof(ogg_block)),a,bytes);
+  return _block_init(malloc(bytes+sizeof(ogg_block)),NULL,bytes);
+}
+
+void *ogg_calloc(size_t count,size_t bytes){
+  void *ret;
+  if(bytes && count>((size_t)-1-sizeof(ogg_block))/bytes)return NULL;
+  if(!current)
+    return _block_init(calloc(1,count*bytes+sizeof(ogg_block)),
+                       NULL,count*bytes);
+  ret=ogg_malloc(count*bytes);
+  if(ret)memset(ret,0,count*bytes);
+  return ret;
+}
+
+void *ogg_realloc(void *ptr,size_t bytes){
+  ogg_block *b;
+  void *ret;
+  if(!ptr)return ogg_malloc(bytes);
+  if(bytes>(size_t)-1-sizeof(ogg_block))return NULL;
+  b=(ogg_block *)ptr-1;
+  if(!b->h.allocator)
+    return _block_init(realloc(b,bytes+sizeof(ogg_block)),NULL,bytes);
+
+  /* allocators have no realloc of their own; the block stays with
+     the one it came from */
+  {
+    const ogg_allocator *prev=ogg_allocator_use(b->h.allocator);
+    ret=ogg_malloc(bytes);
+    ogg_allocator_use(prev);
+  }
+  if(ret){
+    memcpy(ret,ptr,b->h.bytes<bytes?b->h.bytes:bytes);
+    ogg_free(ptr);
+  }
+  return ret;
+}
+
+void ogg_free(void *ptr){
+  ogg_block *b;
+  if(!ptr)return;
+  b=(ogg_block *)ptr-1;
+  if(!b->h.allocator)
+    free(b);
+  else if(b->h.allocator->free)
+    b->h.allocator->free(b->h.allocator->ctx,b);
+}
@@ -99,7 +99,7 @@ int ogg_page_packets(const ogg_page *og){
 
 #if 0
 /* helper to initialize lookup for direct-table CRC (illustrative; we
-   use the static init below) */
+   use the static tables in crctable.h) */
 
 static ogg_uint32_t _ogg_crc_entry(unsigned long index){
   int           i;
@@ -118,71 +118,177 @@ static ogg_uint32_t _ogg_crc_entry(unsigned long index){
 }
 #endif
 
-static const ogg_uint32_t crc_lookup[256]={
-  0x00000000,0x04c11db7,0x09823b6e,0x0d4326d9,
-  0x130476dc,0x17c56b6b,0x1a864db2,0x1e475005,
-  0x2608edb8,0x22c9f00f,0x2f8ad6d6,0x2b4bcb61,
-  0x350c9b64,0x31cd86d3,0x3c8ea00a,0x384fbdbd,
-  0x4c11db70,0x48d0c6c7,0x4593e01e,0x4152fda9,
-  0x5f15adac,0x5bd4b01b,0x569796c2,0x52568b75,
-  0x6a1936c8,0x6ed82b7f,0x639b0da6,0x675a1011,
-  0x791d4014,0x7ddc5da3,0x709f7b7a,0x745e66cd,
-  0x9823b6e0,0x9ce2ab57,0x91a18d8e,0x95609039,
-  0x8b27c03c,0x8fe6dd8b,0x82a5fb52,0x8664e6e5,
-  0xbe2b5b58,0xbaea46ef,0xb7a96036,0xb3687d81,
-  0xad2f2d84,0xa9ee3033,0xa4ad16ea,0xa06c0b5d,
-  0xd4326d90,0xd0f37027,0xddb056fe,0xd9714b49,
-  0xc7361b4c,0xc3f706fb,0xceb42022,0xca753d95,
-  0xf23a8028,0xf6fb9d9f,0xfbb8bb46,0xff79a6f1,
-  0xe13ef6f4,0xe5ffeb43,0xe8bccd9a,0xec7dd02d,
-  0x34867077,0x30476dc0,0x3d044b19,0x39c556ae,
-  0x278206ab,0x23431b1c,0x2e003dc5,0x2ac12072,
-  0x128e9dcf,0x164f8078,0x1b0ca6a1,0x1fcdbb16,
-  0x018aeb13,0x054bf6a4,0x0808d07d,0x0cc9cdca,
-  0x7897ab07,0x7c56b6b0,0x71159069,0x75d48dde,
-  0x6b93dddb,0x6f52c06c,0x6211e6b5,0x66d0fb02,
-  0x5e9f46bf,0x5a5e5b08,0x571d7dd1,0x53dc6066,
-  0x4d9b3063,0x495a2dd4,0x44190b0d,0x40d816ba,
-  0xaca5c697,0xa864db20,0xa527fdf9,0xa1e6e04e,
-  0xbfa1b04b,0xbb60adfc,0xb6238b25,0xb2e29692,
-  0x8aad2b2f,0x8e6c3698,0x832f1041,0x87ee0df6,
-  0x99a95df3,0x9d684044,0x902b669d,0x94ea7b2a,
-  0xe0b41de7,0xe4750050,0xe9362689,0xedf73b3e,
-  0xf3b06b3b,0xf771768c,0xfa325055,0xfef34de2,
-  0xc6bcf05f,0xc27dede8,0xcf3ecb31,0xcbffd686,
-  0xd5b88683,0xd1799b34,0xdc3abded,0xd8fba05a,
-  0x690ce0ee,0x6dcdfd59,0x608edb80,0x644fc637,
-  0x7a089632,0x7ec98b85,0x738aad5c,0x774bb0eb,
-  0x4f040d56,0x4bc510e1,0x46863638,0x42472b8f,
-  0x5c007b8a,0x58c1663d,0x558240e4,0x51435d53,
-  0x251d3b9e,0x21dc2629,0x2c9f00f0,0x285e1d47,
-  0x36194d42,0x32d850f5,0x3f9b762c,0x3b5a6b9b,
-  0x0315d626,0x07d4cb91,0x0a97ed48,0x0e56f0ff,
-  0x1011a0fa,0x14d0bd4d,0x19939b94,0x1d528623,
-  0xf12f560e,0xf5ee4bb9,0xf8ad6d60,0xfc6c70d7,
-  0xe22b20d2,0xe6ea3d65,0xeba91bbc,0xef68060b,
-  0xd727bbb6,0xd3e6a601,0xdea580d8,0xda649d6f,
-  0xc423cd6a,0xc0e2d0dd,0xcda1f604,0xc960ebb3,
-  0xbd3e8d7e,0xb9ff90c9,0xb4bcb610,0xb07daba7,
-  0xae3afba2,0xaafbe615,0xa7b8c0cc,0xa379dd7b,
-  0x9b3660c6,0x9ff77d71,0x92b45ba8,0x9675461f,
-  0x8832161a,0x8cf30bad,0x81b02d74,0x857130c3,
-  0x5d8a9099,0x594b8d2e,0x5408abf7,0x50c9b640,
-  0x4e8ee645,0x4a4ffbf2,0x470cdd2b,0x43cdc09c,
-  0x7b827d21,0x7f436096,0x7200464f,0x76c15bf8,
-  0x68860bfd,0x6c47164a,0x61043093,0x65c52d24,
-  0x119b4be9,0x155a565e,0x18197087,0x1cd86d30,
-  0x029f3d35,0x065e2082,0x0b1d065b,0x0fdc1bec,
-  0x3793a651,0x3352bbe6,0x3e119d3f,0x3ad08088,
-  0x2497d08d,0x2056cd3a,0x2d15ebe3,0x29d4f654,
-  0xc5a92679,0xc1683bce,0xcc2b1d17,0xc8ea00a0,
-  0xd6ad50a5,0xd26c4d12,0xdf2f6bcb,0xdbee767c,
-  0xe3a1cbc1,0xe760d676,0xea23f0af,0xeee2ed18,
-  0xf0a5bd1d,0xf464a0aa,0xf9278673,0xfde69bc4,
-  0x89b8fd09,0x8d79e0be,0x803ac667,0x84fbdbd0,
-  0x9abc8bd5,0x9e7d9662,0x933eb0bb,0x97ffad0c,
-  0xafb010b1,0xab710d06,0xa6322bdf,0xa2f33668,
-  0xbcb4666d,0xb8757bda,0xb5365d03,0xb1f740b4};
+#include "crctable.h"
+
+/* Slicing-by-8: XOR the running CRC into the next four message bytes
+   and look up all eight bytes at once. */
+
+static ogg_uint32_t _os_update_crc_sb8(ogg_uint32_t crc,
+                                       const unsigned char *buffer,
+                                       long size){
+  while(size>=8){
+    crc^=((ogg_uint32_t)buffer[0]<<24)|((ogg_uint32_t)buffer[1]<<16)|
+         ((ogg_uint32_t)buffer[2]<<8)|((ogg_uint32_t)buffer[3]);
+
+    crc=crc_lookup[7][ crc>>24      ]^crc_lookup[6][(crc>>16)&0xff]^
+        crc_lookup[5][(crc>> 8)&0xff]^crc_lookup[4][ crc     &0xff]^
+        crc_lookup[3][buffer[4]     ]^crc_lookup[2][buffer[5]     ]^
+        crc_lookup[1][buffer[6]     ]^crc_lookup[0][buffer[7]     ];
+
+    buffer+=8;
+    size-=8;
+  }
+
+  while(size--)
+    crc=(crc<<8)^crc_lookup[0][((crc>>24)&0xff)^*buffer++];
+  return(crc);
+}
+
+/* Carry-less multiply version for x86 CPUs with PCLMULQDQ.  The page
+   CRC is unreflected with a zero init, so the CRC of a message M is
+   M(x)*x^32 mod P(x); the message is byte swapped into 128 bit
+   registers (bit i holding x^i) and folded four blocks at a time by
+   multiplying the high and low halves by x^(n+64) and x^n mod P.  The
+   128 bit remainder that is left is congruent to everything folded so
+   far and goes through the table code like any other 16 bytes.  When
+   dst is set, the bytes are also stored there as they are loaded. */
+
+#if !defined(OGG_NO_SIMD) && \
+  (defined(_M_IX86) || defined(_M_X64) || defined(__i386__) || defined(__x86_64__))
+#define OGG_CRC_PCLMUL
+
+#include <emmintrin.h>
+#include <tmmintrin.h>
+#include <wmmintrin.h>
+#ifdef _MSC_VER
+#include <intrin.h>
+#else
+#include <cpuid.h>
+#endif
+
+#if defined(__GNUC__)
+#define OGG_TARGET_PCLMUL __attribute__((target("sse2,ssse3,pclmul")))
+#else
+#define OGG_TARGET_PCLMUL
+#endif
+
+/* below this the table code is as fast */
+#define OGG_CRC_PCLMUL_MIN 64
+
+static int _os_crc_pclmul_ok(void){
+  static volatile int ok=-1;
+  if(ok<0){
+    unsigned int r[4]={0,0,0,0};
+#ifdef _MSC_VER
+    int info[4];
+    __cpuid(info,1);
+    r[2]=info[2];
+    r[3]=info[3];
+#else
+    if(__get_cpuid(1,&r[0],&r[1],&r[2],&r[3])==0)r[2]=r[3]=0;
+#endif
+    /* SSE2, SSSE3 and PCLMULQDQ */
+    ok=(r[3]&(1<<26)) && (r[2]&(1<<9)) && (r[2]&(1<<1));
+  }
+  return(ok);
+}
+
+#define CRC_LOAD(x,p) do{                                           \
+    x=_mm_loadu_si128((const __m128i *)(p));                         \
+    if(dst)_mm_storeu_si128((__m128i *)(dst+((p)-buffer)),x);        \
+    x=_mm_shuffle_epi8(x,bswap);                                     \
+  }while(0)
+
+#define CRC_FOLD(x,k) \
+  _mm_xor_si128(_mm_clmulepi64_si128(x,k,0x00),_mm_clmulepi64_si128(x,k,0x11))
+
+OGG_TARGET_PCLMUL
+static ogg_uint32_t _os_update_crc_pclmul(ogg_uint32_t crc,
+                                          unsigned char *dst,
+                                          const unsigned char *buffer,
+                                          long size){
+  const __m128i bswap=_mm_set_epi8(0,1,2,3,4,5,6,7,8,9,10,11,12,13,14,15);
+  /* x^576, x^512 and x^192, x^128 mod P: high half, low half */
+  const __m128i k4=_mm_set_epi32(0,0x8833794c,0,0xe6228b11);
+  const __m128i k1=_mm_set_epi32(0,0xc5b9cd4c,0,0xe8a45605);
+  const unsigned char *p=buffer;
+  unsigned char tmp[16];
+  __m128i x0,x1,x2,x3,y;
+
+  /* size>=OGG_CRC_PCLMUL_MIN */
+  CRC_LOAD(x0,p);
+  CRC_LOAD(x1,p+16);
+  CRC_LOAD(x2,p+32);
+  CRC_LOAD(x3,p+48);
+  x0=_mm_xor_si128(x0,_mm_set_epi32(crc,0,0,0));
+  p+=64;
+  size-=64;
+
+  while(size>=64){
+    CRC_LOAD(y,p);
+    x0=_mm_xor_si128(CRC_FOLD(x0,k4),y);
+    CRC_LOAD(y,p+16);
+    x1=_mm_xor_si128(CRC_FOLD(x1,k4),y);
+    CRC_LOAD(y,p+32);
+    x2=_mm_xor_si128(CRC_FOLD(x2,k4),y);
+    CRC_LOAD(y,p+48);
+    x3=_mm_xor_si128(CRC_FOLD(x3,k4),y);
+    p+=64;
+    size-=64;
+  }
+
+  x1=_mm_xor_si128(CRC_FOLD(x0,k1),x1);
+  x2=_mm_xor_si128(CRC_FOLD(x1,k1),x2);
+  x3=_mm_xor_si128(CRC_FOLD(x2,k1),x3);
+
+  while(size>=16){
+    CRC_LOAD(y,p);
+    x3=_mm_xor_si128(CRC_FOLD(x3,k1),y);
+    p+=16;
+    size-=16;
+  }
+
+  _mm_storeu_si128((__m128i *)tmp,_mm_shuffle_epi8(x3,bswap));
+  crc=_os_update_crc_sb8(0,tmp,16);
+
+  if(dst)memcpy(dst+(p-buffer),p,size);
+  return(_os_update_crc_sb8(crc,p,size));
+}
+
+#undef CRC_LOAD
+#undef CRC_FOLD
+
+#endif
+
+/* Continue a page CRC over size more bytes */
+static ogg_uint32_t _os_update_crc(ogg_uint32_t crc,
+                                   const unsigned char *buffer,long size){
+#ifdef OGG_CRC_PCLMUL
+  if(size>=OGG_CRC_PCLMUL_MIN && _os_crc_pclmul_ok())
+    return(_os_update_crc_pclmul(crc,NULL,buffer,size));
+#endif
+  return(_os_update_crc_sb8(crc,buffer,size));
+}
+
+/* The same while copying the bytes to dst, for data that is being
+   moved anyway.  The table version checksums eight bytes and then
+   stores them, so each byte is read only once. */
+static ogg_uint32_t _os_copy_crc(ogg_uint32_t crc,unsigned char *dst,
+                                 const unsigned char *src,long size){
+#ifdef OGG_CRC_PCLMUL
+  if(size>=OGG_CRC_PCLMUL_MIN && _os_crc_pclmul_ok())
+    return(_os_update_crc_pclmul(crc,dst,src,size));
+#endif
+  while(size>=8){
+    crc=_os_update_crc_sb8(crc,src,8);
+    memcpy(dst,src,8);
+    dst+=8;
+    src+=8;
+    size-=8;
+  }
+  memcpy(dst,src,size);
+  return(_os_update_crc_sb8(crc,src,size));
+}
 
 /* init the encode/decode logical stream state */
 
@@ -217,7 +323,10 @@ int ogg_stream_check(ogg_stream_state *os){
 /* _clear does not free os, only the non-flat storage within */
 int ogg_stream_clear(ogg_stream_state *os){
   if(os){
-    if(os->body_data)_ogg_free(os->body_data);
+    if(os->body_store)
+      _ogg_free(os->body_store);
+    else if(os->body_data)
+      _ogg_free(os->body_data);
     if(os->lacing_vals)_ogg_free(os->lacing_vals);
     if(os->granule_vals)_ogg_free(os->granule_vals);
 
@@ -258,6 +367,27 @@ static int _os_body_expand(ogg_stream_state *os,long needed){
   return 0;
 }
 
+/* if body_data points into a page handed to ogg_stream_pagein_ref(),
+   go back to our own buffer, copying over the bytes not yet returned
+   as packets */
+static int _os_body_unref(ogg_stream_state *os){
+  if(os->body_store){
+    unsigned char *ref=os->body_data+os->body_returned;
+    long bytes=os->body_fill-os->body_returned;
+
+    os->body_data=os->body_store;
+    os->body_store=NULL;
+    os->body_fill=0;
+    os->body_returned=0;
+    if(bytes){
+      if(_os_body_expand(os,bytes)) return -1;
+      memcpy(os->body_data,ref,bytes);
+      os->body_fill=bytes;
+    }
+  }
+  return 0;
+}
+
 static int _os_lacing_expand(ogg_stream_state *os,long needed){
   if(os->lacing_storage-needed<=os->lacing_fill){
     long lacing_storage;
@@ -286,14 +416,45 @@ static int _os_lacing_expand(ogg_stream_state *os,long needed){
   return 0;
 }
 
+/* Make room up front for bytes of packet data and segments lacing
+   values, so that ogg_stream_pagein*() need not grow the stream's
+   buffers for as long as the data not yet returned as packets and the
+   page being added fit in that much. */
+int ogg_stream_reserve(ogg_stream_state *os,long bytes,long segments){
+  if(ogg_stream_check(os)) return -1;
+  if(bytes<0 || segments<0 || bytes>=LONG_MAX || segments>=LONG_MAX-1)
+    return -1;
+
+  /* the expand helpers grow when the new data would fill them */
+  bytes++;
+  segments+=2;
+
+  if(bytes>os->body_storage){
+    /* while paged in by reference, the stream's own buffer is parked
+       in body_store and holds nothing */
+    unsigned char **own=os->body_store?&os->body_store:&os->body_data;
+    void *ret=_ogg_realloc(*own,bytes*sizeof(**own));
+    if(!ret) return -1;
+    *own=ret;
+    os->body_storage=bytes;
+  }
+  if(segments>os->lacing_storage){
+    void *ret=_ogg_realloc(os->lacing_vals,segments*sizeof(*os->lacing_vals));
+    if(!ret) return -1;
+    os->lacing_vals=ret;
+    ret=_ogg_realloc(os->granule_vals,segments*sizeof(*os->granule_vals));
+    if(!ret) return -1;
+    os->granule_vals=ret;
+    os->lacing_storage=segments;
+  }
+  return 0;
+}
+
 /* checksum the page */
-/* Direct table CRC; note that this will be faster in the future if we
-   perform the checksum simultaneously with other copies */
 
 void ogg_page_checksum_set(ogg_page *og){
   if(og){
-    ogg_uint32_t crc_reg=0;
-    int i;
+    ogg_uint32_t crc_reg;
 
     /* safety; needed for API behavior, but not framing code */
     og->header[22]=0;
@@ -301,10 +462,8 @@ void ogg_page_checksum_set(ogg_page *og){
     og->header[24]=0;
     og->header[25]=0;
 
-    for(i=0;i<og->header_len;i++)
-      crc_reg=(crc_reg<<8)^crc_lookup[((crc_reg >> 24)&0xff)^og->header[i]];
-    for(i=0;i<og->body_len;i++)
-      crc_reg=(crc_reg<<8)^crc_lookup[((crc_reg >> 24)&0xff)^og->body[i]];
+    crc_reg=_os_update_crc(0,og->header,og->header_len);
+    crc_reg=_os_update_crc(crc_reg,og->body,og->body_len);
 
     og->header[22]=(unsigned char)(crc_reg&0xff);
     og->header[23]=(unsigned char)((crc_reg>>8)&0xff);
@@ -322,6 +481,7 @@ int ogg_stream_iovecin(ogg_stream_state *os, ogg_iovec_t *iov, int count,
 
   if(ogg_stream_check(os)) return -1;
   if(!iov) return 0;
+  if(_os_body_unref(os)) return -1;
 
   for (i = 0; i < count; ++i){
     if(iov[i].iov_len>LONG_MAX) return -1;
@@ -599,6 +759,7 @@ int ogg_sync_init(ogg_sync_state *oy){
   if(oy){
     oy->storage = -1; /* used as a readiness flag */
     memset(oy,0,sizeof(*oy));
+    oy->allocator=ogg_allocator_current();
   }
   return(0);
 }
@@ -606,7 +767,7 @@ int ogg_sync_init(ogg_sync_state *oy){
 /* clear non-flat storage within */
 int ogg_sync_clear(ogg_sync_state *oy){
   if(oy){
-    if(oy->data)_ogg_free(oy->data);
+    if(oy->data && !oy->external)_ogg_free(oy->data);
     memset(oy,0,sizeof(*oy));
   }
   return(0);
@@ -625,8 +786,25 @@ int ogg_sync_check(ogg_sync_state *oy){
   return 0;
 }
 
-char *ogg_sync_buffer(ogg_sync_state *oy, long size){
-  if(ogg_sync_check(oy)) return NULL;
+static char *_sync_buffer(ogg_sync_state *oy, long size){
+  /* attached to app data: carry on in a buffer of our own with
+     whatever hasn't been returned yet */
+  if(oy->external){
+    long bytes=oy->fill-oy->returned;
+    long newsize=bytes+size+4096;
+    unsigned char *ret=_ogg_malloc(newsize);
+
+    if(!ret){
+      ogg_sync_clear(oy);
+      return NULL;
+    }
+    if(bytes)memcpy(ret,oy->data+oy->returned,bytes);
+    oy->data=ret;
+    oy->storage=newsize;
+    oy->fill=bytes;
+    oy->returned=0;
+    oy->external=0;
+  }
 
   /* first, clear out any space that has been previously returned */
   if(oy->returned){
@@ -657,13 +835,109 @@ char *ogg_sync_buffer(ogg_sync_state *oy, long size){
   return((char *)oy->data+oy->fill);
 }
 
+char *ogg_sync_buffer(ogg_sync_state *oy, long size){
+  const ogg_allocator *prev;
+  char *ret;
+  if(ogg_sync_check(oy)) return NULL;
+
+  prev=ogg_allocator_use(oy->allocator);
+  ret=_sync_buffer(oy,size);
+  ogg_allocator_use(prev);
+  return ret;
+}
+
+/* Grow the buffer to hold bytes at once, so that ogg_sync_buffer()
+   need not reallocate while the data held plus the size asked for
+   stay within that.  This does nothing for a sync state attached to
+   app data, which has no buffer to grow. */
+int ogg_sync_reserve(ogg_sync_state *oy, long bytes){
+  const ogg_allocator *prev;
+  void *ret;
+  if(ogg_sync_check(oy))return -1;
+  if(bytes<0 || bytes>INT_MAX)return -1;
+  if(oy->external || bytes<=oy->storage)return 0;
+
+  prev=ogg_allocator_use(oy->allocator);
+  ret=_ogg_realloc(oy->data,bytes);
+  ogg_allocator_use(prev);
+  if(!ret)return -1;
+  oy->data=ret;
+  oy->storage=bytes;
+  return 0;
+}
+
 int ogg_sync_wrote(ogg_sync_state *oy, long bytes){
   if(ogg_sync_check(oy))return -1;
+  if(oy->external)return -1;
   if(oy->fill+bytes>oy->storage)return -1;
   oy->fill+=bytes;
   return(0);
 }
 
+/* The same as ogg_sync_buffer(), a copy and ogg_sync_wrote() in one
+   call, for apps that have the data in memory already.  Bytes that
+   belong to a page whose header has been seen by ogg_sync_pageseek()
+   are checksummed during the copy, so the page need not be read again
+   to verify it. */
+int ogg_sync_write(ogg_sync_state *oy, const char *buffer, long bytes){
+  unsigned char *dst;
+  long n=0;
+
+  if(bytes<0)return -1;
+  dst=(unsigned char *)ogg_sync_buffer(oy,bytes);
+  if(!dst)return -1;
+
+  if(oy->headerbytes && oy->crcbytes==oy->fill-oy->returned){
+    n=oy->headerbytes+oy->bodybytes-oy->crcbytes;
+    if(n>bytes)n=bytes;
+    oy->crc=_os_copy_crc(oy->crc,dst,(const unsigned char *)buffer,n);
+    oy->crcbytes+=n;
+  }
+  memcpy(dst+n,buffer+n,bytes-n);
+
+  return(ogg_sync_wrote(oy,bytes));
+}
+
+/* Point the sync state at bytes the app keeps in memory (a whole
+   file, a memory mapping...) instead of copying them in.  Pages are
+   then returned pointing into those bytes, which must stay valid and
+   unchanged until the sync state is cleared or attached elsewhere.
+   Anything buffered before is dropped, as by ogg_sync_reset().
+   ogg_sync_buffer() may still be used afterwards; it moves the bytes
+   not yet returned into a buffer of the sync state's own. */
+int ogg_sync_attach(ogg_sync_state *oy, const char *buffer, long bytes){
+  if(ogg_sync_check(oy))return -1;
+  if(bytes<0 || bytes>INT_MAX || (bytes && !buffer))return -1;
+
+  if(oy->data && !oy->external)_ogg_free(oy->data);
+  oy->data=(unsigned char *)buffer;
+  oy->storage=bytes;
+  oy->fill=bytes;
+  oy->returned=0;
+  oy->unsynced=0;
+  oy->headerbytes=0;
+  oy->bodybytes=0;
+  oy->crcbytes=0;
+  oy->external=1;
+  return(0);
+}
+
+/* Move the read position to byte pos of the data held, dropping any
+   partly synced page.  Bytes before the current position are kept
+   until the next ogg_sync_buffer(), so a reader that has just looked
+   at a page can go back to it without fetching it again. */
+int ogg_sync_seek(ogg_sync_state *oy, long pos){
+  if(ogg_sync_check(oy))return -1;
+  if(pos<0 || pos>oy->fill)return -1;
+
+  oy->returned=(int)pos;
+  oy->unsynced=0;
+  oy->headerbytes=0;
+  oy->bodybytes=0;
+  oy->crcbytes=0;
+  return(0);
+}
+
 /* sync the stream.  This is meant to be useful for finding page
    boundaries.
 
@@ -696,36 +970,39 @@ long ogg_sync_pageseek(ogg_sync_state *oy,ogg_page *og){
     for(i=0;i<page[26];i++)
       oy->bodybytes+=page[27+i];
     oy->headerbytes=headerbytes;
+
+    /* start the checksum with the header, its CRC field read as zero */
+    {
+      static const unsigned char zero[4]={0,0,0,0};
+      oy->crc=_os_update_crc(0,page,22);
+      oy->crc=_os_update_crc(oy->crc,zero,4);
+      oy->crc=_os_update_crc(oy->crc,page+26,headerbytes-26);
+      oy->crcbytes=headerbytes;
+    }
+  }
+
+  /* checksum as much of the body as is buffered and not yet done;
+     ogg_sync_write() may have covered some of it already */
+  {
+    long have=oy->headerbytes+oy->bodybytes;
+    if(have>bytes)have=bytes;
+    if(have>oy->crcbytes){
+      oy->crc=_os_update_crc(oy->crc,page+oy->crcbytes,have-oy->crcbytes);
+      oy->crcbytes=have;
+    }
   }
 
   if(oy->bodybytes+oy->headerbytes>bytes)return(0);
 
   /* The whole test page is buffered.  Verify the checksum */
-  {
-    /* Grab the checksum bytes, set the header field to zero */
-    char chksum[4];
-    ogg_page log;
-
-    memcpy(chksum,page+22,4);
-    memset(page+22,0,4);
-
-    /* set up a temp page struct and recompute the checksum */
-    log.header=page;
-    log.header_len=oy->headerbytes;
-    log.body=page+oy->headerbytes;
-    log.body_len=oy->bodybytes;
-    ogg_page_checksum_set(&log);
-
-    /* Compare */
-    if(memcmp(chksum,page+22,4)){
-      /* D'oh.  Mismatch! Corrupt page (or miscapture and not a page
-         at all) */
-      /* replace the computed checksum with the one actually read in */
-      memcpy(page+22,chksum,4);
-
-      /* Bad checksum. Lose sync */
-      goto sync_fail;
-    }
+  if(page[22]!=(oy->crc&0xff) ||
+     page[23]!=((oy->crc>>8)&0xff) ||
+     page[24]!=((oy->crc>>16)&0xff) ||
+     page[25]!=((oy->crc>>24)&0xff)){
+    /* D'oh.  Mismatch! Corrupt page (or miscapture and not a page
+       at all) */
+    /* Bad checksum. Lose sync */
+    goto sync_fail;
   }
 
   /* yes, have a whole page all ready to go */
@@ -744,6 +1021,7 @@ long ogg_sync_pageseek(ogg_sync_state *oy,ogg_page *og){
     oy->returned+=(bytes=oy->headerbytes+oy->bodybytes);
     oy->headerbytes=0;
     oy->bodybytes=0;
+    oy->crcbytes=0;
     return(bytes);
   }
 
@@ -751,6 +1029,7 @@ long ogg_sync_pageseek(ogg_sync_state *oy,ogg_page *og){
 
   oy->headerbytes=0;
   oy->bodybytes=0;
+  oy->crcbytes=0;
 
   /* search for possible capture */
   next=memchr(page+1,'O',bytes-1);
@@ -805,7 +1084,7 @@ int ogg_sync_pageout(ogg_sync_state *oy, ogg_page *og){
 /* add the incoming page to the stream state; we decompose the page
    into packet segments here as well. */
 
-int ogg_stream_pagein(ogg_stream_state *os, ogg_page *og){
+static int _os_pagein(ogg_stream_state *os, ogg_page *og, int ref){
   unsigned char *header=og->header;
   unsigned char *body=og->body;
   long           bodysize=og->body_len;
@@ -821,6 +1100,7 @@ int ogg_stream_pagein(ogg_stream_state *os, ogg_page *og){
   int segments=header[26];
 
   if(ogg_stream_check(os)) return -1;
+  if(_os_body_unref(os)) return -1;
 
   /* clean up 'returned data' */
   {
@@ -890,9 +1170,16 @@ int ogg_stream_pagein(ogg_stream_state *os, ogg_page *og){
   }
 
   if(bodysize){
-    if(_os_body_expand(os,bodysize)) return -1;
-    memcpy(os->body_data+os->body_fill,body,bodysize);
-    os->body_fill+=bodysize;
+    if(ref && os->body_fill==0){
+      /* nothing buffered; packets can be handed out of the page */
+      os->body_store=os->body_data;
+      os->body_data=body;
+      os->body_fill=bodysize;
+    }else{
+      if(_os_body_expand(os,bodysize)) return -1;
+      memcpy(os->body_data+os->body_fill,body,bodysize);
+      os->body_fill+=bodysize;
+    }
   }
 
   {
@@ -933,6 +1220,19 @@ int ogg_stream_pagein(ogg_stream_state *os, ogg_page *og){
   return(0);
 }
 
+int ogg_stream_pagein(ogg_stream_state *os, ogg_page *og){
+  return(_os_pagein(os,og,0));
+}
+
+/* The same, except that the page body is not copied when no partial
+   packet is waiting for it: packets that lie wholly within the page
+   are then returned pointing into og->body.  The page data must stay
+   valid and unchanged until the next call to ogg_stream_pagein*(),
+   _reset() or _clear() on this stream. */
+int ogg_stream_pagein_ref(ogg_stream_state *os, ogg_page *og){
+  return(_os_pagein(os,og,1));
+}
+
 /* clear things to an initial state.  Good to call, eg, before seeking */
 int ogg_sync_reset(ogg_sync_state *oy){
   if(ogg_sync_check(oy))return -1;
@@ -942,12 +1242,17 @@ int ogg_sync_reset(ogg_sync_state *oy){
   oy->unsynced=0;
   oy->headerbytes=0;
   oy->bodybytes=0;
+  oy->crcbytes=0;
   return(0);
 }
 
 int ogg_stream_reset(ogg_stream_state *os){
   if(ogg_stream_check(os)) return -1;
 
+  if(os->body_store){
+    os->body_data=os->body_store;
+    os->body_store=NULL;
+  }
   os->body_fill=0;
   os->body_returned=0;
 
@@ -1671,8 +1976,131 @@ void test_pack(const int *pl, const int **headers, int byteskip,
   fprintf(stderr,"ok.\n");
 }
 
+/* decode straight out of a memory image: ogg_sync_attach() and
+   ogg_stream_pagein_ref() must give the same packets as copying, with
+   packets that don't span pages pointing into the image */
+void test_attach(void){
+  const int pl[]={17,254,255,256,500,510,600,4345,259,65500,0,31,-1};
+  unsigned char *data=_ogg_malloc(128*1024);
+  unsigned char *file=_ogg_malloc(160*1024);
+  long inptr=0,fileptr=0,deptr=0;
+  int i,j,packets=0,inplace=0;
+  ogg_stream_state en,de;
+  ogg_sync_state sy;
+  ogg_page og;
+  ogg_packet op;
+
+  fprintf(stderr,"testing attached sync and by-reference pagein... ");
+  ogg_stream_init(&en,0x04030201);
+  ogg_stream_init(&de,0x04030201);
+  ogg_sync_init(&sy);
+
+  for(i=0;pl[i]>=0;i++){
+    op.packet=data+inptr;
+    op.bytes=pl[i];
+    op.b_o_s=0;
+    op.e_o_s=(pl[i+1]<0);
+    op.granulepos=i;
+    op.packetno=i;
+    for(j=0;j<pl[i];j++)data[inptr++]=i+j;
+    ogg_stream_packetin(&en,&op);
+    while(ogg_stream_pageout(&en,&og)){
+      memcpy(file+fileptr,og.header,og.header_len);
+      memcpy(file+fileptr+og.header_len,og.body,og.body_len);
+      fileptr+=og.header_len+og.body_len;
+    }
+  }
+  while(ogg_stream_flush(&en,&og)){
+    memcpy(file+fileptr,og.header,og.header_len);
+    memcpy(file+fileptr+og.header_len,og.body,og.body_len);
+    fileptr+=og.header_len+og.body_len;
+  }
+
+  if(ogg_sync_attach(&sy,(char *)file,fileptr))error();
+  while(ogg_sync_pageout(&sy,&og)>0){
+    if(og.header<file || og.header>=file+fileptr){
+      fprintf(stderr,"attached page not in place!\n");
+      exit(1);
+    }
+    ogg_stream_pagein_ref(&de,&og);
+    while(ogg_stream_packetout(&de,&op)>0){
+      if(op.bytes!=pl[packets] || memcmp(data+deptr,op.packet,op.bytes)){
+        fprintf(stderr,"packet data mismatch in attached decode! "
+                "pos=%ld\n",deptr);
+        exit(1);
+      }
+      if(op.bytes && op.packet>=file && op.packet<file+fileptr)inplace++;
+      deptr+=op.bytes;
+      packets++;
+    }
+  }
+  if(pl[packets]!=-1 || !inplace){
+    fprintf(stderr,"attached decode lost packets or copied all of them!\n");
+    exit(1);
+  }
+
+  /* switching back to a buffer of its own keeps what wasn't returned */
+  ogg_sync_attach(&sy,(char *)file,fileptr);
+  if(ogg_sync_pageout(&sy,&og)<=0)error();
+  memcpy(ogg_sync_buffer(&sy,100),"junk",4);
+  if(ogg_sync_pageout(&sy,&og)<=0)error();
+
+  /* going back to a page already returned finds it in place */
+  ogg_sync_attach(&sy,(char *)file,fileptr);
+  if(ogg_sync_pageout(&sy,&og)<=0)error();
+  if(ogg_sync_pageout(&sy,&og)<=0)error();
+  {
+    long pos=(long)(og.header-file);
+    if(ogg_sync_seek(&sy,pos+1))error();
+    if(ogg_sync_pageseek(&sy,&og)>=0)error();
+    if(ogg_sync_seek(&sy,pos))error();
+    if(ogg_sync_pageout(&sy,&og)<=0 || og.header!=file+pos)error();
+    if(!ogg_sync_seek(&sy,fileptr+1))error();
+  }
+
+  ogg_sync_clear(&sy);
+  ogg_stream_clear(&en);
+  ogg_stream_clear(&de);
+  _ogg_free(data);
+  _ogg_free(file);
+  fprintf(stderr,"ok.\n");
+}
+
+/* all the CRC routines must agree with the bytewise table loop */
+void test_crc(void){
+  unsigned char buf[1100],copy[1100];
+  long i,len,off;
+
+  fprintf(stderr,"testing page CRC implementations... ");
+  for(i=0;i<(long)sizeof(buf);i++)buf[i]=rand();
+
+  for(len=0;len<1024;len+=(len<200?1:37)){
+    for(off=0;off<16;off+=5){
+      ogg_uint32_t ref=0x12345678,crc;
+      for(i=0;i<len;i++)
+        ref=(ref<<8)^crc_lookup[0][((ref>>24)&0xff)^buf[off+i]];
+
+      crc=_os_update_crc(0x12345678,buf+off,len);
+      if(crc!=ref){
+        fprintf(stderr,"CRC mismatch at length %ld!\n",len);
+        exit(1);
+      }
+      memset(copy,0,sizeof(copy));
+      crc=_os_copy_crc(0x12345678,copy+3,buf+off,len);
+      if(crc!=ref || memcmp(copy+3,buf+off,len) || copy[3+len] || copy[2]){
+        fprintf(stderr,"CRC copy mismatch at length %ld!\n",len);
+        exit(1);
+      }
+    }
+  }
+  fprintf(stderr,"ok.\n");
+}
+
 int main(void){
 
+  test_crc();
+  test_attach();
+
   ogg_stream_init(&os_en,0x04030201);
   ogg_stream_init(&os_de,0x04030201);
   ogg_sync_init(&oy);
@@ -1987,6 +2415,35 @@ int main(void){
       fprintf(stderr,"ok.\n");
     }
 
+    {
+      ogg_page og_de;
+      unsigned char *bad;
+      /* Same again through ogg_sync_write(), which checksums the body
+         as it is copied in */
+      fprintf(stderr,"Testing sync on partial ogg_sync_write inputs... ");
+      ogg_sync_reset(&oy);
+      ogg_sync_write(&oy,(char *)og[1].header,3);
+      if(ogg_sync_pageout(&oy,&og_de)>0)error();
+      ogg_sync_write(&oy,(char *)og[1].header+3,og[1].header_len-3);
+      if(ogg_sync_pageout(&oy,&og_de)>0)error();
+      ogg_sync_write(&oy,(char *)og[1].body,1000);
+      if(ogg_sync_pageout(&oy,&og_de)>0)error();
+      ogg_sync_write(&oy,(char *)og[1].body+1000,og[1].body_len-1000);
+      if(ogg_sync_pageout(&oy,&og_de)<=0)error();
+
+      /* a damaged body byte must still fail the checksum */
+      bad=malloc(og[1].body_len);
+      memcpy(bad,og[1].body,og[1].body_len);
+      bad[og[1].body_len/2]^=0x10;
+      ogg_sync_write(&oy,(char *)og[1].header,og[1].header_len);
+      if(ogg_sync_pageout(&oy,&og_de)>0)error();
+      ogg_sync_write(&oy,(char *)bad,og[1].body_len);
+      if(ogg_sync_pageout(&oy,&og_de)>0)error();
+      free(bad);
+
+      fprintf(stderr,"ok.\n");
+    }
+
     /* Test fractional page inputs: page + incomplete capture */
     {
       ogg_page og_de;
@@ -36,6 +36,14 @@ typedef struct{
   void *(*inverse1)  (struct vorbis_block *,vorbis_look_floor *);
   int   (*inverse2)  (struct vorbis_block *,vorbis_look_floor *,
                      void *buffer,float *);
+  /* the worst case of inverse1 for one channel: block storage taken
+     (returned) and packet bits read (in *bits); also does any set up
+     inverse1/2 would otherwise do on first use */
+  long  (*reserve)   (vorbis_dsp_state *,vorbis_look_floor *,long *bits);
+  /* as inverse2, but writes the envelope itself rather than applying
+     it; optional */
+  int   (*curve)     (struct vorbis_block *,vorbis_look_floor *,
+                     void *buffer,float *);
 } vorbis_func_floor;
 
 typedef struct{
@@ -99,6 +107,9 @@ typedef struct{
                         int **,int *,int,long **,int);
   int  (*inverse)      (struct vorbis_block *,vorbis_look_residue *,
                         float **,int *,int);
+  /* as for floors, for ch channels */
+  long (*reserve)      (vorbis_dsp_state *,vorbis_look_residue *,
+                        int ch,long *bits);
 } vorbis_func_residue;
 
 typedef struct vorbis_info_residue0{
@@ -126,6 +137,8 @@ typedef struct{
   void (*free_info)    (vorbis_info_mapping *);
   int  (*forward)      (struct vorbis_block *vb);
   int  (*inverse)      (struct vorbis_block *vb,vorbis_info_mapping *);
+  /* as for floors, for a whole block */
+  long (*reserve)      (vorbis_dsp_state *,vorbis_info_mapping *,long *bits);
 } vorbis_func_mapping;
 
 typedef struct vorbis_info_mapping0{
@@ -29,8 +29,16 @@
 #include "mdct.h"
 #include "lpc.h"
 #include "registry.h"
+#include "setupcache.h"
+#include "thread.h"
+#include "profile.h"
+#include "cpu.h"
 #include "misc.h"
 
+#ifdef VORBIS_SIMD_X86
+#  include <emmintrin.h>
+#endif
+
 static int ilog2(unsigned int v){
   int ret=0;
   if(v)--v;
@@ -81,10 +89,6 @@ static int ilog2(unsigned int v){
 
 /* block abstraction setup *********************************************/
 
-#ifndef WORD_ALIGN
-#define WORD_ALIGN 8
-#endif
-
 int vorbis_block_init(vorbis_dsp_state *v, vorbis_block *vb){
   int i;
   memset(vb,0,sizeof(*vb));
@@ -92,6 +96,7 @@ int vorbis_block_init(vorbis_dsp_state *v, vorbis_block *vb){
   vb->localalloc=0;
   vb->localstore=NULL;
   if(v->analysisp){
+    const ogg_allocator *prev=ogg_allocator_use(v->allocator);
     vorbis_block_internal *vbi=
       vb->internal=_ogg_calloc(1,sizeof(vorbis_block_internal));
     vbi->ampmax=-9999;
@@ -105,14 +110,18 @@ int vorbis_block_init(vorbis_dsp_state *v, vorbis_block *vb){
       }
       oggpack_writeinit(vbi->packetblob[i]);
     }
+    ogg_allocator_use(prev);
   }
 
   return(0);
 }
 
+/* block storage comes from the allocator of the dsp state, whichever
+   thread asks for it */
 void *_vorbis_block_alloc(vorbis_block *vb,long bytes){
-  bytes=(bytes+(WORD_ALIGN-1)) & ~(WORD_ALIGN-1);
+  bytes=_vorbis_block_bytes(bytes);
   if(bytes+vb->localtop>vb->localalloc){
+    const ogg_allocator *prev=ogg_allocator_use(vb->vd->allocator);
     /* can't just _ogg_realloc... there are outstanding pointers */
     if(vb->localstore){
       struct alloc_chain *link=_ogg_malloc(sizeof(*link));
@@ -125,6 +134,7 @@ void *_vorbis_block_alloc(vorbis_block *vb,long bytes){
     vb->localalloc=bytes;
     vb->localstore=_ogg_malloc(vb->localalloc);
     vb->localtop=0;
+    ogg_allocator_use(prev);
   }
   {
     void *ret=(void *)(((char *)vb->localstore)+vb->localtop);
@@ -133,10 +143,19 @@ void *_vorbis_block_alloc(vorbis_block *vb,long bytes){
   }
 }
 
+static void _lap_flush(vorbis_dsp_state *v,long from);
+
 /* reap the chain, pull the ripcord */
 void _vorbis_block_ripcord(vorbis_block *vb){
+  vorbis_dsp_state *vd=vb->vd;
   /* reap the chain */
   struct alloc_chain *reap=vb->reap;
+
+  /* the block may hold an overlap not yet lapped; see lap.h */
+  if(vd && vd->backend_state && !vd->analysisp &&
+     ((private_state *)vd->backend_state)->lap.vb==vb)
+    _lap_flush(vd,vd->pcm_returned);
+
   while(reap){
     struct alloc_chain *next=reap->next;
     _ogg_free(reap->ptr);
@@ -146,7 +165,9 @@ void _vorbis_block_ripcord(vorbis_block *vb){
   }
   /* consolidate storage */
   if(vb->totaluse){
+    const ogg_allocator *prev=ogg_allocator_use(vb->vd->allocator);
     vb->localstore=_ogg_realloc(vb->localstore,vb->totaluse+vb->localalloc);
+    ogg_allocator_use(prev);
     vb->localalloc+=vb->totaluse;
     vb->totaluse=0;
   }
@@ -156,6 +177,20 @@ void _vorbis_block_ripcord(vorbis_block *vb){
   vb->reap=NULL;
 }
 
+/* reap, then make sure bytes can be allocated without a chain */
+int _vorbis_block_reserve(vorbis_block *vb,long bytes){
+  _vorbis_block_ripcord(vb);
+  if(bytes>vb->localalloc){
+    const ogg_allocator *prev=ogg_allocator_use(vb->vd->allocator);
+    void *ret=_ogg_realloc(vb->localstore,bytes);
+    ogg_allocator_use(prev);
+    if(!ret)return(OV_EFAULT);
+    vb->localstore=ret;
+    vb->localalloc=bytes;
+  }
+  return(0);
+}
+
 int vorbis_block_clear(vorbis_block *vb){
   int i;
   vorbis_block_internal *vbi=vb->internal;
@@ -188,6 +223,7 @@ static int _vds_shared_init(vorbis_dsp_state *v,vorbis_info *vi,int encp){
   hs=ci->halfrate_flag;
 
   memset(v,0,sizeof(*v));
+  v->allocator=ogg_allocator_current();
   b=v->backend_state=_ogg_calloc(1,sizeof(*b));
 
   v->vi=vi;
@@ -271,13 +307,19 @@ static int _vds_shared_init(vorbis_dsp_state *v,vorbis_info *vi,int encp){
   b->flr=_ogg_calloc(ci->floors,sizeof(*b->flr));
   b->residue=_ogg_calloc(ci->residues,sizeof(*b->residue));
 
-  for(i=0;i<ci->floors;i++)
-    b->flr[i]=_floor_P[ci->floor_type[i]]->
-      look(v,ci->floor_param[i]);
+  for(i=0;i<ci->floors;i++){
+    b->flr[i]=_vorbis_setup_floor(ci,i);
+    if(!b->flr[i])
+      b->flr[i]=_floor_P[ci->floor_type[i]]->
+        look(v,ci->floor_param[i]);
+  }
 
-  for(i=0;i<ci->residues;i++)
-    b->residue[i]=_residue_P[ci->residue_type[i]]->
-      look(v,ci->residue_param[i]);
+  for(i=0;i<ci->residues;i++){
+    b->residue[i]=_vorbis_setup_residue(ci,i);
+    if(!b->residue[i])
+      b->residue[i]=_residue_P[ci->residue_type[i]]->
+        look(v,ci->residue_param[i]);
+  }
 
   return 0;
  abort_books:
@@ -340,15 +382,17 @@ void vorbis_dsp_clear(vorbis_dsp_state *v){
       if(b->flr){
         if(ci)
           for(i=0;i<ci->floors;i++)
-            _floor_P[ci->floor_type[i]]->
-              free_look(b->flr[i]);
+            if(b->flr[i]!=_vorbis_setup_floor(ci,i))
+              _floor_P[ci->floor_type[i]]->
+                free_look(b->flr[i]);
         _ogg_free(b->flr);
       }
       if(b->residue){
         if(ci)
           for(i=0;i<ci->residues;i++)
-            _residue_P[ci->residue_type[i]]->
-              free_look(b->residue[i]);
+            if(b->residue[i]!=_vorbis_setup_residue(ci,i))
+              _residue_P[ci->residue_type[i]]->
+                free_look(b->residue[i]);
         _ogg_free(b->residue);
       }
       if(b->psy){
@@ -359,6 +403,8 @@ void vorbis_dsp_clear(vorbis_dsp_state *v){
       }
 
       if(b->psy_g_look)_vp_global_free(b->psy_g_look);
+      if(!b->pool_lent)_vorbis_pool_destroy(b->pool);
+      if(b->downmix)_ogg_free(b->downmix);
       vorbis_bitrate_clear(&b->bms);
 
       drft_clear(&b->fft_look[0]);
@@ -400,11 +446,13 @@ float **vorbis_analysis_buffer(vorbis_dsp_state *v, int vals){
      expand the PCM (and envelope) storage */
 
   if(v->pcm_current+vals>=v->pcm_storage){
+    const ogg_allocator *prev=ogg_allocator_use(v->allocator);
     v->pcm_storage=v->pcm_current+vals*2;
 
     for(i=0;i<vi->channels;i++){
       v->pcm[i]=_ogg_realloc(v->pcm[i],v->pcm_storage*sizeof(*v->pcm[i]));
     }
+    ogg_allocator_use(prev);
   }
 
   for(i=0;i<vi->channels;i++)
@@ -701,6 +749,7 @@ int vorbis_synthesis_restart(vorbis_dsp_state *v){
   v->sequence=-1;
   v->eofflag=0;
   ((private_state *)(v->backend_state))->sample_count=-1;
+  ((private_state *)(v->backend_state))->lap.vb=NULL;
 
   return(0);
 }
@@ -714,6 +763,167 @@ int vorbis_synthesis_init(vorbis_dsp_state *v,vorbis_info *vi){
   return 0;
 }
 
+/* Decode the channels of a block on up to threads threads (the
+   caller's included) once the bitstream has been read: each channel's
+   floor synthesis and inverse MDCT are independent of the others.
+   Blocks too small to pay for the dispatch stay on the caller's
+   thread, which in practice means stereo always does.  threads<=1
+   turns this off.  Output is the same either way. */
+int vorbis_synthesis_threads(vorbis_dsp_state *v,int threads){
+  private_state *b=v->backend_state;
+  if(!b || v->analysisp)return(OV_EINVAL);
+  _vorbis_synthesis_pool(v,NULL);
+  if(threads>1){
+    const ogg_allocator *prev=ogg_allocator_use(v->allocator);
+    b->pool=_vorbis_pool_create(threads-1);
+    ogg_allocator_use(prev);
+    if(!b->pool)return(OV_EFAULT);
+  }
+  return(0);
+}
+
+/* see thread.h */
+int _vorbis_synthesis_pool(vorbis_dsp_state *v,vorbis_pool *p){
+  private_state *b=v->backend_state;
+  if(!b || v->analysisp)return(OV_EINVAL);
+  if(!b->pool_lent)_vorbis_pool_destroy(b->pool);
+  b->pool=p;
+  b->pool_lent=p!=NULL;
+  return(0);
+}
+
+/* Decouple the channels and apply the floors in one sweep over the
+   spectra, a few hundred lines at a time (flag=1), rather than in a
+   pass each (flag=0, the default).  At Vorbis block sizes the spectra
+   mostly fit in the L1 cache anyway, so which is faster depends on the
+   machine and the stream; the output is the same either way. */
+int vorbis_synthesis_fused(vorbis_dsp_state *v,int flag){
+  private_state *b=v->backend_state;
+  if(!b || v->analysisp)return(OV_EINVAL);
+  b->fused=flag!=0;
+  return(0);
+}
+
+/* Mix the decoded channels down to channels channels, where matrix
+   holds channels rows of vi->channels gains each (output channel o is
+   the sum over c of matrix[o*vi->channels+c] times input channel c).
+   The inverse MDCT and the overlap-add are linear, so the mix is done
+   on the spectra and only the output channels are transformed and
+   lapped; vorbis_synthesis_pcmout() then returns channels channels.
+   A NULL matrix goes back to decoding every channel.  Set it before
+   the first block, or call vorbis_synthesis_restart() after, as the
+   overlap kept from earlier blocks is in the old layout. */
+int vorbis_synthesis_downmix(vorbis_dsp_state *v,int channels,
+                             const float *matrix){
+  private_state *b=v->backend_state;
+  float *copy=NULL;
+  if(!b || v->analysisp)return(OV_EINVAL);
+  if(matrix){
+    const ogg_allocator *prev;
+    if(channels<1 || channels>v->vi->channels)return(OV_EINVAL);
+    prev=ogg_allocator_use(v->allocator);
+    copy=_ogg_malloc(sizeof(*copy)*channels*v->vi->channels);
+    ogg_allocator_use(prev);
+    if(!copy)return(OV_EFAULT);
+    memcpy(copy,matrix,sizeof(*copy)*channels*v->vi->channels);
+  }
+  if(b->downmix)_ogg_free(b->downmix);
+  b->downmix=copy;
+  b->downmix_channels=copy?channels:0;
+  return(0);
+}
+
+/* Copy the stage timings gathered since init or the last reset to
+   stats (if not NULL), then zero them if reset is set.  Only builds
+   with VORBIS_PROFILE defined keep timings; others return OV_EIMPL. */
+int vorbis_synthesis_profile(vorbis_dsp_state *v,vorbis_profile *stats,
+                             int reset){
+  private_state *b=v->backend_state;
+  if(!b || v->analysisp)return(OV_EINVAL);
+#ifdef VORBIS_PROFILE
+  if(stats)*stats=b->profile;
+  if(reset)memset(&b->profile,0,sizeof(b->profile));
+  return(0);
+#else
+  (void)stats;
+  (void)reset;
+  return(OV_EIMPL);
+#endif
+}
+
+/* the channels synthesis hands back */
+static int _synthesis_channels(vorbis_dsp_state *v){
+  private_state *b=v->backend_state;
+  return(b && b->downmix?b->downmix_channels:v->vi->channels);
+}
+
+/* pcm[i]*down[-i]+cur[i]*up[i], as the window slopes run opposite
+   ways over the overlap; the SIMD code does the same multiplies and
+   add per sample, so the sums are the same */
+
+#ifdef VORBIS_SIMD_X86
+
+VORBIS_TARGET_SSE2
+static long _lap_sse2(float *d,const float *pcm,const float *cur,
+                      const float *up,const float *down,long n){
+  long i;
+  for(i=0;i+4<=n;i+=4){
+    __m128 w=_mm_loadu_ps(down-i-3);
+    w=_mm_shuffle_ps(w,w,_MM_SHUFFLE(0,1,2,3));
+    _mm_storeu_ps(d+i,_mm_add_ps(_mm_mul_ps(_mm_loadu_ps(pcm+i),w),
+                                 _mm_mul_ps(_mm_loadu_ps(cur+i),
+                                            _mm_loadu_ps(up+i))));
+  }
+  return i;
+}
+
+#endif
+
+void _vorbis_lap(float *d,const float *pcm,const float *cur,
+                 const float *up,const float *down,long n){
+  long i=0;
+#ifdef VORBIS_SIMD_X86
+  if(_vorbis_cpu_flags()&VORBIS_CPU_SSE2)
+    i=_lap_sse2(d,pcm,cur,up,down,n);
+#endif
+  for(;i<n;i++)
+    d[i]=pcm[i]*down[-i]+cur[i]*up[i];
+}
+
+/* write the pending overlap from sample from on into v->pcm */
+static void _lap_flush(vorbis_dsp_state *v,long from){
+  private_state *b=v->backend_state;
+  vorbis_lap *lap=&b->lap;
+  int channels=_synthesis_channels(v);
+  int j;
+
+  if(!lap->vb)return;
+  if(from<lap->begin)from=lap->begin;
+  for(j=0;j<channels;j++){
+    float *pcm=v->pcm[j];
+    float *cur=lap->vb->pcm[j]+lap->off-lap->begin;
+    long i=from;
+    if(i<lap->begin+lap->n){
+      long k=i-lap->begin;
+      _vorbis_lap(pcm+i,pcm+i,cur+i,lap->w+k,lap->w+lap->n-1-k,
+                  lap->begin+lap->n-i);
+      i=lap->begin+lap->n;
+    }
+    for(;i<lap->end;i++)
+      pcm[i]=cur[i];
+  }
+  lap->vb=NULL;
+}
+
+/* see lap.h */
+int _vorbis_synthesis_lazy(vorbis_dsp_state *v,int flag){
+  private_state *b=v->backend_state;
+  if(!b || v->analysisp)return(OV_EINVAL);
+  if(!flag)_lap_flush(v,v->pcm_returned);
+  b->lazy=flag!=0;
+  return(0);
+}
+
 /* Unlike in analysis, the window is only partially applied for each
    block.  The time domain envelope is not yet handled at the point of
    calling (as it relies on the previous block). */
@@ -723,10 +933,14 @@ int vorbis_synthesis_blockin(vorbis_dsp_state *v,vorbis_block *vb){
   codec_setup_info *ci=vi->codec_setup;
   private_state *b=v->backend_state;
   int hs=ci->halfrate_flag;
+  int channels=_synthesis_channels(v);
+  vorbis_lap *lap=&b->lap;
   int i,j;
+  VORBIS_CLOCK(t);
 
   if(!vb)return(OV_EINVAL);
   if(v->pcm_current>v->pcm_returned  && v->pcm_returned!=-1)return(OV_EINVAL);
+  lap->vb=NULL;
 
   v->lW=v->W;
   v->W=vb->W;
@@ -766,52 +980,40 @@ int vorbis_synthesis_blockin(vorbis_dsp_state *v,vorbis_block *vb){
        to have to constantly shift *or* adjust memory usage.  Don't
        accept a new block until the old is shifted out */
 
-    for(j=0;j<vi->channels;j++){
-      /* the overlap/add section */
+    /* the overlap/add section */
+    lap->vb=vb;
+    lap->begin=prevCenter;
+    lap->end=prevCenter+n1;
+    lap->off=0;
+    if(v->lW && v->W){
+      /* large/large */
+      lap->w=_vorbis_window_get(b->window[1]-hs);
+      lap->n=n1;
+    }else{
+      lap->w=_vorbis_window_get(b->window[0]-hs);
+      lap->n=n0;
       if(v->lW){
-        if(v->W){
-          /* large/large */
-          const float *w=_vorbis_window_get(b->window[1]-hs);
-          float *pcm=v->pcm[j]+prevCenter;
-          float *p=vb->pcm[j];
-          for(i=0;i<n1;i++)
-            pcm[i]=pcm[i]*w[n1-i-1] + p[i]*w[i];
-        }else{
-          /* large/small */
-          const float *w=_vorbis_window_get(b->window[0]-hs);
-          float *pcm=v->pcm[j]+prevCenter+n1/2-n0/2;
-          float *p=vb->pcm[j];
-          for(i=0;i<n0;i++)
-            pcm[i]=pcm[i]*w[n0-i-1] +p[i]*w[i];
-        }
+        /* large/small */
+        lap->begin+=n1/2-n0/2;
+        lap->end=lap->begin+n0;
+      }else if(v->W){
+        /* small/large */
+        lap->off=n1/2-n0/2;
+        lap->end=prevCenter+n1/2+n0/2;
       }else{
-        if(v->W){
-          /* small/large */
-          const float *w=_vorbis_window_get(b->window[0]-hs);
-          float *pcm=v->pcm[j]+prevCenter;
-          float *p=vb->pcm[j]+n1/2-n0/2;
-          for(i=0;i<n0;i++)
-            pcm[i]=pcm[i]*w[n0-i-1] +p[i]*w[i];
-          for(;i<n1/2+n0/2;i++)
-            pcm[i]=p[i];
-        }else{
-          /* small/small */
-          const float *w=_vorbis_window_get(b->window[0]-hs);
-          float *pcm=v->pcm[j]+prevCenter;
-          float *p=vb->pcm[j];
-          for(i=0;i<n0;i++)
-            pcm[i]=pcm[i]*w[n0-i-1] +p[i]*w[i];
-        }
+        /* small/small */
+        lap->end=prevCenter+n0;
       }
+    }
 
-      /* the copy section */
-      {
-        float *pcm=v->pcm[j]+thisCenter;
-        float *p=vb->pcm[j]+n;
-        for(i=0;i<n;i++)
-          pcm[i]=p[i];
-      }
+    /* the copy section */
+    for(j=0;j<channels;j++){
+      float *pcm=v->pcm[j]+thisCenter;
+      float *p=vb->pcm[j]+n;
+      for(i=0;i<n;i++)
+        pcm[i]=p[i];
     }
+    if(!b->lazy)_lap_flush(v,lap->begin);
 
     if(v->centerW)
       v->centerW=0;
@@ -929,18 +1131,18 @@ int vorbis_synthesis_blockin(vorbis_dsp_state *v,vorbis_block *vb){
   /* Update, cleanup */
 
   if(vb->eofflag)v->eofflag=1;
+  VORBIS_STAGE(&b->profile,blockin,t);
   return(0);
 
 }
 
 /* pcm==NULL indicates we just want the pending samples, no more */
 int vorbis_synthesis_pcmout(vorbis_dsp_state *v,float ***pcm){
-  vorbis_info *vi=v->vi;
-
   if(v->pcm_returned>-1 && v->pcm_returned<v->pcm_current){
     if(pcm){
-      int i;
-      for(i=0;i<vi->channels;i++)
+      int i,channels=_synthesis_channels(v);
+      _lap_flush(v,v->pcm_returned);
+      for(i=0;i<channels;i++)
         v->pcmret[i]=v->pcm[i]+v->pcm_returned;
       *pcm=v->pcmret;
     }
@@ -955,6 +1157,35 @@ int vorbis_synthesis_read(vorbis_dsp_state *v,int n){
   return(0);
 }
 
+/* see lap.h */
+long _vorbis_synthesis_lapseg(vorbis_dsp_state *v,long pos,
+                              vorbis_lapseg *s){
+  private_state *b=v->backend_state;
+  vorbis_lap *lap=&b->lap;
+  long i=v->pcm_returned+pos;
+  long end=v->pcm_current;
+
+  if(v->pcm_returned<0 || i>=end)return(0);
+  s->pcm=v->pcm;
+  s->off=i;
+  s->cur=NULL;
+  if(lap->vb && i>=lap->begin){
+    long k=i-lap->begin;
+    if(k<lap->n){
+      s->cur=lap->vb->pcm;
+      s->curoff=lap->off+k;
+      s->up=lap->w+k;
+      s->down=lap->w+lap->n-1-k;
+      if(end>lap->begin+lap->n)end=lap->begin+lap->n;
+    }else if(i<lap->end){
+      s->pcm=lap->vb->pcm;
+      s->off=lap->off+k;
+    }
+  }else if(lap->vb && end>lap->begin)
+    end=lap->begin;
+  return(end-i);
+}
+
 /* intended for use with a specific vorbisfile feature; we want access
    to the [usually synthetic/postextrapolated] buffer and lapping at
    the end of a decode cycle, specifically, a half-short-block worth.
@@ -968,9 +1199,11 @@ int vorbis_synthesis_lapout(vorbis_dsp_state *v,float ***pcm){
   int n=ci->blocksizes[v->W]>>(hs+1);
   int n0=ci->blocksizes[0]>>(hs+1);
   int n1=ci->blocksizes[1]>>(hs+1);
+  int channels=_synthesis_channels(v);
   int i,j;
 
   if(v->pcm_returned<0)return 0;
+  _lap_flush(v,v->pcm_returned);
 
   /* our returned data ends at pcm_returned; because the synthesis pcm
      buffer is a two-fragment ring, that means our data block may be
@@ -985,7 +1218,7 @@ int vorbis_synthesis_lapout(vorbis_dsp_state *v,float ***pcm){
   if(v->centerW==n1){
     /* the data buffer wraps; swap the halves */
     /* slow, sure, small */
-    for(j=0;j<vi->channels;j++){
+    for(j=0;j<channels;j++){
       float *p=v->pcm[j];
       for(i=0;i<n1;i++){
         float temp=p[i];
@@ -1002,7 +1235,7 @@ int vorbis_synthesis_lapout(vorbis_dsp_state *v,float ***pcm){
   /* solidify buffer into contiguous space */
   if((v->lW^v->W)==1){
     /* long/short or short/long */
-    for(j=0;j<vi->channels;j++){
+    for(j=0;j<channels;j++){
       float *s=v->pcm[j];
       float *d=v->pcm[j]+(n1-n0)/2;
       for(i=(n1+n0)/2-1;i>=0;--i)
@@ -1013,7 +1246,7 @@ int vorbis_synthesis_lapout(vorbis_dsp_state *v,float ***pcm){
   }else{
     if(v->lW==0){
       /* short/short */
-      for(j=0;j<vi->channels;j++){
+      for(j=0;j<channels;j++){
         float *s=v->pcm[j];
         float *d=v->pcm[j]+n1-n0;
         for(i=n0-1;i>=0;--i)
@@ -1026,7 +1259,7 @@ int vorbis_synthesis_lapout(vorbis_dsp_state *v,float ***pcm){
 
   if(pcm){
     int i;
-    for(i=0;i<vi->channels;i++)
+    for(i=0;i<channels;i++)
       v->pcmret[i]=v->pcm[i]+v->pcm_returned;
     *pcm=v->pcmret;
   }
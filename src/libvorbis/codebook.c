@@ -23,7 +23,15 @@
 #include "codebook.h"
 #include "scales.h"
 #include "misc.h"
+#ifdef VORBIS_DECODE_TABLE_STATS
+#include "thread.h"
+#endif
 #include "os.h"
+#include "cpu.h"
+
+#ifdef VORBIS_SIMD_X86
+#  include <emmintrin.h>
+#endif
 
 /* packs the given codebook into the bitstream **************************/
 
@@ -293,29 +301,53 @@ static ogg_uint32_t bitreverse(ogg_uint32_t x){
   return((x>> 1)&0x55555555) | ((x<< 1)&0xaaaaaaaa);
 }
 
-STIN long decode_packed_entry_number(codebook *book, oggpack_buffer *b){
+STIN long decode_packed_entry_number(codebook *book, oggpack_cache *b){
   int  read=book->dec_maxlength;
   long lo,hi;
-  long lok = oggpack_look(b,book->dec_firsttablen);
+  long lok = oggpack_cache_look(b,book->dec_firsttablen);
 
   if (lok >= 0) {
     long entry = book->dec_firsttable[lok];
-    if(entry&0x80000000UL){
+    if(!(entry&0x80000000UL)){
+#ifdef VORBIS_DECODE_TABLE_STATS
+      vorbis_atomic_inc(&book->dec_firsthits);
+#endif
+      oggpack_cache_adv(b, book->dec_codelengths[entry-1]);
+      return(entry-1);
+    }else if(entry&0x40000000UL){
+      /* second level table */
+      int firstbits=book->dec_firsttablen;
+      lok = oggpack_cache_look(b, firstbits+((entry>>25)&0x1f));
+      if(lok >= 0){
+        entry = book->dec_secondtable[(entry&0x1ffffff)+(lok>>firstbits)];
+        if(entry){
+#ifdef VORBIS_DECODE_TABLE_STATS
+          vorbis_atomic_inc(&book->dec_secondhits);
+#endif
+          oggpack_cache_adv(b, book->dec_codelengths[entry-1]);
+          return(entry-1);
+        }
+      }
+      /* short packet or invalid word; let the search sort it out */
+      lo=0;
+      hi=book->used_entries;
+    }else{
       lo=(entry>>15)&0x7fff;
       hi=book->used_entries-(entry&0x7fff);
-    }else{
-      oggpack_adv(b, book->dec_codelengths[entry-1]);
-      return(entry-1);
     }
   }else{
     lo=0;
     hi=book->used_entries;
   }
 
-  lok = oggpack_look(b, read);
+#ifdef VORBIS_DECODE_TABLE_STATS
+  vorbis_atomic_inc(&book->dec_searches);
+#endif
+
+  lok = oggpack_cache_look(b, read);
 
   while(lok<0 && read>1)
-    lok = oggpack_look(b, --read);
+    lok = oggpack_cache_look(b, --read);
   if(lok<0)return -1;
 
   /* bisect search for the codeword in the ordered list */
@@ -330,12 +362,12 @@ STIN long decode_packed_entry_number(codebook *book, oggpack_buffer *b){
       }
 
     if(book->dec_codelengths[lo]<=read){
-      oggpack_adv(b, book->dec_codelengths[lo]);
+      oggpack_cache_adv(b, book->dec_codelengths[lo]);
       return(lo);
     }
   }
 
-  oggpack_adv(b, read);
+  oggpack_cache_adv(b, read);
 
   return(-1);
 }
@@ -355,7 +387,7 @@ STIN long decode_packed_entry_number(codebook *book, oggpack_buffer *b){
    addmul==2 -> multiplicitive */
 
 /* returns the [original, not compacted] entry number or -1 on eof *********/
-long vorbis_book_decode(codebook *book, oggpack_buffer *b){
+long vorbis_book_decode(codebook *book, oggpack_cache *b){
   if(book->used_entries>0){
     long packed_entry=decode_packed_entry_number(book,b);
     if(packed_entry>=0)
@@ -366,9 +398,155 @@ long vorbis_book_decode(codebook *book, oggpack_buffer *b){
   return(-1);
 }
 
+#ifdef VORBIS_SIMD_X86
+
+/* SSE2 versions of the adding decoders below, for books with
+   dec_vectors.  An entry's values load as one aligned vector (two for
+   dim 8, the top half zeros for dim 2), and the lanes are moved where
+   they go with shuffles rather than element by element.  Each output
+   gets the same single precision add as in the C code, so the sums
+   are identical. */
+
+#define SHUF(a,b,c,d) _MM_SHUFFLE(d,c,b,a)  /* lanes in memory order */
+
+VORBIS_TARGET_SSE2
+STIN void add2(float *a,__m128 t){
+  __m128 x=_mm_loadl_pi(_mm_setzero_ps(),(const __m64 *)a);
+  _mm_storel_pi((__m64 *)a,_mm_add_ps(x,t));
+}
+
+VORBIS_TARGET_SSE2
+STIN void add4(float *a,__m128 t){
+  _mm_storeu_ps(a,_mm_add_ps(_mm_loadu_ps(a),t));
+}
+
+VORBIS_TARGET_SSE2
+static long decodevs_add_sse2(codebook *book,float *a,oggpack_cache *b,
+                              int n){
+  int step=n/book->dim;
+  long stride=(book->dim+3)&~3L;
+  const float **t=alloca(sizeof(*t)*step);
+  int i,j;
+
+  for(j=0;j<step;j++){
+    long entry=decode_packed_entry_number(book,b);
+    if(entry==-1)return(-1);
+    t[j]=book->dec_vectors+entry*stride;
+  }
+
+  /* four entries at a time, transposed so that each vector holds
+     one position of all four */
+  for(j=0;j+4<=step;j+=4){
+    for(i=0;i<book->dim;i+=4){
+      __m128 r0=_mm_load_ps(t[j]+i);
+      __m128 r1=_mm_load_ps(t[j+1]+i);
+      __m128 r2=_mm_load_ps(t[j+2]+i);
+      __m128 r3=_mm_load_ps(t[j+3]+i);
+      _MM_TRANSPOSE4_PS(r0,r1,r2,r3);
+      add4(a+i*step+j,r0);
+      add4(a+(i+1)*step+j,r1);
+      if(book->dim>2){
+        add4(a+(i+2)*step+j,r2);
+        add4(a+(i+3)*step+j,r3);
+      }
+    }
+  }
+  for(;j<step;j++)
+    for(i=0;i<book->dim;i++)
+      a[i*step+j]+=t[j][i];
+  return(0);
+}
+
+VORBIS_TARGET_SSE2
+static long decodev_add_sse2(codebook *book,float *a,oggpack_cache *b,
+                             int n){
+  const float *v=book->dec_vectors;
+  long entry;
+  int i;
+
+  switch(book->dim){
+  case 2:
+    for(i=0;i<n;i+=2){
+      entry=decode_packed_entry_number(book,b);
+      if(entry==-1)return(-1);
+      add2(a+i,_mm_load_ps(v+entry*4));
+    }
+    break;
+  case 4:
+    for(i=0;i<n;i+=4){
+      entry=decode_packed_entry_number(book,b);
+      if(entry==-1)return(-1);
+      add4(a+i,_mm_load_ps(v+entry*4));
+    }
+    break;
+  default:
+    for(i=0;i<n;i+=8){
+      entry=decode_packed_entry_number(book,b);
+      if(entry==-1)return(-1);
+      add4(a+i,_mm_load_ps(v+entry*8));
+      add4(a+i+4,_mm_load_ps(v+entry*8+4));
+    }
+    break;
+  }
+  return(0);
+}
+
+/* two channels, interleaved in the book's vectors, to two vectors */
+VORBIS_TARGET_SSE2
+static long decodevv2_add_sse2(codebook *book,float **a,long offset,
+                               oggpack_cache *b,int n){
+  const float *v=book->dec_vectors;
+  float *a0=a[0];
+  float *a1=a[1];
+  long i,end=(offset+n)/2,entry;
+
+  switch(book->dim){
+  case 2:
+    for(i=offset/2;i<end;i++){
+      const float *t;
+      entry=decode_packed_entry_number(book,b);
+      if(entry==-1)return(-1);
+      t=v+entry*4;
+      a0[i]+=t[0];
+      a1[i]+=t[1];
+    }
+    break;
+  case 4:
+    for(i=offset/2;i<end;i+=2){
+      __m128 t,x;
+      entry=decode_packed_entry_number(book,b);
+      if(entry==-1)return(-1);
+      t=_mm_load_ps(v+entry*4);
+      x=_mm_loadl_pi(_mm_setzero_ps(),(const __m64 *)(a0+i));
+      x=_mm_loadh_pi(x,(const __m64 *)(a1+i));
+      x=_mm_add_ps(x,_mm_shuffle_ps(t,t,SHUF(0,2,1,3)));
+      _mm_storel_pi((__m64 *)(a0+i),x);
+      _mm_storeh_pi((__m64 *)(a1+i),x);
+    }
+    break;
+  default:
+    for(i=offset/2;i<end;i+=4){
+      __m128 t0,t1;
+      entry=decode_packed_entry_number(book,b);
+      if(entry==-1)return(-1);
+      t0=_mm_load_ps(v+entry*8);
+      t1=_mm_load_ps(v+entry*8+4);
+      add4(a0+i,_mm_shuffle_ps(t0,t1,SHUF(0,2,0,2)));
+      add4(a1+i,_mm_shuffle_ps(t0,t1,SHUF(1,3,1,3)));
+    }
+    break;
+  }
+  return(0);
+}
+
+#endif
+
 /* returns 0 on OK or -1 on eof *************************************/
 /* decode vector / dim granularity gaurding is done in the upper layer */
-long vorbis_book_decodevs_add(codebook *book,float *a,oggpack_buffer *b,int n){
+long vorbis_book_decodevs_add(codebook *book,float *a,oggpack_cache *b,int n){
+#ifdef VORBIS_SIMD_X86
+  if(book->dec_vectors)return(decodevs_add_sse2(book,a,b,n));
+#endif
   if(book->used_entries>0){
     int step=n/book->dim;
     long *entry = alloca(sizeof(*entry)*step);
@@ -388,7 +566,10 @@ long vorbis_book_decodevs_add(codebook *book,float *a,oggpack_buffer *b,int n){
 }
 
 /* decode vector / dim granularity gaurding is done in the upper layer */
-long vorbis_book_decodev_add(codebook *book,float *a,oggpack_buffer *b,int n){
+long vorbis_book_decodev_add(codebook *book,float *a,oggpack_cache *b,int n){
+#ifdef VORBIS_SIMD_X86
+  if(book->dec_vectors)return(decodev_add_sse2(book,a,b,n));
+#endif
   if(book->used_entries>0){
     int i,j,entry;
     float *t;
@@ -436,7 +617,7 @@ long vorbis_book_decodev_add(codebook *book,float *a,oggpack_buffer *b,int n){
 /* unlike the others, we guard against n not being an integer number
    of <dim> internally rather than in the upper layer (called only by
    floor0) */
-long vorbis_book_decodev_set(codebook *book,float *a,oggpack_buffer *b,int n){
+long vorbis_book_decodev_set(codebook *book,float *a,oggpack_cache *b,int n){
   if(book->used_entries>0){
     int i,j,entry;
     float *t;
@@ -460,11 +641,28 @@ long vorbis_book_decodev_set(codebook *book,float *a,oggpack_buffer *b,int n){
 }
 
 long vorbis_book_decodevv_add(codebook *book,float **a,long offset,int ch,
-                              oggpack_buffer *b,int n){
+                              oggpack_cache *b,int n){
 
   long i,j,entry;
   int chptr=0;
-  if(book->used_entries>0){
+#ifdef VORBIS_SIMD_X86
+  if(book->dec_vectors && ch==2)
+    return(decodevv2_add_sse2(book,a,offset,b,n));
+#endif
+  if(book->used_entries>0 && ch==2){
+    /* the usual stereo res2: k counts values in the interleaved
+       vector, so the channel and frame follow from it directly */
+    long k=offset/2*2,end=(offset+n)/2*2;
+    while(k<end){
+      entry = decode_packed_entry_number(book,b);
+      if(entry==-1)return(-1);
+      {
+        const float *t = book->valuelist+entry*book->dim;
+        for (j=0;j<book->dim;j++,k++)
+          a[k&1][k>>1]+=t[j];
+      }
+    }
+  }else if(book->used_entries>0){
     for(i=offset/ch;i<(offset+n)/ch;){
       entry = decode_packed_entry_number(book,b);
       if(entry==-1)return(-1);
@@ -19,6 +19,16 @@
 #define _V_CODEBOOK_H_
 
 #include <ogg/ogg.h>
+#include <ogg/oggpack_cache.h>
+
+/* Upper bound in bytes on the second level decode tables of a single
+   codebook; see vorbis_book_init_decode(). */
+#ifndef VORBIS_DECODE_TABLE_BUDGET
+#define VORBIS_DECODE_TABLE_BUDGET 8192
+#endif
+
+/* second level tables are never built deeper than this */
+#define VORBIS_DECODE_SUBTABLE_MAXBITS 16
 
 /* This structure encapsulates huffman and VQ style encoding books; it
    doesn't do anything specific to either.
@@ -72,6 +82,21 @@ typedef struct codebook{
   ogg_uint32_t *dec_firsttable;
   int           dec_firsttablen;
   int           dec_maxlength;
+  ogg_uint32_t *dec_secondtable; /* second level tables for long words */
+
+  /* valuelist again for the SIMD decoders, where the CPU has them and
+     dim is 2, 4 or 8: 16 byte aligned, each entry padded with zeros to
+     a whole number of vectors (dec_vectorstore is the allocation) */
+  float        *dec_vectors;
+  void         *dec_vectorstore;
+
+#ifdef VORBIS_DECODE_TABLE_STATS
+  /* how codewords were resolved: first table, second table, search;
+     bumped atomically, as decoders on other threads may share the book */
+  long          dec_firsthits;
+  long          dec_secondhits;
+  long          dec_searches;
+#endif
 
   /* The current encoder uses only centered, integer-only lattice books. */
   int           quantvals;
@@ -103,16 +128,16 @@ extern static_codebook *vorbis_staticbook_unpack(oggpack_buffer *b);
 
 extern int vorbis_book_encode(codebook *book, int a, oggpack_buffer *b);
 
-extern long vorbis_book_decode(codebook *book, oggpack_buffer *b);
+extern long vorbis_book_decode(codebook *book, oggpack_cache *b);
 extern long vorbis_book_decodevs_add(codebook *book, float *a,
-                                     oggpack_buffer *b,int n);
+                                     oggpack_cache *b,int n);
 extern long vorbis_book_decodev_set(codebook *book, float *a,
-                                    oggpack_buffer *b,int n);
+                                    oggpack_cache *b,int n);
 extern long vorbis_book_decodev_add(codebook *book, float *a,
-                                    oggpack_buffer *b,int n);
+                                    oggpack_cache *b,int n);
 extern long vorbis_book_decodevv_add(codebook *book, float **a,
                                      long off,int ch,
-                                    oggpack_buffer *b,int n);
+                                    oggpack_cache *b,int n);
 
 
 
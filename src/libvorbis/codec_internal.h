@@ -20,6 +20,7 @@
 
 #include "envelope.h"
 #include "codebook.h"
+#include "lap.h"
 
 #define BLOCKTYPE_IMPULSE    0
 #define BLOCKTYPE_PADDING    1
@@ -82,6 +83,26 @@ typedef struct private_state {
   bitrate_manager_state bms;
 
   ogg_int64_t sample_count;
+
+  /* per channel floor synthesis and inverse MDCT run here when set;
+     see vorbis_synthesis_threads() */
+  struct vorbis_pool *pool;
+  int                 pool_lent; /* see _vorbis_synthesis_pool() */
+
+  /* when set, blocks are mixed down to downmix_channels channels
+     before the inverse MDCT; see vorbis_synthesis_downmix() */
+  float *downmix;
+  int    downmix_channels;
+
+  /* decoupling and floors in one sweep; see vorbis_synthesis_fused() */
+  int    fused;
+
+  /* the overlap blockin left for the reader; see lap.h */
+  int        lazy;
+  vorbis_lap lap;
+
+  /* see vorbis_synthesis_profile() */
+  vorbis_profile profile;
 } private_state;
 
 /* codec_setup_info contains all the setup information specific to the
@@ -127,7 +148,12 @@ typedef struct codec_setup_info {
   highlevel_encode_setup hi; /* used only by vorbisenc.c.  It's a
                                 highly redundant structure, but
                                 improves clarity of program flow. */
-  int         halfrate_flag; /* painless downsample for decode */
+  int         halfrate_flag; /* painless downsample for decode; the
+                                rate is divided by 1<<halfrate_flag */
+
+  /* when set, the setup header settings and books above belong to
+     the setup cache (setupcache.c), not to this codec_setup_info */
+  struct vorbis_shared_setup *shared;
 } codec_setup_info;
 
 extern vorbis_look_psy_global *_vp_global_look(vorbis_info *vi);
@@ -164,4 +190,6 @@ extern int *floor1_interpolate_fit(vorbis_block *vb,vorbis_look_floor1 *look,
 extern int floor1_encode(oggpack_buffer *opb,vorbis_block *vb,
                   vorbis_look_floor1 *look,
                   int *post,int *ilogmask);
+
+extern void mapping0_decouple(float *pcmM,float *pcmA,long n);
 #endif
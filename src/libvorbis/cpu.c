@@ -0,0 +1,90 @@
+/********************************************************************
+ *                                                                  *
+ * THIS FILE IS PART OF THE OggVorbis SOFTWARE CODEC SOURCE CODE.   *
+ * USE, DISTRIBUTION AND REPRODUCTION OF THIS LIBRARY SOURCE IS     *
+ * GOVERNED BY A BSD-STYLE SOURCE LICENSE INCLUDED WITH THIS SOURCE *
+ * IN 'COPYING'. PLEASE READ THESE TERMS BEFORE DISTRIBUTING.       *
+ *                                                                  *
+ * THE OggVorbis SOURCE CODE IS (C) COPYRIGHT 1994-2009             *
+ * by the Xiph.Org Foundation http://www.xiph.org/                  *
+ *                                                                  *
+ ********************************************************************
+
+ function: runtime CPU feature detection for SIMD code paths
+
+ ********************************************************************/
+
+#include "cpu.h"
+
+#ifdef VORBIS_SIMD_X86
+
+#ifdef _MSC_VER
+#  include <intrin.h>
+#else
+#  include <cpuid.h>
+#endif
+
+static void cpuid(unsigned int leaf,unsigned int *r){
+#ifdef _MSC_VER
+  int regs[4];
+  __cpuidex(regs,leaf,0);
+  r[0]=regs[0];
+  r[1]=regs[1];
+  r[2]=regs[2];
+  r[3]=regs[3];
+#else
+  __cpuid_count(leaf,0,r[0],r[1],r[2],r[3]);
+#endif
+}
+
+/* the OS has to save the upper register halves across context
+   switches before AVX may be used */
+static int os_saves_ymm(void){
+#ifdef _MSC_VER
+  return (_xgetbv(0)&6)==6;
+#else
+  unsigned int eax,edx;
+  __asm__ volatile(".byte 0x0f, 0x01, 0xd0" : "=a"(eax), "=d"(edx) : "c"(0));
+  return (eax&6)==6;
+#endif
+}
+
+static int detect(void){
+  unsigned int r[4];
+  unsigned int maxleaf;
+  int flags=0;
+
+  cpuid(0,r);
+  maxleaf=r[0];
+  if(maxleaf<1)return 0;
+
+  cpuid(1,r);
+  if(r[3]&(1<<26))flags|=VORBIS_CPU_SSE2;
+  if(r[2]&(1<<9))flags|=VORBIS_CPU_SSSE3;
+  if(r[2]&(1<<19))flags|=VORBIS_CPU_SSE41;
+
+  /* AVX needs both the CPU bit and OSXSAVE */
+  if((r[2]&(1<<28)) && (r[2]&(1<<27)) && os_saves_ymm()){
+    flags|=VORBIS_CPU_AVX;
+    if(maxleaf>=7){
+      cpuid(7,r);
+      if(r[1]&(1<<5))flags|=VORBIS_CPU_AVX2;
+    }
+  }
+
+  return flags;
+}
+
+#endif
+
+/* The result is cached; detection is idempotent, so a race between two
+   threads doing it at once is harmless. */
+int _vorbis_cpu_flags(void){
+#ifdef VORBIS_SIMD_X86
+  static volatile int flags=-1;
+  if(flags<0)flags=detect();
+  return flags;
+#else
+  return 0;
+#endif
+}
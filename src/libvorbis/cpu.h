@@ -0,0 +1,48 @@
+/********************************************************************
+ *                                                                  *
+ * THIS FILE IS PART OF THE OggVorbis SOFTWARE CODEC SOURCE CODE.   *
+ * USE, DISTRIBUTION AND REPRODUCTION OF THIS LIBRARY SOURCE IS     *
+ * GOVERNED BY A BSD-STYLE SOURCE LICENSE INCLUDED WITH THIS SOURCE *
+ * IN 'COPYING'. PLEASE READ THESE TERMS BEFORE DISTRIBUTING.       *
+ *                                                                  *
+ * THE OggVorbis SOURCE CODE IS (C) COPYRIGHT 1994-2009             *
+ * by the Xiph.Org Foundation http://www.xiph.org/                  *
+ *                                                                  *
+ ********************************************************************
+
+ function: runtime CPU feature detection for SIMD code paths
+
+ ********************************************************************/
+
+#ifndef _V_CPU_H_
+#define _V_CPU_H_
+
+/* SIMD kernels are only built for x86/x64; everything else (including
+   ARM) runs the portable C code.  Define VORBIS_NO_SIMD to force the C
+   code everywhere. */
+#if !defined(VORBIS_NO_SIMD) && \
+  (defined(_M_IX86) || defined(_M_X64) || defined(__i386__) || defined(__x86_64__))
+#  define VORBIS_SIMD_X86
+#endif
+
+/* gcc and clang only emit instructions for an extension inside functions
+   that ask for it; MSVC accepts the intrinsics anywhere */
+#if defined(__GNUC__)
+#  define VORBIS_TARGET_SSE2 __attribute__((target("sse2")))
+#  define VORBIS_TARGET_AVX  __attribute__((target("avx")))
+#  define VORBIS_TARGET_AVX2 __attribute__((target("avx2")))
+#else
+#  define VORBIS_TARGET_SSE2
+#  define VORBIS_TARGET_AVX
+#  define VORBIS_TARGET_AVX2
+#endif
+
+#define VORBIS_CPU_SSE2   0x01
+#define VORBIS_CPU_SSSE3  0x02
+#define VORBIS_CPU_SSE41  0x04
+#define VORBIS_CPU_AVX    0x08
+#define VORBIS_CPU_AVX2   0x10
+
+extern int _vorbis_cpu_flags(void);
+
+#endif
@@ -109,15 +109,14 @@ static vorbis_info_floor *floor0_unpack (vorbis_info *vi,oggpack_buffer *opb){
    Note that the scale depends on the sampling rate as well as the
    linear block and mapping sizes */
 
-static void floor0_map_lazy_init(vorbis_block      *vb,
+static void floor0_map_lazy_init(vorbis_dsp_state  *vd,
                                  vorbis_info_floor *infoX,
-                                 vorbis_look_floor0 *look){
-  if(!look->linearmap[vb->W]){
-    vorbis_dsp_state   *vd=vb->vd;
+                                 vorbis_look_floor0 *look,
+                                 int W){
+  if(!look->linearmap[W]){
     vorbis_info        *vi=vd->vi;
     codec_setup_info   *ci=vi->codec_setup;
     vorbis_info_floor0 *info=(vorbis_info_floor0 *)infoX;
-    int W=vb->W;
     int n=ci->blocksizes[W]/2,j;
 
     /* we choose a scaling constant so that:
@@ -164,7 +163,13 @@ static void *floor0_inverse1(vorbis_block *vb,vorbis_look_floor *i){
   vorbis_info_floor0 *info=look->vi;
   int j,k;
 
-  int ampraw=oggpack_read(&vb->opb,info->ampbits);
+  int ampraw;
+
+  /* here rather than in inverse2, which may run for several channels
+     at once */
+  floor0_map_lazy_init(vb->vd,info,look,vb->W);
+
+  ampraw=oggpack_read(&vb->opb,info->ampbits);
   if(ampraw>0){ /* also handles the -1 out of data case */
     long maxval=(1<<info->ampbits)-1;
     float amp=(float)ampraw/maxval*info->ampdB;
@@ -179,8 +184,13 @@ static void *floor0_inverse1(vorbis_block *vb,vorbis_look_floor *i){
          smash; b->dim is provably more than we can overflow the
          vector */
       float *lsp=_vorbis_block_alloc(vb,sizeof(*lsp)*(look->m+b->dim+1));
+      oggpack_cache opc;
+      long ret;
 
-      if(vorbis_book_decodev_set(b,lsp,&vb->opb,look->m)==-1)goto eop;
+      oggpack_cache_init(&opc,&vb->opb);
+      ret=vorbis_book_decodev_set(b,lsp,&opc,look->m);
+      oggpack_cache_sync(&opc);
+      if(ret==-1)goto eop;
       for(j=0;j<look->m;){
         for(k=0;j<look->m && k<b->dim;k++,j++)lsp[j]+=last;
         last=lsp[j-1];
@@ -198,8 +208,9 @@ static int floor0_inverse2(vorbis_block *vb,vorbis_look_floor *i,
                            void *memo,float *out){
   vorbis_look_floor0 *look=(vorbis_look_floor0 *)i;
   vorbis_info_floor0 *info=look->vi;
-
-  floor0_map_lazy_init(vb,info,look);
+  codec_setup_info   *ci=vb->vd->vi->codec_setup;
+  /* at a reduced rate only the bottom of the spectrum is used */
+  int                 n=look->n[vb->W]>>ci->halfrate_flag;
 
   if(memo){
     float *lsp=(float *)memo;
@@ -208,17 +219,40 @@ static int floor0_inverse2(vorbis_block *vb,vorbis_look_floor *i,
     /* take the coefficients back to a spectral envelope curve */
     vorbis_lsp_to_curve(out,
                         look->linearmap[vb->W],
-                        look->n[vb->W],
+                        n,
                         look->ln,
                         lsp,look->m,amp,(float)info->ampdB);
     return(1);
   }
-  memset(out,0,sizeof(*out)*look->n[vb->W]);
+  memset(out,0,sizeof(*out)*n);
   return(0);
 }
 
+static long floor0_reserve(vorbis_dsp_state *vd,vorbis_look_floor *i,
+                           long *bits){
+  vorbis_look_floor0 *look=(vorbis_look_floor0 *)i;
+  vorbis_info_floor0 *info=look->vi;
+  codec_setup_info   *ci=vd->vi->codec_setup;
+  long bytes=0,most=0;
+  int j;
+
+  floor0_map_lazy_init(vd,info,look,0);
+  floor0_map_lazy_init(vd,info,look,1);
+
+  for(j=0;j<info->numbooks;j++){
+    codebook *b=ci->fullbooks+info->books[j];
+    long need=_vorbis_block_bytes(sizeof(float)*(look->m+b->dim+1));
+    long read=(look->m+b->dim-1)/b->dim*b->dec_maxlength;
+    if(need>bytes)bytes=need;
+    if(read>most)most=read;
+  }
+  *bits=info->ampbits+_ilog(info->numbooks)+most;
+  return(bytes);
+}
+
 /* export hooks */
 const vorbis_func_floor floor0_exportbundle={
   NULL,&floor0_unpack,&floor0_look,&floor0_free_info,
-  &floor0_free_look,&floor0_inverse1,&floor0_inverse2
+  &floor0_free_look,&floor0_inverse1,&floor0_inverse2,&floor0_reserve,
+  NULL
 };
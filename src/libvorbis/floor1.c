@@ -975,13 +975,16 @@ static void *floor1_inverse1(vorbis_block *vb,vorbis_look_floor *in){
 
   int i,j,k;
   codebook *books=ci->fullbooks;
+  oggpack_cache opc;
+
+  oggpack_cache_init(&opc,&vb->opb);
 
   /* unpack wrapped/predicted values from stream */
-  if(oggpack_read(&vb->opb,1)==1){
+  if(oggpack_cache_read(&opc,1)==1){
     int *fit_value=_vorbis_block_alloc(vb,(look->posts)*sizeof(*fit_value));
 
-    fit_value[0]=oggpack_read(&vb->opb,ilog(look->quant_q-1));
-    fit_value[1]=oggpack_read(&vb->opb,ilog(look->quant_q-1));
+    fit_value[0]=oggpack_cache_read(&opc,ilog(look->quant_q-1));
+    fit_value[1]=oggpack_cache_read(&opc,ilog(look->quant_q-1));
 
     /* partition by partition */
     for(i=0,j=2;i<info->partitions;i++){
@@ -993,7 +996,7 @@ static void *floor1_inverse1(vorbis_block *vb,vorbis_look_floor *in){
 
       /* decode the partition's first stage cascade value */
       if(csubbits){
-        cval=vorbis_book_decode(books+info->class_book[class],&vb->opb);
+        cval=vorbis_book_decode(books+info->class_book[class],&opc);
 
         if(cval==-1)goto eop;
       }
@@ -1002,7 +1005,7 @@ static void *floor1_inverse1(vorbis_block *vb,vorbis_look_floor *in){
         int book=info->class_subbook[class][cval&(csub-1)];
         cval>>=csubbits;
         if(book>=0){
-          if((fit_value[j+k]=vorbis_book_decode(books+book,&vb->opb))==-1)
+          if((fit_value[j+k]=vorbis_book_decode(books+book,&opc))==-1)
             goto eop;
         }else{
           fit_value[j+k]=0;
@@ -1010,6 +1013,7 @@ static void *floor1_inverse1(vorbis_block *vb,vorbis_look_floor *in){
       }
       j+=cdim;
     }
+    oggpack_cache_sync(&opc);
 
     /* unwrap positive values and reconsitute via linear interpolation */
     for(i=2;i<look->posts;i++){
@@ -1051,16 +1055,49 @@ static void *floor1_inverse1(vorbis_block *vb,vorbis_look_floor *in){
     return(fit_value);
   }
  eop:
+  oggpack_cache_sync(&opc);
   return(NULL);
 }
 
-static int floor1_inverse2(vorbis_block *vb,vorbis_look_floor *in,void *memo,
-                          float *out){
+/* as render_line, but stores the envelope instead of applying it */
+static void render_curve(int n, int x0,int x1,int y0,int y1,float *d){
+  int dy=y1-y0;
+  int adx=x1-x0;
+  int ady=abs(dy);
+  int base=dy/adx;
+  int sy=(dy<0?base-1:base+1);
+  int x=x0;
+  int y=y0;
+  int err=0;
+
+  ady-=abs(base*adx);
+
+  if(n>x1)n=x1;
+
+  if(x<n)
+    d[x]=FLOOR1_fromdB_LOOKUP[y];
+
+  while(++x<n){
+    err=err+ady;
+    if(err>=adx){
+      err-=adx;
+      y+=sy;
+    }else{
+      y+=base;
+    }
+    d[x]=FLOOR1_fromdB_LOOKUP[y];
+  }
+}
+
+static int floor1_render(vorbis_block *vb,vorbis_look_floor *in,void *memo,
+                         float *out,
+                         void (*line)(int,int,int,int,int,float *)){
   vorbis_look_floor1 *look=(vorbis_look_floor1 *)in;
   vorbis_info_floor1 *info=look->vi;
 
   codec_setup_info   *ci=vb->vd->vi->codec_setup;
-  int                  n=ci->blocksizes[vb->W]/2;
+  /* at a reduced rate only the bottom of the spectrum is used */
+  int                  n=ci->blocksizes[vb->W]>>(ci->halfrate_flag+1);
   int j;
 
   if(memo){
@@ -1082,21 +1119,60 @@ static int floor1_inverse2(vorbis_block *vb,vorbis_look_floor *in,void *memo,
         /* guard lookup against out-of-range values */
         hy=(hy<0?0:hy>255?255:hy);
 
-        render_line(n,lx,hx,ly,hy,out);
+        line(n,lx,hx,ly,hy,out);
 
         lx=hx;
         ly=hy;
       }
     }
-    for(j=hx;j<n;j++)out[j]*=FLOOR1_fromdB_LOOKUP[ly]; /* be certain */
+    /* be certain */
+    if(hx<n)line(n,hx,n,ly,ly,out);
     return(1);
   }
   memset(out,0,sizeof(*out)*n);
   return(0);
 }
 
+static int floor1_inverse2(vorbis_block *vb,vorbis_look_floor *in,void *memo,
+                          float *out){
+  return floor1_render(vb,in,memo,out,render_line);
+}
+
+static int floor1_curve(vorbis_block *vb,vorbis_look_floor *in,void *memo,
+                        float *out){
+  return floor1_render(vb,in,memo,out,render_curve);
+}
+
+static long floor1_reserve(vorbis_dsp_state *vd,vorbis_look_floor *in,
+                           long *bits){
+  vorbis_look_floor1 *look=(vorbis_look_floor1 *)in;
+  vorbis_info_floor1 *info=look->vi;
+  codec_setup_info   *ci=vd->vi->codec_setup;
+  codebook           *books=ci->fullbooks;
+  long                most=1+2*ilog(look->quant_q-1);
+  int                 i,k;
+
+  for(i=0;i<info->partitions;i++){
+    int class=info->partitionclass[i];
+    int csub=1<<info->class_subs[class];
+    int longest=0;
+
+    if(info->class_subs[class])
+      most+=books[info->class_book[class]].dec_maxlength;
+    for(k=0;k<csub;k++){
+      int book=info->class_subbook[class][k];
+      if(book>=0 && books[book].dec_maxlength>longest)
+        longest=books[book].dec_maxlength;
+    }
+    most+=info->class_dim[class]*longest;
+  }
+  *bits=most;
+  return(_vorbis_block_bytes(look->posts*sizeof(int)));
+}
+
 /* export hooks */
 const vorbis_func_floor floor1_exportbundle={
   &floor1_pack,&floor1_unpack,&floor1_look,&floor1_free_info,
-  &floor1_free_look,&floor1_inverse1,&floor1_inverse2
+  &floor1_free_look,&floor1_inverse1,&floor1_inverse2,&floor1_reserve,
+  &floor1_curve
 };
@@ -28,6 +28,7 @@
 #include "registry.h"
 #include "window.h"
 #include "psy.h"
+#include "setupcache.h"
 #include "misc.h"
 #include "os.h"
 
@@ -161,6 +162,13 @@ void vorbis_info_clear(vorbis_info *vi){
   codec_setup_info     *ci=vi->codec_setup;
   int i;
 
+  if(ci && ci->shared){
+    /* the setup header settings and books are the cache's */
+    _vorbis_setup_release(ci->shared);
+    _ogg_free(ci);
+    ci=NULL;
+  }
+
   if(ci){
 
     for(i=0;i<ci->modes;i++)
@@ -420,7 +428,18 @@ int vorbis_synthesis_headerin(vorbis_info *vi,vorbis_comment *vc,ogg_packet *op)
           return(OV_EBADHEADER);
         }
 
-        return(_vorbis_unpack_books(vi,&opb));
+        if(_vorbis_setup_find(vi,op))
+          return(0);
+        {
+          /* a setup that goes to the cache outlives this decoder, so
+             it comes from the heap rather than the caller's allocator */
+          const ogg_allocator *prev=ogg_allocator_use
+            (_vorbis_setup_sharing()?NULL:ogg_allocator_current());
+          int ret=_vorbis_unpack_books(vi,&opb);
+          if(!ret)_vorbis_setup_share(vi,op);
+          ogg_allocator_use(prev);
+          return(ret);
+        }
 
       default:
         /* Not a valid vorbis header type */
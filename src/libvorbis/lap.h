@@ -0,0 +1,61 @@
+/********************************************************************
+ *                                                                  *
+ * THIS FILE IS PART OF THE OggVorbis SOFTWARE CODEC SOURCE CODE.   *
+ * USE, DISTRIBUTION AND REPRODUCTION OF THIS LIBRARY SOURCE IS     *
+ * GOVERNED BY A BSD-STYLE SOURCE LICENSE INCLUDED WITH THIS SOURCE *
+ * IN 'COPYING'. PLEASE READ THESE TERMS BEFORE DISTRIBUTING.       *
+ *                                                                  *
+ * THE OggVorbis SOURCE CODE IS (C) COPYRIGHT 1994-2009             *
+ * by the Xiph.Org Foundation http://www.xiph.org/                  *
+ *                                                                  *
+ ********************************************************************
+
+ function: windowed overlap-add of synthesis blocks
+
+ ********************************************************************/
+
+#ifndef _V_LAP_H_
+#define _V_LAP_H_
+
+#include "vorbis/codec.h"
+
+/* d[i]=pcm[i]*down[-i]+cur[i]*up[i] for i<n; d may be pcm */
+extern void _vorbis_lap(float *d,const float *pcm,const float *cur,
+                        const float *up,const float *down,long n);
+
+/* The overlap of the last block blockin took with the one before:
+   v->pcm[begin+i] is lapped with vb->pcm[off+i] over the window w
+   for i<n, and is vb->pcm[off+i] itself for n<=i<end-begin. */
+typedef struct {
+  vorbis_block *vb;  /* NULL once lapped into v->pcm */
+  const float  *w;
+  int           n;
+  int           begin;
+  int           end;
+  int           off;
+} vorbis_lap;
+
+/* With lazy lapping on, blockin leaves the overlap in the block for
+   the reader to lap as it converts the samples, rather than writing
+   it back to v->pcm first.  vorbis_synthesis_pcmout() and lapout()
+   still lap it in place when asked for the samples, as does reusing
+   or clearing the block, so the API behaves the same either way. */
+extern int  _vorbis_synthesis_lazy(vorbis_dsp_state *v,int flag);
+
+/* Where the samples from pos on (counting from the first not yet
+   returned) come from: pcm[c]+off, lapped with cur[c]+curoff over
+   up and down as in _vorbis_lap() if cur is not NULL.  Returns how
+   many samples that holds for, 0 past the end. */
+typedef struct {
+  float      **pcm;
+  long         off;
+  float      **cur;
+  long         curoff;
+  const float *up;
+  const float *down;
+} vorbis_lapseg;
+
+extern long _vorbis_synthesis_lapseg(vorbis_dsp_state *v,long pos,
+                                     vorbis_lapseg *s);
+
+#endif
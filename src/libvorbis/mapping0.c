@@ -26,8 +26,16 @@
 #include "window.h"
 #include "registry.h"
 #include "psy.h"
+#include "thread.h"
+#include "profile.h"
+#include "cpu.h"
 #include "misc.h"
 
+#ifdef VORBIS_SIMD_X86
+#  include <emmintrin.h>
+#  include <immintrin.h>
+#endif
+
 /* simplistic, wasteful way of doing this (unique lookup for each
    mode/submapping); there should be a central repository for
    identical lookups.  That will require minor work, so I'm putting it
@@ -703,6 +711,268 @@ static int mapping0_forward(vorbis_block *vb){
   return(0);
 }
 
+/* below this many spectral lines in a block, summed over channels,
+   handing channels to other threads costs more than it saves */
+#define PARALLEL_MIN 4096
+
+typedef struct {
+  vorbis_block         *vb;
+  vorbis_info_mapping0 *info;
+  void                **floormemo;
+} mapping0_synth;
+
+/* compute and apply the spectral envelope */
+static void mapping0_floor_channel(void *arg,int i){
+  mapping0_synth       *job=arg;
+  vorbis_block         *vb=job->vb;
+  vorbis_dsp_state     *vd=vb->vd;
+  codec_setup_info     *ci=vd->vi->codec_setup;
+  private_state        *b=vd->backend_state;
+  int                   submap=job->info->chmuxlist[i];
+  int                   floor=job->info->floorsubmap[submap];
+
+  _floor_P[ci->floor_type[floor]]->
+    inverse2(vb,b->flr[floor],job->floormemo[i],vb->pcm[i]);
+}
+
+/* transform the PCM data; takes PCM vector, vb; modifies PCM vector */
+/* only MDCT right now.... */
+static void mapping0_mdct_channel(void *arg,int i){
+  mapping0_synth       *job=arg;
+  vorbis_block         *vb=job->vb;
+  private_state        *b=vb->vd->backend_state;
+  mdct_backward(b->transform[vb->W][0],vb->pcm[i],vb->pcm[i]);
+}
+
+#ifndef VORBIS_PROFILE
+/* both of the above; nothing here writes anything shared between
+   channels */
+static void mapping0_synth_channel(void *arg,int i){
+  mapping0_floor_channel(arg,i);
+  mapping0_mdct_channel(arg,i);
+}
+#endif
+
+static void mapping0_run(private_state *b,int parallel,
+                         void (*func)(void *arg,int i),
+                         mapping0_synth *job,int n){
+  int i;
+  if(parallel)
+    _vorbis_pool_run(b->pool,func,job,n);
+  else
+    for(i=0;i<n;i++)
+      func(job,i);
+}
+
+/* replace the first b->downmix_channels spectra with the mix of all
+   of them; the rest are left for dead */
+static void mapping0_downmix(vorbis_block *vb,long n,long lines){
+  vorbis_info   *vi=vb->vd->vi;
+  private_state *b=vb->vd->backend_state;
+  int            out=b->downmix_channels;
+  float        **mix=alloca(sizeof(*mix)*out);
+  int            i,j,k;
+
+  for(i=0;i<out;i++){
+    const float *m=b->downmix+i*vi->channels;
+    /* room for the whole block, as the MDCT works in place */
+    float *d=mix[i]=_vorbis_block_alloc(vb,sizeof(*d)*n);
+    memset(d,0,sizeof(*d)*lines);
+    for(j=0;j<vi->channels;j++){
+      const float *s=vb->pcm[j];
+      float g=m[j];
+      if(g==0.f)continue;
+      for(k=0;k<lines;k++)
+        d[k]+=g*s[k];
+    }
+  }
+  for(i=0;i<out;i++)
+    vb->pcm[i]=mix[i];
+}
+
+/* Square polar decoupling.  Where ang>0 the magnitude stays and the
+   angle becomes mag-ang (mag+ang if mag<=0); otherwise the angle takes
+   the magnitude and the magnitude becomes mag+ang (mag-ang if mag<=0).
+   Flipping the sign of ang where mag>0 folds the four cases into one
+   add and one subtract, both computed for every line and selected by
+   the sign of ang; x+(-y) and x-y are the same IEEE operation, so
+   there is no branch to mispredict and the SIMD versions below give
+   the same bits as the C code.
+
+   With envM and envA set, the decoupled lines are also multiplied by
+   those floor envelopes before they are stored (see mapping0_fuse()).
+   Each returns how far it got. */
+
+#ifdef VORBIS_SIMD_X86
+
+VORBIS_TARGET_SSE2
+static long decouple_sse2(float *pcmM,float *pcmA,
+                          const float *envM,const float *envA,long n){
+  const __m128 zero=_mm_setzero_ps();
+  const __m128 sign=_mm_set1_ps(-0.f);
+  long j;
+  for(j=0;j+4<=n;j+=4){
+    __m128 mag=_mm_loadu_ps(pcmM+j);
+    __m128 ang=_mm_loadu_ps(pcmA+j);
+    __m128 t=_mm_xor_ps(ang,_mm_and_ps(_mm_cmpgt_ps(mag,zero),sign));
+    __m128 keep=_mm_cmpgt_ps(ang,zero);
+    __m128 sum=_mm_add_ps(mag,t);
+    __m128 diff=_mm_sub_ps(mag,t);
+    __m128 m=_mm_or_ps(_mm_and_ps(keep,mag),_mm_andnot_ps(keep,diff));
+    __m128 a=_mm_or_ps(_mm_and_ps(keep,sum),_mm_andnot_ps(keep,mag));
+    if(envM){
+      m=_mm_mul_ps(m,_mm_loadu_ps(envM+j));
+      a=_mm_mul_ps(a,_mm_loadu_ps(envA+j));
+    }
+    _mm_storeu_ps(pcmM+j,m);
+    _mm_storeu_ps(pcmA+j,a);
+  }
+  return j;
+}
+
+VORBIS_TARGET_AVX
+static long decouple_avx(float *pcmM,float *pcmA,
+                         const float *envM,const float *envA,long n){
+  const __m256 zero=_mm256_setzero_ps();
+  const __m256 sign=_mm256_set1_ps(-0.f);
+  long j;
+  for(j=0;j+8<=n;j+=8){
+    __m256 mag=_mm256_loadu_ps(pcmM+j);
+    __m256 ang=_mm256_loadu_ps(pcmA+j);
+    __m256 t=_mm256_xor_ps(ang,_mm256_and_ps(_mm256_cmp_ps(mag,zero,
+                                                           _CMP_GT_OQ),
+                                             sign));
+    __m256 keep=_mm256_cmp_ps(ang,zero,_CMP_GT_OQ);
+    __m256 sum=_mm256_add_ps(mag,t);
+    __m256 diff=_mm256_sub_ps(mag,t);
+    __m256 m=_mm256_blendv_ps(diff,mag,keep);
+    __m256 a=_mm256_blendv_ps(mag,sum,keep);
+    if(envM){
+      m=_mm256_mul_ps(m,_mm256_loadu_ps(envM+j));
+      a=_mm256_mul_ps(a,_mm256_loadu_ps(envA+j));
+    }
+    _mm256_storeu_ps(pcmM+j,m);
+    _mm256_storeu_ps(pcmA+j,a);
+  }
+  _mm256_zeroupper();
+  return j;
+}
+
+#endif
+
+static void decouple(float *pcmM,float *pcmA,
+                     const float *envM,const float *envA,long n){
+  long j=0;
+
+#ifdef VORBIS_SIMD_X86
+  int flags=_vorbis_cpu_flags();
+  if(flags&VORBIS_CPU_AVX)
+    j=decouple_avx(pcmM,pcmA,envM,envA,n);
+  else if(flags&VORBIS_CPU_SSE2)
+    j=decouple_sse2(pcmM,pcmA,envM,envA,n);
+#endif
+
+  for(;j<n;j++){
+    float mag=pcmM[j];
+    float ang=pcmA[j];
+    float t=mag>0?-ang:ang;
+    float sum=mag+t;
+    float diff=mag-t;
+    int   keep=ang>0;
+    float m=keep?mag:diff;
+    float a=keep?sum:mag;
+    if(envM){
+      m*=envM[j];
+      a*=envA[j];
+    }
+    pcmM[j]=m;
+    pcmA[j]=a;
+  }
+}
+
+/* undo one coupling step over n lines, in place */
+void mapping0_decouple(float *pcmM,float *pcmA,long n){
+  decouple(pcmM,pcmA,NULL,NULL,n);
+}
+
+/* Decoupling and the floors in one sweep over the spectra, FUSED_LINES
+   lines at a time so that each stretch of every channel stays in the
+   L1 cache from the first coupling step to the floor.  The envelopes
+   are rendered first, each into a vector of its own.  A channel pair
+   that no later coupling step writes has its envelopes multiplied in
+   by the decoupling loop itself; any other channel gets its envelope
+   in a loop of its own at the end of the stretch.  The multiplies are
+   the ones inverse2 would do, after all the decoupling, so the result
+   is the same bits as the passes one after another. */
+#define FUSED_LINES 256
+
+static void mapping0_fuse(vorbis_block *vb,vorbis_info_mapping0 *info,
+                          void **floormemo,long lines){
+  vorbis_info      *vi=vb->vd->vi;
+  codec_setup_info *ci=vi->codec_setup;
+  private_state    *b=vb->vd->backend_state;
+  float           **curve=alloca(sizeof(*curve)*vi->channels);
+  int              *final=alloca(sizeof(*final)*vi->channels);
+  int              *applied=alloca(sizeof(*applied)*vi->channels);
+  int              *fused=alloca(sizeof(*fused)*(info->coupling_steps+1));
+  long              c,j;
+  int               i;
+
+  for(i=0;i<vi->channels;i++){
+    int floor=info->floorsubmap[info->chmuxlist[i]];
+    const vorbis_func_floor *f=_floor_P[ci->floor_type[floor]];
+    final[i]=-1;
+    applied[i]=0;
+    curve[i]=NULL;
+    if(!floormemo[i])continue;
+    curve[i]=_vorbis_block_alloc(vb,sizeof(**curve)*lines);
+    if(f->curve)
+      f->curve(vb,b->flr[floor],floormemo[i],curve[i]);
+    else{
+      /* a floor that only knows how to apply itself */
+      for(j=0;j<lines;j++)curve[i][j]=1.f;
+      f->inverse2(vb,b->flr[floor],floormemo[i],curve[i]);
+    }
+  }
+
+  /* the steps run from the last to the first, so the first step that
+     writes a channel is the one that finishes it */
+  for(i=info->coupling_steps-1;i>=0;i--){
+    final[info->coupling_mag[i]]=i;
+    final[info->coupling_ang[i]]=i;
+  }
+  for(i=0;i<info->coupling_steps;i++){
+    int mag=info->coupling_mag[i];
+    int ang=info->coupling_ang[i];
+    fused[i]=final[mag]==i && final[ang]==i && curve[mag] && curve[ang];
+    if(fused[i])applied[mag]=applied[ang]=1;
+  }
+
+  for(c=0;c<lines;c+=FUSED_LINES){
+    long m=lines-c;
+    if(m>FUSED_LINES)m=FUSED_LINES;
+
+    for(i=info->coupling_steps-1;i>=0;i--){
+      int mag=info->coupling_mag[i];
+      int ang=info->coupling_ang[i];
+      if(fused[i])
+        decouple(vb->pcm[mag]+c,vb->pcm[ang]+c,curve[mag]+c,curve[ang]+c,m);
+      else
+        decouple(vb->pcm[mag]+c,vb->pcm[ang]+c,NULL,NULL,m);
+    }
+
+    for(i=0;i<vi->channels;i++){
+      float *p=vb->pcm[i]+c;
+      if(applied[i])continue;
+      if(curve[i]){
+        const float *e=curve[i]+c;
+        for(j=0;j<m;j++)p[j]*=e[j];
+      }else
+        memset(p,0,sizeof(*p)*m);
+    }
+  }
+}
+
 static int mapping0_inverse(vorbis_block *vb,vorbis_info_mapping *l){
   vorbis_dsp_state     *vd=vb->vd;
   vorbis_info          *vi=vd->vi;
@@ -712,12 +982,16 @@ static int mapping0_inverse(vorbis_block *vb,vorbis_info_mapping *l){
 
   int                   i,j;
   long                  n=vb->pcmend=ci->blocksizes[vb->W];
+  /* spectral lines the inverse MDCT will use; fewer than n/2 when
+     decoding at a reduced rate */
+  long                  lines=n>>(ci->halfrate_flag+1);
 
   float **pcmbundle=alloca(sizeof(*pcmbundle)*vi->channels);
   int    *zerobundle=alloca(sizeof(*zerobundle)*vi->channels);
 
   int   *nonzero  =alloca(sizeof(*nonzero)*vi->channels);
   void **floormemo=alloca(sizeof(*floormemo)*vi->channels);
+  VORBIS_CLOCK(t);
 
   /* recover the spectral envelope; store it in the PCM vector for now */
   for(i=0;i<vi->channels;i++){
@@ -730,6 +1004,7 @@ static int mapping0_inverse(vorbis_block *vb,vorbis_info_mapping *l){
       nonzero[i]=0;
     memset(vb->pcm[i],0,sizeof(*vb->pcm[i])*n/2);
   }
+  VORBIS_STAGE(&b->profile,floor_unpack,t);
 
   /* channel coupling can 'dirty' the nonzero listing */
   for(i=0;i<info->coupling_steps;i++){
@@ -757,53 +1032,92 @@ static int mapping0_inverse(vorbis_block *vb,vorbis_info_mapping *l){
       inverse(vb,b->residue[info->residuesubmap[i]],
               pcmbundle,zerobundle,ch_in_bundle);
   }
+  VORBIS_STAGE(&b->profile,residue,t);
+
+  if(b->fused){
+    mapping0_fuse(vb,info,floormemo,lines);
+    VORBIS_STAGE(&b->profile,floor,t);
+  }else{
+    /* channel coupling */
+    for(i=info->coupling_steps-1;i>=0;i--)
+      mapping0_decouple(vb->pcm[info->coupling_mag[i]],
+                        vb->pcm[info->coupling_ang[i]],lines);
+    VORBIS_STAGE(&b->profile,decouple,t);
+  }
 
-  /* channel coupling */
-  for(i=info->coupling_steps-1;i>=0;i--){
-    float *pcmM=vb->pcm[info->coupling_mag[i]];
-    float *pcmA=vb->pcm[info->coupling_ang[i]];
-
-    for(j=0;j<n/2;j++){
-      float mag=pcmM[j];
-      float ang=pcmA[j];
-
-      if(mag>0)
-        if(ang>0){
-          pcmM[j]=mag;
-          pcmA[j]=mag-ang;
-        }else{
-          pcmA[j]=mag;
-          pcmM[j]=mag+ang;
-        }
-      else
-        if(ang>0){
-          pcmM[j]=mag;
-          pcmA[j]=mag+ang;
-        }else{
-          pcmA[j]=mag;
-          pcmM[j]=mag-ang;
-        }
+  /* the rest is per channel */
+  {
+    mapping0_synth job;
+    int parallel=b->pool && vi->channels*lines>=PARALLEL_MIN;
+    job.vb=vb;
+    job.info=info;
+    job.floormemo=floormemo;
+    if(b->downmix){
+      /* the floor is applied per input channel; from there on it is
+         all linear, so mix first and transform only what is kept */
+      if(!b->fused){
+        mapping0_run(b,parallel,mapping0_floor_channel,&job,vi->channels);
+        VORBIS_STAGE(&b->profile,floor,t);
+      }
+      mapping0_downmix(vb,n,lines);
+      VORBIS_STAGE(&b->profile,downmix,t);
+      mapping0_run(b,parallel,mapping0_mdct_channel,&job,
+                   b->downmix_channels);
+      VORBIS_STAGE(&b->profile,imdct,t);
+    }else if(b->fused){
+      mapping0_run(b,parallel,mapping0_mdct_channel,&job,vi->channels);
+      VORBIS_STAGE(&b->profile,imdct,t);
+    }else{
+#ifdef VORBIS_PROFILE
+      /* the same work, one stage at a time so each can be timed */
+      mapping0_run(b,parallel,mapping0_floor_channel,&job,vi->channels);
+      VORBIS_STAGE(&b->profile,floor,t);
+      mapping0_run(b,parallel,mapping0_mdct_channel,&job,vi->channels);
+      VORBIS_STAGE(&b->profile,imdct,t);
+#else
+      mapping0_run(b,parallel,mapping0_synth_channel,&job,vi->channels);
+#endif
     }
   }
 
-  /* compute and apply spectral envelope */
+  /* all done! */
+  return(0);
+}
+
+static long mapping0_reserve(vorbis_dsp_state *vd,vorbis_info_mapping *l,
+                             long *bits){
+  vorbis_info          *vi=vd->vi;
+  codec_setup_info     *ci=vi->codec_setup;
+  private_state        *b=vd->backend_state;
+  vorbis_info_mapping0 *info=(vorbis_info_mapping0 *)l;
+  long                  bytes=0,most=0,read;
+  int                   i,j;
+
   for(i=0;i<vi->channels;i++){
-    float *pcm=vb->pcm[i];
-    int submap=info->chmuxlist[i];
-    _floor_P[ci->floor_type[info->floorsubmap[submap]]]->
-      inverse2(vb,b->flr[info->floorsubmap[submap]],
-               floormemo[i],pcm);
+    int floor=info->floorsubmap[info->chmuxlist[i]];
+    bytes+=_floor_P[ci->floor_type[floor]]->
+      reserve(vd,b->flr[floor],&read);
+    most+=read;
   }
 
-  /* transform the PCM data; takes PCM vector, vb; modifies PCM vector */
-  /* only MDCT right now.... */
-  for(i=0;i<vi->channels;i++){
-    float *pcm=vb->pcm[i];
-    mdct_backward(b->transform[vb->W][0],pcm,pcm);
+  for(i=0;i<info->submaps;i++){
+    int resnum=info->residuesubmap[i];
+    int ch_in_bundle=0;
+    for(j=0;j<vi->channels;j++)
+      if(info->chmuxlist[j]==i)ch_in_bundle++;
+    bytes+=_residue_P[ci->residue_type[resnum]]->
+      reserve(vd,b->residue[resnum],ch_in_bundle,&read);
+    most+=read;
   }
 
-  /* all done! */
-  return(0);
+  if(b->downmix)
+    bytes+=b->downmix_channels*
+      _vorbis_block_bytes(sizeof(float)*ci->blocksizes[1]);
+  /* the envelopes of the fused sweep, whether or not it is on now */
+  bytes+=vi->channels*_vorbis_block_bytes(sizeof(float)*ci->blocksizes[1]/2);
+
+  *bits=most;
+  return(bytes);
 }
 
 /* export hooks */
@@ -812,5 +1126,6 @@ const vorbis_func_mapping mapping0_exportbundle={
   &mapping0_unpack,
   &mapping0_free_info,
   &mapping0_forward,
-  &mapping0_inverse
+  &mapping0_inverse,
+  &mapping0_reserve
 };
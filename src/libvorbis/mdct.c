@@ -46,16 +46,64 @@
 #include "os.h"
 #include "misc.h"
 
+/* The butterflies below need at least 64 points.  Reduced rate decode
+   (vorbis_synthesis_rate_shift()) can shrink short blocks past that;
+   the few transforms it needs down there are done straight from the
+   definition, against a table of every cosine.  Inverse only. */
+
+static void mdct_backward_direct(mdct_lookup *init,
+                                 DATA_TYPE *in, DATA_TYPE *out){
+  int n=init->n;
+  int n2=n>>1;
+  DATA_TYPE *T=init->trig;
+  DATA_TYPE *w=alloca(sizeof(*w)*n); /* in and out may be the same */
+  int i,k;
+
+  for(i=0;i<n;i++,T+=n2){
+    REG_TYPE acc=0;
+    for(k=0;k<n2;k++)
+      acc+=MULT_NORM(in[k]*T[k]);
+    w[i]=acc;
+  }
+  memcpy(out,w,sizeof(*w)*n);
+}
+
+static void mdct_init_direct(mdct_lookup *lookup,int n){
+  int n2=n>>1;
+  DATA_TYPE *T=_ogg_malloc(sizeof(*T)*n*n2);
+  int i,k;
+
+  for(i=0;i<n;i++)
+    for(k=0;k<n2;k++)
+      T[i*n2+k]=FLOAT_CONV(cos((2*M_PI/n)*(i+.5+n/4)*(k+.5)));
+
+  lookup->n=n;
+  lookup->log2n=rint(log((float)n)/log(2.f));
+  lookup->trig=T;
+  lookup->bitrev=NULL;
+  lookup->scale=FLOAT_CONV(4.f/n);
+  lookup->backward=mdct_backward_direct;
+}
+
 /* build lookups for trig functions; also pre-figure scaling and
    some window function algebra. */
 
 void mdct_init(mdct_lookup *lookup,int n){
-  int   *bitrev=_ogg_malloc(sizeof(*bitrev)*(n/4));
-  DATA_TYPE *T=_ogg_malloc(sizeof(*T)*(n+n/4));
+  int   *bitrev;
+  DATA_TYPE *T;
 
   int i;
   int n2=n>>1;
-  int log2n=lookup->log2n=rint(log((float)n)/log(2.f));
+  int log2n;
+
+  if(n<64){
+    mdct_init_direct(lookup,n);
+    return;
+  }
+
+  bitrev=_ogg_malloc(sizeof(*bitrev)*(n/4));
+  T=_ogg_malloc(sizeof(*T)*(n+n/4));
+  log2n=lookup->log2n=rint(log((float)n)/log(2.f));
   lookup->n=n;
   lookup->trig=T;
   lookup->bitrev=bitrev;
@@ -88,6 +136,7 @@ void mdct_init(mdct_lookup *lookup,int n){
     }
   }
   lookup->scale=FLOAT_CONV(4.f/n);
+  lookup->backward=mdct_simd_backward(n);
 }
 
 /* 8 point butterfly (in place, 4 register) */
@@ -395,6 +444,14 @@ STIN void mdct_bitreverse(mdct_lookup *init,
 }
 
 void mdct_backward(mdct_lookup *init, DATA_TYPE *in, DATA_TYPE *out){
+  if(init->backward)
+    init->backward(init,in,out);
+  else
+    mdct_backward_c(init,in,out);
+}
+
+/* the portable inverse; also the reference for the SIMD versions */
+void mdct_backward_c(mdct_lookup *init, DATA_TYPE *in, DATA_TYPE *out){
   int n=init->n;
   int n2=n>>1;
   int n4=n>>2;
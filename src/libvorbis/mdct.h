@@ -53,7 +53,11 @@
 #endif
 
 
-typedef struct {
+struct mdct_lookup;
+typedef void (*mdct_func)(struct mdct_lookup *init,
+                          DATA_TYPE *in, DATA_TYPE *out);
+
+typedef struct mdct_lookup {
   int n;
   int log2n;
 
@@ -61,6 +65,10 @@ typedef struct {
   int       *bitrev;
 
   DATA_TYPE scale;
+
+  /* SIMD inverse picked by mdct_init() for this CPU and size; NULL
+     means the portable C code */
+  mdct_func backward;
 } mdct_lookup;
 
 extern void mdct_init(mdct_lookup *lookup,int n);
@@ -68,4 +76,8 @@ extern void mdct_clear(mdct_lookup *l);
 extern void mdct_forward(mdct_lookup *init, DATA_TYPE *in, DATA_TYPE *out);
 extern void mdct_backward(mdct_lookup *init, DATA_TYPE *in, DATA_TYPE *out);
 
+/* mdct_simd.c */
+extern void mdct_backward_c(mdct_lookup *init, DATA_TYPE *in, DATA_TYPE *out);
+extern mdct_func mdct_simd_backward(int n);
+
 #endif
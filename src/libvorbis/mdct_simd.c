@@ -0,0 +1,823 @@
+/********************************************************************
+ *                                                                  *
+ * THIS FILE IS PART OF THE OggVorbis SOFTWARE CODEC SOURCE CODE.   *
+ * USE, DISTRIBUTION AND REPRODUCTION OF THIS LIBRARY SOURCE IS     *
+ * GOVERNED BY A BSD-STYLE SOURCE LICENSE INCLUDED WITH THIS SOURCE *
+ * IN 'COPYING'. PLEASE READ THESE TERMS BEFORE DISTRIBUTING.       *
+ *                                                                  *
+ * THE OggVorbis SOURCE CODE IS (C) COPYRIGHT 1994-2009             *
+ * by the Xiph.Org Foundation http://www.xiph.org/                  *
+ *                                                                  *
+ ********************************************************************
+
+ function: SSE2 and AVX versions of the inverse MDCT
+
+ ********************************************************************/
+
+/* These follow mdct_backward_c() in mdct.c step for step: the same
+   rotations, butterfly stages and bitreverse, over the same trig
+   tables, with the same in-place access pattern.  Every output lane
+   is produced by the same sequence of IEEE single precision adds,
+   subtracts and multiplies as the C code (negations are done as sign
+   flips, which are exact), and no fused multiply-add is used, so the
+   result is identical to the C code compiled for SSE math.  The
+   tolerance we promise, and that the self test below checks, is the
+   looser MDCT_SIMD_TOLERANCE to leave room for a C build that keeps
+   intermediates in x87 registers or contracts to FMA.
+
+   The 32 point butterflies at the bottom are irregular, so instead of
+   vectorizing within a block, four blocks are transposed into the
+   four lanes of the vectors and run through the C code's operations
+   side by side.
+
+   mdct_simd_backward() hands out size specialized versions for the
+   256 and 2048 point transforms every stock encoder mode uses, and a
+   generic one for anything else; SIMD is not used below 64 points. */
+
+#include <stdlib.h>
+#include <string.h>
+#include <math.h>
+#include "vorbis/codec.h"
+#include "mdct.h"
+#include "cpu.h"
+#include "os.h"
+
+/* largest allowed difference between a SIMD and the C output sample,
+   relative to the largest magnitude in the C output */
+#define MDCT_SIMD_TOLERANCE 1e-6f
+
+#if defined(VORBIS_SIMD_X86) && !defined(MDCT_INTEGERIZED)
+
+#include <emmintrin.h>
+#include <immintrin.h>
+
+#define SHUF(a,b,c,d) _MM_SHUFFLE(d,c,b,a)  /* lanes in memory order */
+
+#define SSE_SIGN(a,b,c,d) \
+  _mm_castsi128_ps(_mm_set_epi32((d)?0x80000000:0,(c)?0x80000000:0, \
+                                 (b)?0x80000000:0,(a)?0x80000000:0))
+
+/* two complex pairs gathered from anywhere into one register */
+#define SSE_LOADPAIRS(lo,hi) \
+  _mm_loadh_pi(_mm_loadl_pi(_mm_setzero_ps(),(const __m64 *)(lo)), \
+               (const __m64 *)(hi))
+
+/**** SSE2 *****************************************************************/
+
+VORBIS_TARGET_SSE2
+STIN void sse_presymmetry(mdct_lookup *init,float *in,float *out,int n){
+  int n2=n>>1;
+  int n4=n>>2;
+  const __m128 s02=SSE_SIGN(1,0,1,0);
+  const __m128 s13=SSE_SIGN(0,1,0,1);
+
+  float *iX = in+n2-7;
+  float *oX = out+n2+n4;
+  float *T  = init->trig+n4;
+
+  do{
+    __m128 L0=_mm_loadu_ps(iX);
+    __m128 L1=_mm_loadu_ps(iX+4);
+    __m128 Tv=_mm_loadu_ps(T);
+    __m128 E=_mm_shuffle_ps(L0,L1,SHUF(0,2,0,2));      /* x0 x2 x4 x6 */
+    __m128 A=_mm_xor_ps(_mm_shuffle_ps(E,E,SHUF(1,0,3,2)),s02);
+    __m128 B=_mm_shuffle_ps(Tv,Tv,SHUF(3,3,1,1));
+    __m128 D=_mm_shuffle_ps(Tv,Tv,SHUF(2,2,0,0));
+    oX-=4;
+    _mm_storeu_ps(oX,_mm_sub_ps(_mm_mul_ps(A,B),_mm_mul_ps(E,D)));
+    iX-=8;
+    T+=4;
+  }while(iX>=in);
+
+  iX = in+n2-8;
+  oX = out+n2+n4;
+  T  = init->trig+n4;
+
+  do{
+    __m128 L0=_mm_loadu_ps(iX);
+    __m128 L1=_mm_loadu_ps(iX+4);
+    __m128 Tv;
+    __m128 E=_mm_shuffle_ps(L0,L1,SHUF(0,2,0,2));      /* x0 x2 x4 x6 */
+    __m128 A=_mm_shuffle_ps(E,E,SHUF(2,2,0,0));
+    __m128 C=_mm_shuffle_ps(E,E,SHUF(3,3,1,1));
+    T-=4;
+    Tv=_mm_loadu_ps(T);
+    _mm_storeu_ps(oX,
+      _mm_add_ps(_mm_mul_ps(A,_mm_shuffle_ps(Tv,Tv,SHUF(3,2,1,0))),
+                 _mm_xor_ps(_mm_mul_ps(C,_mm_shuffle_ps(Tv,Tv,SHUF(2,3,0,1))),
+                            s13)));
+    iX-=8;
+    oX+=4;
+  }while(iX>=in);
+}
+
+/* one group of four complex pairs of a generic butterfly stage; the
+   pairs at x[6],x[4],x[2],x[0] use trig t0,t1,t2,t3 */
+VORBIS_TARGET_SSE2
+STIN void sse_butterfly_step(float *x1,float *x2,
+                             const float *t0,const float *t1,
+                             const float *t2,const float *t3){
+  const __m128 s13=SSE_SIGN(0,1,0,1);
+  __m128 a0=_mm_loadu_ps(x1);
+  __m128 a1=_mm_loadu_ps(x1+4);
+  __m128 b0=_mm_loadu_ps(x2);
+  __m128 b1=_mm_loadu_ps(x2+4);
+  __m128 d0=_mm_sub_ps(a0,b0);                         /* r0 r1 r0 r1 */
+  __m128 d1=_mm_sub_ps(a1,b1);
+  __m128 T0=SSE_LOADPAIRS(t3,t2);
+  __m128 T1=SSE_LOADPAIRS(t1,t0);
+
+  _mm_storeu_ps(x1,_mm_add_ps(a0,b0));
+  _mm_storeu_ps(x1+4,_mm_add_ps(a1,b1));
+
+  _mm_storeu_ps(x2,
+    _mm_add_ps(_mm_mul_ps(_mm_shuffle_ps(d0,d0,SHUF(1,1,3,3)),
+                          _mm_shuffle_ps(T0,T0,SHUF(1,0,3,2))),
+               _mm_xor_ps(_mm_mul_ps(_mm_shuffle_ps(d0,d0,SHUF(0,0,2,2)),T0),
+                          s13)));
+  _mm_storeu_ps(x2+4,
+    _mm_add_ps(_mm_mul_ps(_mm_shuffle_ps(d1,d1,SHUF(1,1,3,3)),
+                          _mm_shuffle_ps(T1,T1,SHUF(1,0,3,2))),
+               _mm_xor_ps(_mm_mul_ps(_mm_shuffle_ps(d1,d1,SHUF(0,0,2,2)),T1),
+                          s13)));
+}
+
+VORBIS_TARGET_SSE2
+STIN void sse_butterfly_generic(float *T,float *x,int points,int trigint){
+  float *x1 = x + points      - 8;
+  float *x2 = x + (points>>1) - 8;
+
+  do{
+    sse_butterfly_step(x1,x2,T,T+trigint,T+trigint*2,T+trigint*3);
+    T+=trigint*4;
+    x1-=8;
+    x2-=8;
+  }while(x2>=x);
+}
+
+/* the 8/16/32 point butterflies of mdct.c, four blocks at a time */
+
+#define V_ADD _mm_add_ps
+#define V_SUB _mm_sub_ps
+#define V_MUL _mm_mul_ps
+
+VORBIS_TARGET_SSE2
+STIN void sse_butterfly_8(__m128 *x){
+  __m128 r0 = V_ADD(x[6],x[2]);
+  __m128 r1 = V_SUB(x[6],x[2]);
+  __m128 r2 = V_ADD(x[4],x[0]);
+  __m128 r3 = V_SUB(x[4],x[0]);
+
+  x[6] = V_ADD(r0,r2);
+  x[4] = V_SUB(r0,r2);
+
+  r0   = V_SUB(x[5],x[1]);
+  r2   = V_SUB(x[7],x[3]);
+  x[0] = V_ADD(r1,r0);
+  x[2] = V_SUB(r1,r0);
+
+  r0   = V_ADD(x[5],x[1]);
+  r1   = V_ADD(x[7],x[3]);
+  x[3] = V_ADD(r2,r3);
+  x[1] = V_SUB(r2,r3);
+  x[7] = V_ADD(r1,r0);
+  x[5] = V_SUB(r1,r0);
+}
+
+VORBIS_TARGET_SSE2
+STIN void sse_butterfly_16(__m128 *x){
+  const __m128 c2=_mm_set1_ps(cPI2_8);
+  __m128 r0 = V_SUB(x[1],x[9]);
+  __m128 r1 = V_SUB(x[0],x[8]);
+
+  x[8]  = V_ADD(x[8],x[0]);
+  x[9]  = V_ADD(x[9],x[1]);
+  x[0]  = V_MUL(V_ADD(r0,r1),c2);
+  x[1]  = V_MUL(V_SUB(r0,r1),c2);
+
+  r0    = V_SUB(x[3],x[11]);
+  r1    = V_SUB(x[10],x[2]);
+  x[10] = V_ADD(x[10],x[2]);
+  x[11] = V_ADD(x[11],x[3]);
+  x[2]  = r0;
+  x[3]  = r1;
+
+  r0    = V_SUB(x[12],x[4]);
+  r1    = V_SUB(x[13],x[5]);
+  x[12] = V_ADD(x[12],x[4]);
+  x[13] = V_ADD(x[13],x[5]);
+  x[4]  = V_MUL(V_SUB(r0,r1),c2);
+  x[5]  = V_MUL(V_ADD(r0,r1),c2);
+
+  r0    = V_SUB(x[14],x[6]);
+  r1    = V_SUB(x[15],x[7]);
+  x[14] = V_ADD(x[14],x[6]);
+  x[15] = V_ADD(x[15],x[7]);
+  x[6]  = r0;
+  x[7]  = r1;
+
+  sse_butterfly_8(x);
+  sse_butterfly_8(x+8);
+}
+
+VORBIS_TARGET_SSE2
+STIN void sse_butterfly_32(__m128 *x){
+  const __m128 c1=_mm_set1_ps(cPI1_8);
+  const __m128 c2=_mm_set1_ps(cPI2_8);
+  const __m128 c3=_mm_set1_ps(cPI3_8);
+  __m128 r0 = V_SUB(x[30],x[14]);
+  __m128 r1 = V_SUB(x[31],x[15]);
+
+  x[30] = V_ADD(x[30],x[14]);
+  x[31] = V_ADD(x[31],x[15]);
+  x[14] = r0;
+  x[15] = r1;
+
+  r0    = V_SUB(x[28],x[12]);
+  r1    = V_SUB(x[29],x[13]);
+  x[28] = V_ADD(x[28],x[12]);
+  x[29] = V_ADD(x[29],x[13]);
+  x[12] = V_SUB(V_MUL(r0,c1),V_MUL(r1,c3));
+  x[13] = V_ADD(V_MUL(r0,c3),V_MUL(r1,c1));
+
+  r0    = V_SUB(x[26],x[10]);
+  r1    = V_SUB(x[27],x[11]);
+  x[26] = V_ADD(x[26],x[10]);
+  x[27] = V_ADD(x[27],x[11]);
+  x[10] = V_MUL(V_SUB(r0,r1),c2);
+  x[11] = V_MUL(V_ADD(r0,r1),c2);
+
+  r0    = V_SUB(x[24],x[8]);
+  r1    = V_SUB(x[25],x[9]);
+  x[24] = V_ADD(x[24],x[8]);
+  x[25] = V_ADD(x[25],x[9]);
+  x[8]  = V_SUB(V_MUL(r0,c3),V_MUL(r1,c1));
+  x[9]  = V_ADD(V_MUL(r1,c3),V_MUL(r0,c1));
+
+  r0    = V_SUB(x[22],x[6]);
+  r1    = V_SUB(x[7],x[23]);
+  x[22] = V_ADD(x[22],x[6]);
+  x[23] = V_ADD(x[23],x[7]);
+  x[6]  = r1;
+  x[7]  = r0;
+
+  r0    = V_SUB(x[4],x[20]);
+  r1    = V_SUB(x[5],x[21]);
+  x[20] = V_ADD(x[20],x[4]);
+  x[21] = V_ADD(x[21],x[5]);
+  x[4]  = V_ADD(V_MUL(r1,c1),V_MUL(r0,c3));
+  x[5]  = V_SUB(V_MUL(r1,c3),V_MUL(r0,c1));
+
+  r0    = V_SUB(x[2],x[18]);
+  r1    = V_SUB(x[3],x[19]);
+  x[18] = V_ADD(x[18],x[2]);
+  x[19] = V_ADD(x[19],x[3]);
+  x[2]  = V_MUL(V_ADD(r1,r0),c2);
+  x[3]  = V_MUL(V_SUB(r1,r0),c2);
+
+  r0    = V_SUB(x[0],x[16]);
+  r1    = V_SUB(x[1],x[17]);
+  x[16] = V_ADD(x[16],x[0]);
+  x[17] = V_ADD(x[17],x[1]);
+  x[0]  = V_ADD(V_MUL(r1,c3),V_MUL(r0,c1));
+  x[1]  = V_SUB(V_MUL(r1,c1),V_MUL(r0,c3));
+
+  sse_butterfly_16(x);
+  sse_butterfly_16(x+16);
+}
+
+#undef V_ADD
+#undef V_SUB
+#undef V_MUL
+
+/* four consecutive 32 point blocks starting at x */
+VORBIS_TARGET_SSE2
+STIN void sse_butterfly_32x4(float *x){
+  __m128 v[32];
+  int i;
+
+  for(i=0;i<32;i+=4){
+    __m128 r0=_mm_loadu_ps(x+i);
+    __m128 r1=_mm_loadu_ps(x+i+32);
+    __m128 r2=_mm_loadu_ps(x+i+64);
+    __m128 r3=_mm_loadu_ps(x+i+96);
+    _MM_TRANSPOSE4_PS(r0,r1,r2,r3);
+    v[i]=r0;
+    v[i+1]=r1;
+    v[i+2]=r2;
+    v[i+3]=r3;
+  }
+
+  sse_butterfly_32(v);
+
+  for(i=0;i<32;i+=4){
+    __m128 r0=v[i];
+    __m128 r1=v[i+1];
+    __m128 r2=v[i+2];
+    __m128 r3=v[i+3];
+    _MM_TRANSPOSE4_PS(r0,r1,r2,r3);
+    _mm_storeu_ps(x+i,r0);
+    _mm_storeu_ps(x+i+32,r1);
+    _mm_storeu_ps(x+i+64,r2);
+    _mm_storeu_ps(x+i+96,r3);
+  }
+}
+
+/* a single leftover block goes through the C operations lane by lane;
+   only the 64 point transform has fewer than four blocks */
+VORBIS_TARGET_SSE2
+STIN void sse_butterfly_32x1(float *x){
+  __m128 v[32];
+  int i;
+
+  for(i=0;i<32;i++)v[i]=_mm_set_ss(x[i]);
+  sse_butterfly_32(v);
+  for(i=0;i<32;i++)_mm_store_ss(x+i,v[i]);
+}
+
+VORBIS_TARGET_SSE2
+STIN void sse_butterflies(mdct_lookup *init,float *x,int points,int log2n){
+  float *T=init->trig;
+  int stages=log2n-5;
+  int i,j;
+
+  if(--stages>0){
+    sse_butterfly_generic(T,x,points,4);
+  }
+
+  for(i=1;--stages>0;i++){
+    for(j=0;j<(1<<i);j++)
+      sse_butterfly_generic(T,x+(points>>i)*j,points>>i,4<<i);
+  }
+
+  for(j=0;j+128<=points;j+=128)
+    sse_butterfly_32x4(x+j);
+  for(;j<points;j+=32)
+    sse_butterfly_32x1(x+j);
+}
+
+VORBIS_TARGET_SSE2
+STIN void sse_bitreverse(mdct_lookup *init,float *x,int n){
+  const __m128 s02=SSE_SIGN(1,0,1,0);
+  const __m128 s13=SSE_SIGN(0,1,0,1);
+  const __m128 half=_mm_set1_ps(.5f);
+  int   *bit = init->bitrev;
+  float *w0  = x;
+  float *w1  = x = w0+(n>>1);
+  float *T   = init->trig+n;
+
+  do{
+    __m128 X0=SSE_LOADPAIRS(x+bit[0],x+bit[2]);
+    __m128 X1=SSE_LOADPAIRS(x+bit[1],x+bit[3]);
+    __m128 S=_mm_add_ps(X0,X1);
+    __m128 D=_mm_sub_ps(X0,X1);
+    __m128 Tv=_mm_loadu_ps(T);
+    /* r2 r3 of both pairs */
+    __m128 R=_mm_add_ps(
+      _mm_mul_ps(_mm_shuffle_ps(S,S,SHUF(0,0,2,2)),Tv),
+      _mm_xor_ps(_mm_mul_ps(_mm_shuffle_ps(D,D,SHUF(1,1,3,3)),
+                            _mm_shuffle_ps(Tv,Tv,SHUF(1,0,3,2))),s13));
+    /* halved r0 r1 of both pairs */
+    __m128 H=_mm_shuffle_ps(S,D,SHUF(1,3,0,2));
+    __m128 V;
+    H=_mm_mul_ps(_mm_shuffle_ps(H,H,SHUF(0,2,1,3)),half);
+
+    _mm_storeu_ps(w0,_mm_add_ps(H,R));
+    V=_mm_add_ps(_mm_xor_ps(H,s13),_mm_xor_ps(R,s02));
+    w1-=4;
+    _mm_storeu_ps(w1,_mm_shuffle_ps(V,V,SHUF(2,3,0,1)));
+
+    T   += 4;
+    bit += 4;
+    w0  += 4;
+  }while(w0<w1);
+}
+
+VORBIS_TARGET_SSE2
+STIN void sse_postsymmetry(mdct_lookup *init,float *out,int n){
+  int n2=n>>1;
+  int n4=n>>2;
+  float *oX1=out+n2+n4;
+  float *oX2=out+n2+n4;
+  float *iX =out;
+  float *T  =init->trig+n2;
+  const __m128 sign=SSE_SIGN(1,1,1,1);
+
+  do{
+    __m128 I0=_mm_loadu_ps(iX);
+    __m128 I1=_mm_loadu_ps(iX+4);
+    __m128 T0=_mm_loadu_ps(T);
+    __m128 T1=_mm_loadu_ps(T+4);
+    __m128 P0=_mm_mul_ps(I0,_mm_shuffle_ps(T0,T0,SHUF(1,0,3,2)));
+    __m128 P1=_mm_mul_ps(I1,_mm_shuffle_ps(T1,T1,SHUF(1,0,3,2)));
+    __m128 Q0=_mm_mul_ps(I0,T0);
+    __m128 Q1=_mm_mul_ps(I1,T1);
+    __m128 A=_mm_sub_ps(_mm_shuffle_ps(P0,P1,SHUF(0,2,0,2)),
+                        _mm_shuffle_ps(P0,P1,SHUF(1,3,1,3)));
+    __m128 B=_mm_add_ps(_mm_shuffle_ps(Q0,Q1,SHUF(0,2,0,2)),
+                        _mm_shuffle_ps(Q0,Q1,SHUF(1,3,1,3)));
+    oX1-=4;
+    _mm_storeu_ps(oX1,_mm_shuffle_ps(A,A,SHUF(3,2,1,0)));
+    _mm_storeu_ps(oX2,_mm_xor_ps(B,sign));
+    oX2+=4;
+    iX+=8;
+    T+=8;
+  }while(iX<oX1);
+
+  iX=out+n2+n4;
+  oX1=out+n4;
+  oX2=oX1;
+
+  do{
+    __m128 v;
+    oX1-=4;
+    iX-=4;
+    v=_mm_loadu_ps(iX);
+    _mm_storeu_ps(oX1,v);
+    _mm_storeu_ps(oX2,_mm_xor_ps(_mm_shuffle_ps(v,v,SHUF(3,2,1,0)),sign));
+    oX2+=4;
+  }while(oX2<iX);
+
+  iX=out+n2+n4;
+  oX1=out+n2+n4;
+  oX2=out+n2;
+  do{
+    __m128 v=_mm_loadu_ps(iX);
+    oX1-=4;
+    _mm_storeu_ps(oX1,_mm_shuffle_ps(v,v,SHUF(3,2,1,0)));
+    iX+=4;
+  }while(oX1>oX2);
+}
+
+VORBIS_TARGET_SSE2
+STIN void sse_backward(mdct_lookup *init,float *in,float *out,
+                       int n,int log2n){
+  sse_presymmetry(init,in,out,n);
+  sse_butterflies(init,out+(n>>1),n>>1,log2n);
+  sse_bitreverse(init,out,n);
+  sse_postsymmetry(init,out,n);
+}
+
+VORBIS_TARGET_SSE2
+static void mdct_backward_sse2(mdct_lookup *init,float *in,float *out){
+  sse_backward(init,in,out,init->n,init->log2n);
+}
+
+VORBIS_TARGET_SSE2
+static void mdct_backward_sse2_256(mdct_lookup *init,float *in,float *out){
+  sse_backward(init,in,out,256,8);
+}
+
+VORBIS_TARGET_SSE2
+static void mdct_backward_sse2_2048(mdct_lookup *init,float *in,float *out){
+  sse_backward(init,in,out,2048,11);
+}
+
+/**** AVX ******************************************************************/
+
+/* The AVX versions run two iterations of each SSE loop per register,
+   one in each 128 bit lane; the 32 point blocks stay with SSE. */
+
+#define AVX_SIGN(a,b,c,d) \
+  _mm256_castsi256_ps(_mm256_set_epi32((d)?0x80000000:0,(c)?0x80000000:0, \
+                                       (b)?0x80000000:0,(a)?0x80000000:0, \
+                                       (d)?0x80000000:0,(c)?0x80000000:0, \
+                                       (b)?0x80000000:0,(a)?0x80000000:0))
+
+/* lo into the low lane, hi into the high lane */
+#define AVX_JOIN(lo,hi) \
+  _mm256_insertf128_ps(_mm256_castps128_ps256(lo),(hi),1)
+
+VORBIS_TARGET_AVX
+STIN void avx_presymmetry(mdct_lookup *init,float *in,float *out,int n){
+  int n2=n>>1;
+  int n4=n>>2;
+  const __m256 s02=AVX_SIGN(1,0,1,0);
+  const __m256 s13=AVX_SIGN(0,1,0,1);
+
+  float *iX = in+n2-7;
+  float *oX = out+n2+n4;
+  float *T  = init->trig+n4;
+
+  /* low lane: iteration at iX-8, high lane: iteration at iX */
+  do{
+    __m256 a=_mm256_loadu_ps(iX-8);
+    __m256 b=_mm256_loadu_ps(iX);
+    __m256 L0=_mm256_permute2f128_ps(a,b,0x20);
+    __m256 L1=_mm256_permute2f128_ps(a,b,0x31);
+    __m256 t=_mm256_loadu_ps(T);
+    __m256 Tv=_mm256_permute2f128_ps(t,t,0x01);
+    __m256 E=_mm256_shuffle_ps(L0,L1,SHUF(0,2,0,2));
+    __m256 A=_mm256_xor_ps(_mm256_shuffle_ps(E,E,SHUF(1,0,3,2)),s02);
+    __m256 B=_mm256_shuffle_ps(Tv,Tv,SHUF(3,3,1,1));
+    __m256 D=_mm256_shuffle_ps(Tv,Tv,SHUF(2,2,0,0));
+    oX-=8;
+    _mm256_storeu_ps(oX,_mm256_sub_ps(_mm256_mul_ps(A,B),_mm256_mul_ps(E,D)));
+    iX-=16;
+    T+=8;
+  }while(iX>=in);
+
+  iX = in+n2-8;
+  oX = out+n2+n4;
+  T  = init->trig+n4;
+
+  /* low lane: iteration at iX, high lane: iteration at iX-8 */
+  do{
+    __m256 a=_mm256_loadu_ps(iX);
+    __m256 b=_mm256_loadu_ps(iX-8);
+    __m256 L0=_mm256_permute2f128_ps(a,b,0x20);
+    __m256 L1=_mm256_permute2f128_ps(a,b,0x31);
+    __m256 E=_mm256_shuffle_ps(L0,L1,SHUF(0,2,0,2));
+    __m256 A=_mm256_shuffle_ps(E,E,SHUF(2,2,0,0));
+    __m256 C=_mm256_shuffle_ps(E,E,SHUF(3,3,1,1));
+    __m256 t,Tv;
+    T-=8;
+    t=_mm256_loadu_ps(T);
+    Tv=_mm256_permute2f128_ps(t,t,0x01);
+    _mm256_storeu_ps(oX,
+      _mm256_add_ps(
+        _mm256_mul_ps(A,_mm256_shuffle_ps(Tv,Tv,SHUF(3,2,1,0))),
+        _mm256_xor_ps(_mm256_mul_ps(C,_mm256_shuffle_ps(Tv,Tv,SHUF(2,3,0,1))),
+                      s13)));
+    iX-=16;
+    oX+=8;
+  }while(iX>=in);
+}
+
+VORBIS_TARGET_AVX
+STIN void avx_butterfly_generic(float *T,float *x,int points,int trigint){
+  const __m256 s13=AVX_SIGN(0,1,0,1);
+  float *x1 = x + points      - 8;
+  float *x2 = x + (points>>1) - 8;
+
+  do{
+    __m256 a=_mm256_loadu_ps(x1);
+    __m256 b=_mm256_loadu_ps(x2);
+    __m256 d=_mm256_sub_ps(a,b);
+    __m256 Tv=AVX_JOIN(SSE_LOADPAIRS(T+trigint*3,T+trigint*2),
+                       SSE_LOADPAIRS(T+trigint,T));
+
+    _mm256_storeu_ps(x1,_mm256_add_ps(a,b));
+    _mm256_storeu_ps(x2,
+      _mm256_add_ps(
+        _mm256_mul_ps(_mm256_shuffle_ps(d,d,SHUF(1,1,3,3)),
+                      _mm256_shuffle_ps(Tv,Tv,SHUF(1,0,3,2))),
+        _mm256_xor_ps(_mm256_mul_ps(_mm256_shuffle_ps(d,d,SHUF(0,0,2,2)),Tv),
+                      s13)));
+
+    T+=trigint*4;
+    x1-=8;
+    x2-=8;
+  }while(x2>=x);
+}
+
+VORBIS_TARGET_AVX
+STIN void avx_butterflies(mdct_lookup *init,float *x,int points,int log2n){
+  float *T=init->trig;
+  int stages=log2n-5;
+  int i,j;
+
+  if(--stages>0){
+    avx_butterfly_generic(T,x,points,4);
+  }
+
+  for(i=1;--stages>0;i++){
+    for(j=0;j<(1<<i);j++)
+      avx_butterfly_generic(T,x+(points>>i)*j,points>>i,4<<i);
+  }
+
+  for(j=0;j+128<=points;j+=128)
+    sse_butterfly_32x4(x+j);
+  for(;j<points;j+=32)
+    sse_butterfly_32x1(x+j);
+}
+
+VORBIS_TARGET_AVX
+STIN void avx_bitreverse(mdct_lookup *init,float *x,int n){
+  const __m256 s02=AVX_SIGN(1,0,1,0);
+  const __m256 s13=AVX_SIGN(0,1,0,1);
+  const __m256 half=_mm256_set1_ps(.5f);
+  int   *bit = init->bitrev;
+  float *w0  = x;
+  float *w1  = x = w0+(n>>1);
+  float *T   = init->trig+n;
+
+  /* low lane: this iteration, high lane: the next one */
+  do{
+    __m256 X0=AVX_JOIN(SSE_LOADPAIRS(x+bit[0],x+bit[2]),
+                       SSE_LOADPAIRS(x+bit[4],x+bit[6]));
+    __m256 X1=AVX_JOIN(SSE_LOADPAIRS(x+bit[1],x+bit[3]),
+                       SSE_LOADPAIRS(x+bit[5],x+bit[7]));
+    __m256 S=_mm256_add_ps(X0,X1);
+    __m256 D=_mm256_sub_ps(X0,X1);
+    __m256 Tv=_mm256_loadu_ps(T);
+    __m256 R=_mm256_add_ps(
+      _mm256_mul_ps(_mm256_shuffle_ps(S,S,SHUF(0,0,2,2)),Tv),
+      _mm256_xor_ps(_mm256_mul_ps(_mm256_shuffle_ps(D,D,SHUF(1,1,3,3)),
+                                  _mm256_shuffle_ps(Tv,Tv,SHUF(1,0,3,2))),
+                    s13));
+    __m256 H=_mm256_shuffle_ps(S,D,SHUF(1,3,0,2));
+    __m256 V;
+    H=_mm256_mul_ps(_mm256_shuffle_ps(H,H,SHUF(0,2,1,3)),half);
+
+    _mm256_storeu_ps(w0,_mm256_add_ps(H,R));
+    V=_mm256_add_ps(_mm256_xor_ps(H,s13),_mm256_xor_ps(R,s02));
+    V=_mm256_shuffle_ps(V,V,SHUF(2,3,0,1));
+    w1-=8;
+    _mm256_storeu_ps(w1,_mm256_permute2f128_ps(V,V,0x01));
+
+    T   += 8;
+    bit += 8;
+    w0  += 8;
+  }while(w0<w1);
+}
+
+VORBIS_TARGET_AVX
+STIN void avx_postsymmetry(mdct_lookup *init,float *out,int n){
+  int n2=n>>1;
+  int n4=n>>2;
+  float *oX1=out+n2+n4;
+  float *oX2=out+n2+n4;
+  float *iX =out;
+  float *T  =init->trig+n2;
+  const __m256 sign=AVX_SIGN(1,1,1,1);
+
+  /* two iterations per pass; lanes hold this one and the next */
+  do{
+    __m256 I0=_mm256_loadu_ps(iX);
+    __m256 I1=_mm256_loadu_ps(iX+8);
+    __m256 T0=_mm256_loadu_ps(T);
+    __m256 T1=_mm256_loadu_ps(T+8);
+    __m256 J0=_mm256_permute2f128_ps(I0,I1,0x20);
+    __m256 J1=_mm256_permute2f128_ps(I0,I1,0x31);
+    __m256 U0=_mm256_permute2f128_ps(T0,T1,0x20);
+    __m256 U1=_mm256_permute2f128_ps(T0,T1,0x31);
+    __m256 P0=_mm256_mul_ps(J0,_mm256_shuffle_ps(U0,U0,SHUF(1,0,3,2)));
+    __m256 P1=_mm256_mul_ps(J1,_mm256_shuffle_ps(U1,U1,SHUF(1,0,3,2)));
+    __m256 Q0=_mm256_mul_ps(J0,U0);
+    __m256 Q1=_mm256_mul_ps(J1,U1);
+    __m256 A=_mm256_sub_ps(_mm256_shuffle_ps(P0,P1,SHUF(0,2,0,2)),
+                           _mm256_shuffle_ps(P0,P1,SHUF(1,3,1,3)));
+    __m256 B=_mm256_add_ps(_mm256_shuffle_ps(Q0,Q1,SHUF(0,2,0,2)),
+                           _mm256_shuffle_ps(Q0,Q1,SHUF(1,3,1,3)));
+    A=_mm256_shuffle_ps(A,A,SHUF(3,2,1,0));
+    oX1-=8;
+    _mm256_storeu_ps(oX1,_mm256_permute2f128_ps(A,A,0x01));
+    _mm256_storeu_ps(oX2,_mm256_xor_ps(B,sign));
+    oX2+=8;
+    iX+=16;
+    T+=16;
+  }while(iX<oX1);
+
+  iX=out+n2+n4;
+  oX1=out+n4;
+  oX2=oX1;
+
+  do{
+    __m256 v;
+    oX1-=8;
+    iX-=8;
+    v=_mm256_loadu_ps(iX);
+    _mm256_storeu_ps(oX1,v);
+    v=_mm256_shuffle_ps(v,v,SHUF(3,2,1,0));
+    _mm256_storeu_ps(oX2,_mm256_xor_ps(_mm256_permute2f128_ps(v,v,0x01),sign));
+    oX2+=8;
+  }while(oX2<iX);
+
+  iX=out+n2+n4;
+  oX1=out+n2+n4;
+  oX2=out+n2;
+  do{
+    __m256 v=_mm256_loadu_ps(iX);
+    v=_mm256_shuffle_ps(v,v,SHUF(3,2,1,0));
+    oX1-=8;
+    _mm256_storeu_ps(oX1,_mm256_permute2f128_ps(v,v,0x01));
+    iX+=8;
+  }while(oX1>oX2);
+}
+
+VORBIS_TARGET_AVX
+STIN void avx_backward(mdct_lookup *init,float *in,float *out,
+                       int n,int log2n){
+  avx_presymmetry(init,in,out,n);
+  avx_butterflies(init,out+(n>>1),n>>1,log2n);
+  avx_bitreverse(init,out,n);
+  avx_postsymmetry(init,out,n);
+  _mm256_zeroupper();
+}
+
+VORBIS_TARGET_AVX
+static void mdct_backward_avx(mdct_lookup *init,float *in,float *out){
+  avx_backward(init,in,out,init->n,init->log2n);
+}
+
+VORBIS_TARGET_AVX
+static void mdct_backward_avx_256(mdct_lookup *init,float *in,float *out){
+  avx_backward(init,in,out,256,8);
+}
+
+VORBIS_TARGET_AVX
+static void mdct_backward_avx_2048(mdct_lookup *init,float *in,float *out){
+  avx_backward(init,in,out,2048,11);
+}
+
+mdct_func mdct_simd_backward(int n){
+  int flags=_vorbis_cpu_flags();
+
+  /* the loops above assume at least two iterations per pass */
+  if(n<64)return NULL;
+
+  if(flags&VORBIS_CPU_AVX){
+    if(n==256)return mdct_backward_avx_256;
+    if(n==2048)return mdct_backward_avx_2048;
+    return mdct_backward_avx;
+  }
+  if(flags&VORBIS_CPU_SSE2){
+    if(n==256)return mdct_backward_sse2_256;
+    if(n==2048)return mdct_backward_sse2_2048;
+    return mdct_backward_sse2;
+  }
+  return NULL;
+}
+
+#else
+
+mdct_func mdct_simd_backward(int n){
+  (void)n;
+  return NULL;
+}
+
+#endif
+
+#ifdef _V_SELFTEST
+
+/* Compare every SIMD inverse this CPU supports against the C code for
+   all the blocksizes Vorbis allows. */
+
+#include <stdio.h>
+
+static int check(const char *name,mdct_func f,int n){
+  mdct_lookup m;
+  float *in=malloc(n*sizeof(*in));
+  float *ref=malloc(n*sizeof(*ref));
+  float *out=malloc(n*sizeof(*out));
+  float max=0.f,err=0.f;
+  int i,trial,exact=1;
+
+  mdct_init(&m,n);
+  srand(n);
+  for(trial=0;trial<16;trial++){
+    for(i=0;i<n;i++)
+      in[i]=(rand()/(float)RAND_MAX-.5f)*(trial&1?1.f:32768.f);
+
+    /* out of place, then in place as mapping0 uses it */
+    mdct_backward_c(&m,in,ref);
+    f(&m,in,out);
+    for(i=0;i<n;i++){
+      float d=fabs(out[i]-ref[i]);
+      if(fabs(ref[i])>max)max=fabs(ref[i]);
+      if(d>err)err=d;
+      if(out[i]!=ref[i])exact=0;
+    }
+    memcpy(out,in,n*sizeof(*out));
+    f(&m,out,out);
+    for(i=0;i<n;i++){
+      float d=fabs(out[i]-ref[i]);
+      if(d>err)err=d;
+      if(out[i]!=ref[i])exact=0;
+    }
+  }
+  mdct_clear(&m);
+  free(in);
+  free(ref);
+  free(out);
+
+  fprintf(stderr,"%s n=%d: max error %g%s\n",name,n,err,
+          exact?" (bit exact)":"");
+  return err>MDCT_SIMD_TOLERANCE*max;
+}
+
+int main(void){
+  int n,ret=0;
+
+  for(n=64;n<=8192;n<<=1){
+#if defined(VORBIS_SIMD_X86) && !defined(MDCT_INTEGERIZED)
+    int flags=_vorbis_cpu_flags();
+    if(flags&VORBIS_CPU_SSE2){
+      ret|=check("SSE2",mdct_backward_sse2,n);
+      if(n==256)ret|=check("SSE2/256",mdct_backward_sse2_256,n);
+      if(n==2048)ret|=check("SSE2/2048",mdct_backward_sse2_2048,n);
+    }
+    if(flags&VORBIS_CPU_AVX){
+      ret|=check("AVX",mdct_backward_avx,n);
+      if(n==256)ret|=check("AVX/256",mdct_backward_avx_256,n);
+      if(n==2048)ret|=check("AVX/2048",mdct_backward_avx_2048,n);
+    }
+#endif
+    ret|=check("dispatch",mdct_backward,n);
+  }
+  if(ret)fprintf(stderr,"FAILED: error above tolerance\n");
+  return ret;
+}
+
+#endif
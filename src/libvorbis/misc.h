@@ -19,8 +19,17 @@
 #define _V_RANDOM_H_
 #include "vorbis/codec.h"
 
+#ifndef WORD_ALIGN
+#define WORD_ALIGN 8
+#endif
+
+/* what _vorbis_block_alloc(vb,bytes) takes from the block's storage */
+#define _vorbis_block_bytes(bytes) \
+  (((bytes)+(WORD_ALIGN-1)) & ~(long)(WORD_ALIGN-1))
+
 extern void *_vorbis_block_alloc(vorbis_block *vb,long bytes);
 extern void _vorbis_block_ripcord(vorbis_block *vb);
+extern int _vorbis_block_reserve(vorbis_block *vb,long bytes);
 
 #ifdef ANALYSIS
 extern int analysis_noisy;
@@ -0,0 +1,43 @@
+/********************************************************************
+ *                                                                  *
+ * THIS FILE IS PART OF THE OggVorbis SOFTWARE CODEC SOURCE CODE.   *
+ * USE, DISTRIBUTION AND REPRODUCTION OF THIS LIBRARY SOURCE IS     *
+ * GOVERNED BY A BSD-STYLE SOURCE LICENSE INCLUDED WITH THIS SOURCE *
+ * IN 'COPYING'. PLEASE READ THESE TERMS BEFORE DISTRIBUTING.       *
+ *                                                                  *
+ * THE OggVorbis SOURCE CODE IS (C) COPYRIGHT 1994-2009             *
+ * by the Xiph.Org Foundation http://www.xiph.org/                  *
+ *                                                                  *
+ ********************************************************************
+
+ function: optional per stage decode timing
+
+ ********************************************************************/
+
+#ifndef _V_PROFILE_H_
+#define _V_PROFILE_H_
+
+#include "vorbis/codec.h"
+
+/* Stage timing is only compiled in with VORBIS_PROFILE defined, for
+   all of the libraries alike; otherwise the macros cost nothing.
+
+   VORBIS_CLOCK(t) declares t and sets it to the time now, in ns.
+   VORBIS_STAGE(p,s,t) adds the time since t
+   and one call to stage s of the vorbis_profile or ov_profile *p, and
+   moves t on to now so stages can follow one another. */
+#ifdef VORBIS_PROFILE
+extern ogg_int64_t _vorbis_clock(void);
+#  define VORBIS_CLOCK(t)     ogg_int64_t t=_vorbis_clock()
+#  define VORBIS_STAGE(p,s,t) do{                   \
+    ogg_int64_t _now=_vorbis_clock();               \
+    (p)->s.ns+=_now-(t);                            \
+    (p)->s.calls++;                                 \
+    (t)=_now;                                       \
+  }while(0)
+#else
+#  define VORBIS_CLOCK(t)     int t=0
+#  define VORBIS_STAGE(p,s,t) ((void)(t))
+#endif
+
+#endif
@@ -50,6 +50,11 @@ typedef struct {
   int         partvals;
   int       **decodemap;
 
+  /* for res2_inverse() when partitions are whole book entries (see
+     res0_look): the stage books of each partition word, stage major,
+     NULL where a partition is not coded in that stage */
+  codebook  **wordbooks;
+
   long      postbits;
   long      phrasebits;
   long      frames;
@@ -146,6 +151,7 @@ void res0_free_look(vorbis_look_residue *i){
     for(j=0;j<look->partvals;j++)
       _ogg_free(look->decodemap[j]);
     _ogg_free(look->decodemap);
+    if(look->wordbooks)_ogg_free(look->wordbooks);
 
     memset(look,0,sizeof(*look));
     _ogg_free(look);
@@ -316,6 +322,38 @@ vorbis_look_residue *res0_look(vorbis_dsp_state *vd,
       look->decodemap[j][k]=deco;
     }
   }
+
+  /* Consecutive partitions read with the same book can then be read
+     in one go, as long as each covers a whole number of book entries
+     (so the entries split the same either way) and of frames (checked
+     in res2_inverse, as it depends on the channels in the vector).
+     Not for huge partition books, where the table would not pay. */
+  {
+    int ok=maxstage>0 && look->partvals<=65536/maxstage/dim;
+    for(j=0;ok && j<look->parts;j++)
+      for(k=0;k<maxstage;k++)
+        if(info->secondstages[j]&(1<<k)){
+          codebook *b=look->partbooks[j][k];
+          if(b->dim<1 || info->grouping%b->dim)ok=0;
+        }
+    if(ok)
+      look->wordbooks=_ogg_calloc(look->partvals*maxstage*dim,
+                                  sizeof(*look->wordbooks));
+    if(look->wordbooks){
+      for(j=0;j<look->partvals;j++)
+        for(k=0;k<maxstage;k++){
+          int l;
+          for(l=0;l<dim;l++){
+            int part=look->decodemap[j][l];
+            if(info->secondstages[part]&(1<<k)){
+              codebook *b=look->partbooks[part][k];
+              if(b->used_entries>0)
+                look->wordbooks[(j*maxstage+k)*dim+l]=b;
+            }
+          }
+        }
+    }
+  }
 #if defined(TRAIN_RES) || defined (TRAIN_RESAUX)
   {
     static int train_seq=0;
@@ -656,7 +694,7 @@ static int _01forward(oggpack_buffer *opb,
 static int _01inverse(vorbis_block *vb,vorbis_look_residue *vl,
                       float **in,int ch,
                       long (*decodepart)(codebook *, float *,
-                                         oggpack_buffer *,int)){
+                                         oggpack_cache *,int)){
 
   long i,j,k,l,s;
   vorbis_look_residue0 *look=(vorbis_look_residue0 *)vl;
@@ -668,6 +706,9 @@ static int _01inverse(vorbis_block *vb,vorbis_look_residue *vl,
   int max=vb->pcmend>>1;
   int end=(info->end<max?info->end:max);
   int n=end-info->begin;
+  oggpack_cache opc;
+
+  oggpack_cache_init(&opc,&vb->opb);
 
   if(n>0){
     int partvals=n/samples_per_partition;
@@ -685,7 +726,7 @@ static int _01inverse(vorbis_block *vb,vorbis_look_residue *vl,
         if(s==0){
           /* fetch the partition word for each channel */
           for(j=0;j<ch;j++){
-            int temp=vorbis_book_decode(look->phrasebook,&vb->opb);
+            int temp=vorbis_book_decode(look->phrasebook,&opc);
 
             if(temp==-1 || temp>=info->partvals)goto eopbreak;
             partword[j][l]=look->decodemap[temp];
@@ -700,7 +741,7 @@ static int _01inverse(vorbis_block *vb,vorbis_look_residue *vl,
             if(info->secondstages[partword[j][l][k]]&(1<<s)){
               codebook *stagebook=look->partbooks[partword[j][l][k]][s];
               if(stagebook){
-                if(decodepart(stagebook,in[j]+offset,&vb->opb,
+                if(decodepart(stagebook,in[j]+offset,&opc,
                               samples_per_partition)==-1)goto eopbreak;
               }
             }
@@ -710,6 +751,7 @@ static int _01inverse(vorbis_block *vb,vorbis_look_residue *vl,
   }
  errout:
  eopbreak:
+  oggpack_cache_sync(&opc);
   return(0);
 }
 
@@ -811,6 +853,59 @@ int res2_forward(oggpack_buffer *opb,
   }
 }
 
+/* reads partitions from up to to, if they are coded with a book */
+static long _2run(vorbis_look_residue0 *look,codebook *book,float **in,
+                  int ch,long from,long to,oggpack_cache *opc){
+  vorbis_info_residue0 *info=look->info;
+  if(!book || from==to)return(0);
+  return(vorbis_book_decodevv_add(book,in,
+                                  from*info->grouping+info->begin,ch,opc,
+                                  (int)(to-from)*info->grouping));
+}
+
+/* res2_inverse() with res0_look()'s wordbooks: the partition word
+   gives each partition's book directly, and a run of partitions read
+   with the same book is read by one call.  The values go through the
+   same adds in the same order, so the result is the same. */
+static void _2inverse_runs(vorbis_block *vb,vorbis_look_residue0 *look,
+                           float **in,int ch,int partvals,
+                           oggpack_cache *opc){
+  vorbis_info_residue0 *info=look->info;
+  int partitions_per_word=look->phrasebook->dim;
+  int stride=look->stages*partitions_per_word;
+  int partwords=(partvals+partitions_per_word-1)/partitions_per_word;
+  codebook ***partword=_vorbis_block_alloc(vb,partwords*sizeof(*partword));
+  long i,k,l,s;
+
+  for(s=0;s<look->stages;s++){
+    codebook *run=NULL; /* the book of partitions from up to i */
+    long from=0;
+
+    for(i=0,l=0;i<partvals;l++){
+      if(s==0){
+        /* the partition word comes between runs */
+        int temp;
+        if(_2run(look,run,in,ch,from,i,opc)==-1)return;
+        run=NULL;
+
+        temp=vorbis_book_decode(look->phrasebook,opc);
+        if(temp==-1 || temp>=info->partvals)return;
+        partword[l]=look->wordbooks+temp*stride;
+      }
+
+      for(k=0;k<partitions_per_word && i<partvals;k++,i++){
+        codebook *book=partword[l][s*partitions_per_word+k];
+        if(book!=run){
+          if(_2run(look,run,in,ch,from,i,opc)==-1)return;
+          run=book;
+          from=i;
+        }
+      }
+    }
+    if(_2run(look,run,in,ch,from,i,opc)==-1)return;
+  }
+}
+
 /* duplicate code here as speed is somewhat more important */
 int res2_inverse(vorbis_block *vb,vorbis_look_residue *vl,
                  float **in,int *nonzero,int ch){
@@ -824,21 +919,31 @@ int res2_inverse(vorbis_block *vb,vorbis_look_residue *vl,
   int max=(vb->pcmend*ch)>>1;
   int end=(info->end<max?info->end:max);
   int n=end-info->begin;
+  oggpack_cache opc;
+
+  oggpack_cache_init(&opc,&vb->opb);
 
   if(n>0){
     int partvals=n/samples_per_partition;
     int partwords=(partvals+partitions_per_word-1)/partitions_per_word;
-    int **partword=_vorbis_block_alloc(vb,partwords*sizeof(*partword));
+    int **partword;
 
     for(i=0;i<ch;i++)if(nonzero[i])break;
     if(i==ch)return(0); /* no nonzero vectors */
 
+    if(look->wordbooks &&
+       info->begin%ch==0 && info->grouping%ch==0){
+      _2inverse_runs(vb,look,in,ch,partvals,&opc);
+      goto eopbreak;
+    }
+
+    partword=_vorbis_block_alloc(vb,partwords*sizeof(*partword));
     for(s=0;s<look->stages;s++){
       for(i=0,l=0;i<partvals;l++){
 
         if(s==0){
           /* fetch the partition word */
-          int temp=vorbis_book_decode(look->phrasebook,&vb->opb);
+          int temp=vorbis_book_decode(look->phrasebook,&opc);
           if(temp==-1 || temp>=info->partvals)goto eopbreak;
           partword[l]=look->decodemap[temp];
           if(partword[l]==NULL)goto errout;
@@ -852,7 +957,7 @@ int res2_inverse(vorbis_block *vb,vorbis_look_residue *vl,
             if(stagebook){
               if(vorbis_book_decodevv_add(stagebook,in,
                                           i*samples_per_partition+info->begin,ch,
-                                          &vb->opb,samples_per_partition)==-1)
+                                          &opc,samples_per_partition)==-1)
                 goto eopbreak;
             }
           }
@@ -861,9 +966,54 @@ int res2_inverse(vorbis_block *vb,vorbis_look_residue *vl,
   }
  errout:
  eopbreak:
+  oggpack_cache_sync(&opc);
   return(0);
 }
 
+/* the worst case of _01inverse/res2_inverse over values vectors of n
+   each: block storage for the partition words, and the packet bits
+   read, as though every partition used the costliest class */
+static long _reserve(vorbis_look_residue0 *look,long n,int vectors,
+                     long *bits){
+  vorbis_info_residue0 *info=look->info;
+  int samples_per_partition=info->grouping;
+  int partitions_per_word=look->phrasebook->dim;
+  int end=(info->end<n?info->end:n);
+  long partvals,partwords,worst=0;
+  int j,s;
+
+  *bits=0;
+  if(vectors<1 || end-info->begin<=0)return(0);
+  partvals=(end-info->begin)/samples_per_partition;
+  partwords=(partvals+partitions_per_word-1)/partitions_per_word;
+
+  for(j=0;j<look->parts;j++){
+    long sum=0;
+    for(s=0;s<look->stages;s++)
+      if(info->secondstages[j]&(1<<s)){
+        codebook *b=look->partbooks[j][s];
+        sum+=(samples_per_partition+b->dim-1)/b->dim*b->dec_maxlength;
+      }
+    if(sum>worst)worst=sum;
+  }
+
+  *bits=vectors*(partwords*look->phrasebook->dec_maxlength+
+                 partvals*worst);
+  return(vectors*_vorbis_block_bytes(partwords*sizeof(int *)));
+}
+
+long res0_reserve(vorbis_dsp_state *vd,vorbis_look_residue *vl,
+                  int ch,long *bits){
+  codec_setup_info *ci=vd->vi->codec_setup;
+  return(_reserve((vorbis_look_residue0 *)vl,ci->blocksizes[1]/2,ch,bits));
+}
+
+long res2_reserve(vorbis_dsp_state *vd,vorbis_look_residue *vl,
+                  int ch,long *bits){
+  codec_setup_info *ci=vd->vi->codec_setup;
+  return(_reserve((vorbis_look_residue0 *)vl,ci->blocksizes[1]*ch/2,
+                  ch>0,bits));
+}
 
 const vorbis_func_residue residue0_exportbundle={
   NULL,
@@ -873,7 +1023,8 @@ const vorbis_func_residue residue0_exportbundle={
   &res0_free_look,
   NULL,
   NULL,
-  &res0_inverse
+  &res0_inverse,
+  &res0_reserve
 };
 
 const vorbis_func_residue residue1_exportbundle={
@@ -884,7 +1035,8 @@ const vorbis_func_residue residue1_exportbundle={
   &res0_free_look,
   &res1_class,
   &res1_forward,
-  &res1_inverse
+  &res1_inverse,
+  &res0_reserve
 };
 
 const vorbis_func_residue residue2_exportbundle={
@@ -895,5 +1047,6 @@ const vorbis_func_residue residue2_exportbundle={
   &res0_free_look,
   &res2_class,
   &res2_forward,
-  &res2_inverse
+  &res2_inverse,
+  &res2_reserve
 };
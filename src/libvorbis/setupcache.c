@@ -0,0 +1,268 @@
+/********************************************************************
+ *                                                                  *
+ * THIS FILE IS PART OF THE OggVorbis SOFTWARE CODEC SOURCE CODE.   *
+ * USE, DISTRIBUTION AND REPRODUCTION OF THIS LIBRARY SOURCE IS     *
+ * GOVERNED BY A BSD-STYLE SOURCE LICENSE INCLUDED WITH THIS SOURCE *
+ * IN 'COPYING'. PLEASE READ THESE TERMS BEFORE DISTRIBUTING.       *
+ *                                                                  *
+ * THE OggVorbis SOURCE CODE IS (C) COPYRIGHT 1994-2009             *
+ * by the Xiph.Org Foundation http://www.xiph.org/                  *
+ *                                                                  *
+ ********************************************************************
+
+ function: process wide cache of decoded setup headers
+
+ Streams from the same encoder configuration carry byte-identical
+ setup headers.  With the cache on, the first decoder to see a setup
+ header unpacks it, builds the decode codebooks and the floor1 and
+ residue look tables, and leaves them here; later decoders given the
+ same packet (for the same channel count) point at those instead of
+ building their own.  Everything shared is read-only while decoding.
+
+ ********************************************************************/
+
+#include <stdlib.h>
+#include <string.h>
+#include <ogg/ogg.h>
+#include "vorbis/codec.h"
+#include "codec_internal.h"
+#include "registry.h"
+#include "setupcache.h"
+#include "thread.h"
+#include "os.h"
+
+struct vorbis_shared_setup {
+  struct vorbis_shared_setup *next;  /* most recently used first */
+
+  ogg_uint32_t   hash;
+  int            channels;
+  long           bytes;
+  unsigned char *packet;
+
+  int            refs;
+
+  /* owns the settings and books; freed with vorbis_info_clear */
+  vorbis_info    vi;
+
+  vorbis_look_floor   *flr[64];
+  vorbis_look_residue *residue[64];
+};
+
+static vorbis_mutex cache_lock=VORBIS_MUTEX_INITIALIZER;
+static vorbis_shared_setup *cache_list=NULL;
+static int cache_idle=0;      /* entries no decoder refers to */
+static int cache_max_idle=-1; /* how many of those to keep; <0 is off */
+
+static ogg_uint32_t _setup_hash(const unsigned char *p,long n){
+  ogg_uint32_t h=2166136261U;
+  while(n--)h=(h^*p++)*16777619U;
+  return(h);
+}
+
+/* the part of a codec_setup_info that the setup header fills in */
+static void _setup_copy(codec_setup_info *to,const codec_setup_info *from){
+  int i;
+  to->modes=from->modes;
+  to->maps=from->maps;
+  to->floors=from->floors;
+  to->residues=from->residues;
+  to->books=from->books;
+  for(i=0;i<from->modes;i++)
+    to->mode_param[i]=from->mode_param[i];
+  for(i=0;i<from->maps;i++){
+    to->map_type[i]=from->map_type[i];
+    to->map_param[i]=from->map_param[i];
+  }
+  for(i=0;i<from->floors;i++){
+    to->floor_type[i]=from->floor_type[i];
+    to->floor_param[i]=from->floor_param[i];
+  }
+  for(i=0;i<from->residues;i++){
+    to->residue_type[i]=from->residue_type[i];
+    to->residue_param[i]=from->residue_param[i];
+  }
+  to->fullbooks=from->fullbooks;
+}
+
+static void _setup_free(vorbis_shared_setup *s){
+  codec_setup_info *ci=s->vi.codec_setup;
+  int i;
+  for(i=0;i<ci->floors;i++)
+    if(s->flr[i])_floor_P[ci->floor_type[i]]->free_look(s->flr[i]);
+  for(i=0;i<ci->residues;i++)
+    if(s->residue[i])_residue_P[ci->residue_type[i]]->free_look(s->residue[i]);
+  vorbis_info_clear(&s->vi);
+  _ogg_free(s->packet);
+  _ogg_free(s);
+}
+
+/* unlink idle entries beyond the limit, least recently used first;
+   call locked, free what comes back unlocked */
+static vorbis_shared_setup *_setup_trim(void){
+  vorbis_shared_setup *dead=NULL;
+  while(cache_idle>(cache_max_idle<0?0:cache_max_idle)){
+    vorbis_shared_setup **p=&cache_list,**last=NULL;
+    for(;*p;p=&(*p)->next)
+      if(!(*p)->refs)last=p;
+    if(!last)break;
+    {
+      vorbis_shared_setup *s=*last;
+      *last=s->next;
+      s->next=dead;
+      dead=s;
+      cache_idle--;
+    }
+  }
+  return(dead);
+}
+
+static void _setup_free_list(vorbis_shared_setup *s){
+  while(s){
+    vorbis_shared_setup *next=s->next;
+    _setup_free(s);
+    s=next;
+  }
+}
+
+int _vorbis_setup_sharing(void){
+  int on;
+  vorbis_mutex_lock(&cache_lock);
+  on=cache_max_idle>=0;
+  vorbis_mutex_unlock(&cache_lock);
+  return(on);
+}
+
+int _vorbis_setup_find(vorbis_info *vi,ogg_packet *op){
+  codec_setup_info *ci=vi->codec_setup;
+  vorbis_shared_setup **p,*s=NULL;
+  ogg_uint32_t hash;
+
+  if(!ci || ci->shared)return(0);
+  hash=_setup_hash(op->packet,op->bytes);
+
+  vorbis_mutex_lock(&cache_lock);
+  if(cache_max_idle<0){
+    vorbis_mutex_unlock(&cache_lock);
+    return(0);
+  }
+  for(p=&cache_list;*p;p=&(*p)->next){
+    s=*p;
+    if(s->hash==hash && s->channels==vi->channels && s->bytes==op->bytes &&
+       !memcmp(s->packet,op->packet,op->bytes)){
+      /* move to front */
+      *p=s->next;
+      s->next=cache_list;
+      cache_list=s;
+      if(!s->refs++)cache_idle--;
+      break;
+    }
+    s=NULL;
+  }
+  vorbis_mutex_unlock(&cache_lock);
+
+  if(!s)return(0);
+  _setup_copy(ci,s->vi.codec_setup);
+  ci->shared=s;
+  return(1);
+}
+
+void _vorbis_setup_share(vorbis_info *vi,ogg_packet *op){
+  codec_setup_info *ci=vi->codec_setup;
+  codec_setup_info *sci;
+  vorbis_shared_setup *s;
+  codebook *books;
+  vorbis_dsp_state vd;
+  int i;
+
+  if(!ci || ci->shared || ci->fullbooks || !_vorbis_setup_sharing())return;
+
+  /* finish the codebooks as _vds_shared_init would; on trouble leave
+     vi alone for that to fail on in the usual way */
+  books=_ogg_calloc(ci->books,sizeof(*books));
+  if(!books)return;
+  for(i=0;i<ci->books;i++)
+    if(!ci->book_param[i] || vorbis_book_init_decode(books+i,ci->book_param[i]))
+      break;
+  if(i<ci->books){
+    while(i>=0)vorbis_book_clear(books+i--);
+    _ogg_free(books);
+    return;
+  }
+  for(i=0;i<ci->books;i++){
+    vorbis_staticbook_destroy(ci->book_param[i]);
+    ci->book_param[i]=NULL;
+  }
+  ci->fullbooks=books;
+
+  s=_ogg_calloc(1,sizeof(*s));
+  if(!s)return;
+  s->packet=_ogg_malloc(op->bytes);
+  if(!s->packet){
+    _ogg_free(s);
+    return;
+  }
+  memcpy(s->packet,op->packet,op->bytes);
+  s->bytes=op->bytes;
+  s->hash=_setup_hash(op->packet,op->bytes);
+  s->channels=vi->channels;
+  s->refs=1;
+
+  vorbis_info_init(&s->vi);
+  s->vi.channels=vi->channels;
+  s->vi.rate=vi->rate;
+  sci=s->vi.codec_setup;
+  sci->blocksizes[0]=ci->blocksizes[0];
+  sci->blocksizes[1]=ci->blocksizes[1];
+  _setup_copy(sci,ci);
+
+  /* the looks only read their settings and the books; floor0 builds
+     its tables lazily while decoding, so each decoder keeps its own */
+  memset(&vd,0,sizeof(vd));
+  vd.vi=&s->vi;
+  for(i=0;i<sci->floors;i++)
+    if(sci->floor_type[i]==1)
+      s->flr[i]=_floor_P[1]->look(&vd,sci->floor_param[i]);
+  for(i=0;i<sci->residues;i++)
+    s->residue[i]=_residue_P[sci->residue_type[i]]->
+      look(&vd,sci->residue_param[i]);
+
+  ci->shared=s;
+
+  vorbis_mutex_lock(&cache_lock);
+  s->next=cache_list;
+  cache_list=s;
+  vorbis_mutex_unlock(&cache_lock);
+}
+
+void _vorbis_setup_release(vorbis_shared_setup *s){
+  vorbis_shared_setup *dead=NULL;
+  vorbis_mutex_lock(&cache_lock);
+  if(!--s->refs){
+    cache_idle++;
+    dead=_setup_trim();
+  }
+  vorbis_mutex_unlock(&cache_lock);
+  _setup_free_list(dead);
+}
+
+vorbis_look_floor *_vorbis_setup_floor(codec_setup_info *ci,int i){
+  return(ci->shared?ci->shared->flr[i]:NULL);
+}
+
+vorbis_look_residue *_vorbis_setup_residue(codec_setup_info *ci,int i){
+  return(ci->shared?ci->shared->residue[i]:NULL);
+}
+
+/* Turn the setup cache on (max_idle>=0) or off (max_idle<0).  Setups
+   in use are shared regardless; max_idle is how many no decoder is
+   using to keep for later opens.  Decoders already sharing a setup
+   keep it when the cache is turned off. */
+int vorbis_synthesis_setup_cache(int max_idle){
+  vorbis_shared_setup *dead;
+  vorbis_mutex_lock(&cache_lock);
+  cache_max_idle=max_idle;
+  dead=_setup_trim();
+  vorbis_mutex_unlock(&cache_lock);
+  _setup_free_list(dead);
+  return(0);
+}
@@ -0,0 +1,39 @@
+/********************************************************************
+ *                                                                  *
+ * THIS FILE IS PART OF THE OggVorbis SOFTWARE CODEC SOURCE CODE.   *
+ * USE, DISTRIBUTION AND REPRODUCTION OF THIS LIBRARY SOURCE IS     *
+ * GOVERNED BY A BSD-STYLE SOURCE LICENSE INCLUDED WITH THIS SOURCE *
+ * IN 'COPYING'. PLEASE READ THESE TERMS BEFORE DISTRIBUTING.       *
+ *                                                                  *
+ * THE OggVorbis SOURCE CODE IS (C) COPYRIGHT 1994-2009             *
+ * by the Xiph.Org Foundation http://www.xiph.org/                  *
+ *                                                                  *
+ ********************************************************************
+
+ function: process wide cache of decoded setup headers
+
+ ********************************************************************/
+
+#ifndef _V_SETUPCACHE_H_
+#define _V_SETUPCACHE_H_
+
+#include "codec_internal.h"
+
+/* a decoded setup header (codebooks, floor/residue/mapping/mode
+   settings and the shareable look tables) that any number of
+   codec_setup_infos may point at; immutable once built */
+typedef struct vorbis_shared_setup vorbis_shared_setup;
+
+/* nonzero if setups unpacked now will be handed to the cache */
+extern int  _vorbis_setup_sharing(void);
+/* on a hit, fill vi's setup from the cache and return 1 */
+extern int  _vorbis_setup_find(vorbis_info *vi,ogg_packet *op);
+/* hand the setup just unpacked into vi over to the cache */
+extern void _vorbis_setup_share(vorbis_info *vi,ogg_packet *op);
+extern void _vorbis_setup_release(vorbis_shared_setup *s);
+
+/* shared look for floor/residue i, or NULL if the decoder makes its own */
+extern vorbis_look_floor   *_vorbis_setup_floor(codec_setup_info *ci,int i);
+extern vorbis_look_residue *_vorbis_setup_residue(codec_setup_info *ci,int i);
+
+#endif
@@ -24,6 +24,7 @@
 #include "vorbis/codec.h"
 #include "codebook.h"
 #include "scales.h"
+#include "cpu.h"
 
 /**** pack/unpack helpers ******************************************/
 int _ilog(unsigned int v){
@@ -276,6 +277,8 @@ void vorbis_book_clear(codebook *b){
   if(b->dec_index)_ogg_free(b->dec_index);
   if(b->dec_codelengths)_ogg_free(b->dec_codelengths);
   if(b->dec_firsttable)_ogg_free(b->dec_firsttable);
+  if(b->dec_secondtable)_ogg_free(b->dec_secondtable);
+  if(b->dec_vectorstore)_ogg_free(b->dec_vectorstore);
 
   memset(b,0,sizeof(*b));
 }
@@ -363,6 +366,19 @@ int vorbis_book_init_decode(codebook *c,const static_codebook *s){
 
 
     c->valuelist=_book_unquantize(s,n,sortindex);
+#ifdef VORBIS_SIMD_X86
+    if(c->valuelist && (c->dim==2 || c->dim==4 || c->dim==8) &&
+       (_vorbis_cpu_flags()&VORBIS_CPU_SSE2)){
+      long stride=(c->dim+3)&~3L;
+      c->dec_vectorstore=_ogg_calloc(n*stride+3,sizeof(*c->dec_vectors));
+      if(c->dec_vectorstore){
+        c->dec_vectors=(float *)(((size_t)c->dec_vectorstore+15)&~(size_t)15);
+        for(i=0;i<n;i++)
+          memcpy(c->dec_vectors+i*stride,c->valuelist+i*c->dim,
+                 c->dim*sizeof(*c->dec_vectors));
+      }
+    }
+#endif
     c->dec_index=_ogg_malloc(n*sizeof(*c->dec_index));
 
     for(n=0,i=0;i<s->entries;i++)
@@ -392,6 +408,60 @@ int vorbis_book_init_decode(codebook *c,const static_codebook *s){
       }
     }
 
+    /* codewords longer than the first table get a second level table
+       per first table slot, indexed by the bits following the first
+       table's, as long as the tables fit in the memory budget.  Slots
+       needing the smallest tables are served first; anything left
+       over keeps the hi/lo search hint below. */
+    {
+      int *subbits=alloca(tabn*sizeof(*subbits));
+      long *suboff=alloca(tabn*sizeof(*suboff));
+      long budget=VORBIS_DECODE_TABLE_BUDGET/sizeof(*c->dec_secondtable);
+      long total=0;
+      int bits;
+
+      memset(subbits,0,tabn*sizeof(*subbits));
+      for(i=0;i<n;i++){
+        if(c->dec_codelengths[i]>c->dec_firsttablen){
+          ogg_uint32_t orig=bitreverse(c->codelist[i]);
+          int slot=orig&(tabn-1);
+          int sub=c->dec_codelengths[i]-c->dec_firsttablen;
+          if(subbits[slot]<sub)subbits[slot]=sub;
+        }
+      }
+
+      for(i=0;i<tabn;i++)suboff[i]=-1;
+      for(bits=1;bits<=VORBIS_DECODE_SUBTABLE_MAXBITS;bits++)
+        for(i=0;i<tabn;i++)
+          if(subbits[i]==bits && total+(1L<<bits)<=budget){
+            suboff[i]=total;
+            total+=1L<<bits;
+          }
+
+      /* without the second level, these slots keep their search hints */
+      if(total)
+        c->dec_secondtable=_ogg_calloc(total,sizeof(*c->dec_secondtable));
+      if(c->dec_secondtable){
+        for(i=0;i<n;i++){
+          int len=c->dec_codelengths[i];
+          if(len>c->dec_firsttablen){
+            ogg_uint32_t orig=bitreverse(c->codelist[i]);
+            int slot=orig&(tabn-1);
+            if(suboff[slot]>=0){
+              ogg_uint32_t rest=orig>>c->dec_firsttablen;
+              int restlen=len-c->dec_firsttablen;
+              for(j=0;j<(1<<(subbits[slot]-restlen));j++)
+                c->dec_secondtable[suboff[slot]+(rest|(j<<restlen))]=i+1;
+            }
+          }
+        }
+        for(i=0;i<tabn;i++)
+          if(suboff[i]>=0)
+            c->dec_firsttable[i]=0xc0000000UL|
+              ((ogg_uint32_t)subbits[i]<<25)|suboff[i];
+      }
+    }
+
     /* now fill in 'unused' entries in the firsttable with hi/lo search
        hints for the non-direct-hits */
     {
@@ -20,6 +20,7 @@
 #include "vorbis/codec.h"
 #include "codec_internal.h"
 #include "registry.h"
+#include "profile.h"
 #include "misc.h"
 #include "os.h"
 
@@ -29,7 +30,9 @@ int vorbis_synthesis(vorbis_block *vb,ogg_packet *op){
   vorbis_info          *vi= vd ? vd->vi : 0;
   codec_setup_info     *ci= vi ? vi->codec_setup : 0;
   oggpack_buffer       *opb=vb ? &vb->opb : 0;
-  int                   type,mode,i;
+  const ogg_allocator  *prev;
+  int                   type,mode,i,ret;
+  VORBIS_CLOCK(t);
 
   if (!vd || !b || !vi || !ci || !opb) {
     return OV_EBADPACKET;
@@ -85,8 +88,13 @@ int vorbis_synthesis(vorbis_block *vb,ogg_packet *op){
   /* unpack_header enforces range checking */
   type=ci->map_type[ci->mode_param[mode]->mapping];
 
-  return(_mapping_P[type]->inverse(vb,ci->map_param[ci->mode_param[mode]->
-                                                   mapping]));
+  /* the backends build some lookups on first use */
+  prev=ogg_allocator_use(vd->allocator);
+  ret=_mapping_P[type]->inverse(vb,ci->map_param[ci->mode_param[mode]->
+                                                 mapping]);
+  ogg_allocator_use(prev);
+  VORBIS_STAGE(&b->profile,synthesis,t);
+  return(ret);
 }
 
 /* used to track pcm position without actually performing decode.
@@ -140,6 +148,42 @@ int vorbis_synthesis_trackonly(vorbis_block *vb,ogg_packet *op){
   return(0);
 }
 
+/* Reserve the block storage vorbis_synthesis() can need for any
+   packet of the stream, and do the set up it would otherwise do on
+   first use, so that decoding into vb allocates nothing from here on.
+   Returns the most bytes of an audio packet the decoder reads (longer
+   packets only carry data it ignores), for sizing packet buffers. */
+long vorbis_synthesis_reserve(vorbis_block *vb){
+  vorbis_dsp_state     *vd= vb ? vb->vd : 0;
+  private_state        *b= vd ? vd->backend_state : 0;
+  vorbis_info          *vi= vd ? vd->vi : 0;
+  codec_setup_info     *ci= vi ? vi->codec_setup : 0;
+  const ogg_allocator  *prev;
+  long                  bytes=0,bits=0;
+  int                   i;
+
+  if (!vd || !b || !vi || !ci)return(OV_EFAULT);
+
+  prev=ogg_allocator_use(vd->allocator);
+  for(i=0;i<ci->modes;i++){
+    int mapping=ci->mode_param[i]->mapping;
+    long read,need=_mapping_P[ci->map_type[mapping]]->
+      reserve(vd,ci->map_param[mapping],&read);
+    if(need>bytes)bytes=need;
+    if(read>bits)bits=read;
+  }
+  ogg_allocator_use(prev);
+
+  /* the pcm passback storage, and the packet type, mode and window
+     flags read above */
+  bytes+=_vorbis_block_bytes(sizeof(*vb->pcm)*vi->channels)+
+    vi->channels*_vorbis_block_bytes(sizeof(**vb->pcm)*ci->blocksizes[1]);
+  bits+=1+b->modebits+2;
+
+  if(_vorbis_block_reserve(vb,bytes))return(OV_EFAULT);
+  return((bits+7)>>3);
+}
+
 long vorbis_packet_blocksize(vorbis_info *vi,ogg_packet *op){
   codec_setup_info     *ci=vi->codec_setup;
   oggpack_buffer       opb;
@@ -168,16 +212,26 @@ long vorbis_packet_blocksize(vorbis_info *vi,ogg_packet *op){
   return(ci->blocksizes[ci->mode_param[mode]->blockflag]);
 }
 
-int vorbis_synthesis_halfrate(vorbis_info *vi,int flag){
-  /* set / clear half-sample-rate mode */
+/* Decode at 1/2^shift of the stream's sample rate, for shift 0 (full
+   rate) to 3 (1/8), by keeping only the lowest 1/2^shift of each
+   block's spectrum: the inverse MDCT and the overlap-add then run at
+   the reduced size, and blocks of n samples come out as n>>shift.  Granule positions, and so vorbisfile's
+   positions, stay in full rate samples.  Short blocks may not shrink
+   below 16 samples.  Set before vorbis_synthesis_init(). */
+int vorbis_synthesis_rate_shift(vorbis_info *vi,int shift){
   codec_setup_info     *ci=vi->codec_setup;
 
-  /* right now, our MDCT can't handle < 64 sample windows. */
-  if(ci->blocksizes[0]<=64 && flag)return -1;
-  ci->halfrate_flag=(flag?1:0);
+  if(shift<0 || shift>3 || (ci->blocksizes[0]>>shift)<16)return -1;
+  ci->halfrate_flag=shift;
   return 0;
 }
 
+int vorbis_synthesis_halfrate(vorbis_info *vi,int flag){
+  /* set / clear half-sample-rate mode */
+  return vorbis_synthesis_rate_shift(vi,flag?1:0);
+}
+
+/* the shift set above; nonzero for any reduced rate */
 int vorbis_synthesis_halfrate_p(vorbis_info *vi){
   codec_setup_info     *ci=vi->codec_setup;
   return ci->halfrate_flag;
@@ -0,0 +1,237 @@
+/********************************************************************
+ *                                                                  *
+ * THIS FILE IS PART OF THE OggVorbis SOFTWARE CODEC SOURCE CODE.   *
+ * USE, DISTRIBUTION AND REPRODUCTION OF THIS LIBRARY SOURCE IS     *
+ * GOVERNED BY A BSD-STYLE SOURCE LICENSE INCLUDED WITH THIS SOURCE *
+ * IN 'COPYING'. PLEASE READ THESE TERMS BEFORE DISTRIBUTING.       *
+ *                                                                  *
+ * THE OggVorbis SOURCE CODE IS (C) COPYRIGHT 1994-2009             *
+ * by the Xiph.Org Foundation http://www.xiph.org/                  *
+ *                                                                  *
+ ********************************************************************
+
+ function: minimal threading primitives
+
+ ********************************************************************/
+
+#include <stdlib.h>
+#include "thread.h"
+#include "profile.h"
+#include "os.h"
+
+#ifndef _WIN32
+#  include <unistd.h>
+#  include <time.h>
+#endif
+
+struct vorbis_thread {
+  void (*func)(void *);
+  void *arg;
+#ifdef _WIN32
+  PTP_WORK work;
+#else
+  pthread_t thread;
+#endif
+};
+
+#ifdef _WIN32
+
+static VOID CALLBACK _thread_main(PTP_CALLBACK_INSTANCE instance,
+                                  PVOID context,PTP_WORK work){
+  vorbis_thread *t=context;
+  (void)instance;
+  (void)work;
+  t->func(t->arg);
+}
+
+vorbis_thread *_vorbis_thread_start(void (*func)(void *),void *arg){
+  vorbis_thread *t=_ogg_calloc(1,sizeof(*t));
+  if(!t)return(NULL);
+  t->func=func;
+  t->arg=arg;
+  t->work=CreateThreadpoolWork(_thread_main,t,NULL);
+  if(!t->work){
+    _ogg_free(t);
+    return(NULL);
+  }
+  SubmitThreadpoolWork(t->work);
+  return(t);
+}
+
+void _vorbis_thread_join(vorbis_thread *t){
+  WaitForThreadpoolWorkCallbacks(t->work,FALSE);
+  CloseThreadpoolWork(t->work);
+  _ogg_free(t);
+}
+
+int _vorbis_cpu_count(void){
+  SYSTEM_INFO si;
+  GetNativeSystemInfo(&si);
+  return(si.dwNumberOfProcessors>0?(int)si.dwNumberOfProcessors:1);
+}
+
+#ifdef VORBIS_PROFILE
+ogg_int64_t _vorbis_clock(void){
+  static LARGE_INTEGER freq;
+  LARGE_INTEGER now;
+  if(!freq.QuadPart)QueryPerformanceFrequency(&freq);
+  QueryPerformanceCounter(&now);
+  return((ogg_int64_t)(now.QuadPart/freq.QuadPart)*1000000000+
+         (ogg_int64_t)(now.QuadPart%freq.QuadPart)*1000000000/freq.QuadPart);
+}
+#endif
+
+#else
+
+static void *_thread_main(void *context){
+  vorbis_thread *t=context;
+  t->func(t->arg);
+  return(NULL);
+}
+
+vorbis_thread *_vorbis_thread_start(void (*func)(void *),void *arg){
+  vorbis_thread *t=_ogg_calloc(1,sizeof(*t));
+  if(!t)return(NULL);
+  t->func=func;
+  t->arg=arg;
+  if(pthread_create(&t->thread,NULL,_thread_main,t)){
+    _ogg_free(t);
+    return(NULL);
+  }
+  return(t);
+}
+
+void _vorbis_thread_join(vorbis_thread *t){
+  pthread_join(t->thread,NULL);
+  _ogg_free(t);
+}
+
+int _vorbis_cpu_count(void){
+#ifdef _SC_NPROCESSORS_ONLN
+  long n=sysconf(_SC_NPROCESSORS_ONLN);
+  if(n>0)return((int)n);
+#endif
+  return(1);
+}
+
+#ifdef VORBIS_PROFILE
+ogg_int64_t _vorbis_clock(void){
+  struct timespec now;
+  clock_gettime(CLOCK_MONOTONIC,&now);
+  return((ogg_int64_t)now.tv_sec*1000000000+now.tv_nsec);
+}
+#endif
+
+#endif
+
+#if !defined(_WIN32) && !defined(__GNUC__)
+/* no atomic builtins; one lock for every counter will do */
+static vorbis_mutex atomic_lock=VORBIS_MUTEX_INITIALIZER;
+
+void _vorbis_atomic_inc(long *p){
+  vorbis_mutex_lock(&atomic_lock);
+  (*p)++;
+  vorbis_mutex_unlock(&atomic_lock);
+}
+#endif
+
+/* worker pool ***********************************************************/
+
+struct vorbis_pool {
+  vorbis_mutex    lock;
+  vorbis_cond     cond;   /* workers wait here for a job */
+  vorbis_cond     done;   /* the caller waits here for the last item */
+  vorbis_thread **threads;
+  int             nthreads;
+
+  void          (*func)(void *arg,int i);
+  void           *arg;
+  int             n;
+  int             next;    /* next item to take */
+  int             pending; /* items not yet finished */
+  unsigned        job;     /* bumped for every run */
+  int             quit;
+};
+
+/* run items of the current job until there are none left; call and
+   return with the lock held */
+static void _pool_work(vorbis_pool *p){
+  while(p->next<p->n){
+    int i=p->next++;
+    vorbis_mutex_unlock(&p->lock);
+    p->func(p->arg,i);
+    vorbis_mutex_lock(&p->lock);
+    if(!--p->pending)vorbis_cond_broadcast(&p->done);
+  }
+}
+
+static void _pool_main(void *arg){
+  vorbis_pool *p=arg;
+  unsigned job=0;
+  vorbis_mutex_lock(&p->lock);
+  while(1){
+    while(!p->quit && p->job==job)
+      vorbis_cond_wait(&p->cond,&p->lock);
+    if(p->quit)break;
+    job=p->job;
+    _pool_work(p);
+  }
+  vorbis_mutex_unlock(&p->lock);
+}
+
+vorbis_pool *_vorbis_pool_create(int threads){
+  vorbis_pool *p;
+  int i;
+  if(threads<1)return(NULL);
+  p=_ogg_calloc(1,sizeof(*p));
+  if(!p)return(NULL);
+  p->threads=_ogg_calloc(threads,sizeof(*p->threads));
+  if(!p->threads){
+    _ogg_free(p);
+    return(NULL);
+  }
+  vorbis_mutex_init(&p->lock);
+  vorbis_cond_init(&p->cond);
+  vorbis_cond_init(&p->done);
+  for(i=0;i<threads;i++){
+    p->threads[p->nthreads]=_vorbis_thread_start(_pool_main,p);
+    if(p->threads[p->nthreads])p->nthreads++;
+  }
+  if(!p->nthreads){
+    _vorbis_pool_destroy(p);
+    return(NULL);
+  }
+  return(p);
+}
+
+void _vorbis_pool_run(vorbis_pool *p,void (*func)(void *arg,int i),
+                      void *arg,int n){
+  vorbis_mutex_lock(&p->lock);
+  p->func=func;
+  p->arg=arg;
+  p->n=n;
+  p->next=0;
+  p->pending=n;
+  p->job++;
+  vorbis_cond_broadcast(&p->cond);
+  _pool_work(p);
+  while(p->pending)
+    vorbis_cond_wait(&p->done,&p->lock);
+  vorbis_mutex_unlock(&p->lock);
+}
+
+void _vorbis_pool_destroy(vorbis_pool *p){
+  int i;
+  if(!p)return;
+  vorbis_mutex_lock(&p->lock);
+  p->quit=1;
+  vorbis_cond_broadcast(&p->cond);
+  vorbis_mutex_unlock(&p->lock);
+  for(i=0;i<p->nthreads;i++)
+    _vorbis_thread_join(p->threads[i]);
+  vorbis_cond_destroy(&p->done);
+  vorbis_cond_destroy(&p->cond);
+  vorbis_mutex_destroy(&p->lock);
+  _ogg_free(p->threads);
+  _ogg_free(p);
+}
@@ -0,0 +1,89 @@
+/********************************************************************
+ *                                                                  *
+ * THIS FILE IS PART OF THE OggVorbis SOFTWARE CODEC SOURCE CODE.   *
+ * USE, DISTRIBUTION AND REPRODUCTION OF THIS LIBRARY SOURCE IS     *
+ * GOVERNED BY A BSD-STYLE SOURCE LICENSE INCLUDED WITH THIS SOURCE *
+ * IN 'COPYING'. PLEASE READ THESE TERMS BEFORE DISTRIBUTING.       *
+ *                                                                  *
+ * THE OggVorbis SOURCE CODE IS (C) COPYRIGHT 1994-2009             *
+ * by the Xiph.Org Foundation http://www.xiph.org/                  *
+ *                                                                  *
+ ********************************************************************
+
+ function: minimal threading primitives
+
+ ********************************************************************/
+
+#ifndef _V_THREAD_H_
+#define _V_THREAD_H_
+
+/* mutexes (which may be statically initialized) and condition
+   variables; SRW locks on Windows (Vista and later, which includes
+   every Windows Runtime target), pthreads everywhere else */
+#ifdef _WIN32
+#  ifndef WIN32_LEAN_AND_MEAN
+#    define WIN32_LEAN_AND_MEAN
+#  endif
+#  include <windows.h>
+typedef SRWLOCK vorbis_mutex;
+typedef CONDITION_VARIABLE vorbis_cond;
+#  define VORBIS_MUTEX_INITIALIZER SRWLOCK_INIT
+#  define vorbis_mutex_init(m)    InitializeSRWLock(m)
+#  define vorbis_mutex_destroy(m) ((void)(m))
+#  define vorbis_mutex_lock(m)    AcquireSRWLockExclusive(m)
+#  define vorbis_mutex_unlock(m)  ReleaseSRWLockExclusive(m)
+#  define vorbis_cond_init(c)     InitializeConditionVariable(c)
+#  define vorbis_cond_destroy(c)  ((void)(c))
+#  define vorbis_cond_wait(c,m)   SleepConditionVariableSRW(c,m,INFINITE,0)
+#  define vorbis_cond_broadcast(c) WakeAllConditionVariable(c)
+#else
+#  include <pthread.h>
+typedef pthread_mutex_t vorbis_mutex;
+typedef pthread_cond_t vorbis_cond;
+#  define VORBIS_MUTEX_INITIALIZER PTHREAD_MUTEX_INITIALIZER
+#  define vorbis_mutex_init(m)    pthread_mutex_init(m,NULL)
+#  define vorbis_mutex_destroy(m) pthread_mutex_destroy(m)
+#  define vorbis_mutex_lock(m)    pthread_mutex_lock(m)
+#  define vorbis_mutex_unlock(m)  pthread_mutex_unlock(m)
+#  define vorbis_cond_init(c)     pthread_cond_init(c,NULL)
+#  define vorbis_cond_destroy(c)  pthread_cond_destroy(c)
+#  define vorbis_cond_wait(c,m)   pthread_cond_wait(c,m)
+#  define vorbis_cond_broadcast(c) pthread_cond_broadcast(c)
+#endif
+
+/* counters that several threads may bump at once (such as those of
+   codebooks shared through the setup cache) */
+#ifdef _WIN32
+#  define vorbis_atomic_inc(p)    ((void)InterlockedIncrement(p))
+#elif defined(__GNUC__)
+#  define vorbis_atomic_inc(p)    ((void)__sync_fetch_and_add(p,1L))
+#else
+#  define vorbis_atomic_inc(p)    _vorbis_atomic_inc(p)
+extern void _vorbis_atomic_inc(long *p);
+#endif
+
+/* worker threads; on Windows these run on the process thread pool,
+   as Windows Phone 8.1 apps cannot create threads of their own */
+typedef struct vorbis_thread vorbis_thread;
+
+extern vorbis_thread *_vorbis_thread_start(void (*func)(void *),void *arg);
+extern void _vorbis_thread_join(vorbis_thread *t);
+extern int  _vorbis_cpu_count(void);
+
+/* a set of threads kept waiting to run func(arg,0..n-1); the calling
+   thread joins in and _vorbis_pool_run returns when all n are done */
+typedef struct vorbis_pool vorbis_pool;
+
+extern vorbis_pool *_vorbis_pool_create(int threads);
+extern void _vorbis_pool_run(vorbis_pool *p,void (*func)(void *arg,int i),
+                             void *arg,int n);
+extern void _vorbis_pool_destroy(vorbis_pool *p);
+
+/* have a decoder run its channels on p as vorbis_synthesis_threads()
+   would, where p outlives the decoder and is the caller's to destroy;
+   NULL goes back to the calling thread only */
+struct vorbis_dsp_state;
+extern int  _vorbis_synthesis_pool(struct vorbis_dsp_state *v,
+                                   vorbis_pool *p);
+
+#endif
@@ -21,6 +21,19 @@
 #include "misc.h"
 #include "window.h"
 
+/* vwin16 and vwin32 are only used by reduced rate decode */
+static const float vwin16[8] = {
+  0.0150906327F, 0.1319772922F, 0.3420093109F, 0.5909004863F,
+  0.8067444548F, 0.9396965634F, 0.9912527399F, 0.9998861299F,
+};
+
+static const float vwin32[16] = {
+  0.0037818978F, 0.0338125350F, 0.0926059461F, 0.1773343161F,
+  0.2832170448F, 0.4033400334F, 0.5289892736F, 0.6506314666F,
+  0.7593936362F, 0.8486285103F, 0.9150501721F, 0.9590558407F,
+  0.9841506695F, 0.9957028366F, 0.9994281928F, 0.9999928486F,
+};
+
 static const float vwin64[32] = {
   0.0009460463F, 0.0085006468F, 0.0235352254F, 0.0458950567F,
   0.0753351908F, 0.1115073077F, 0.1539457973F, 0.2020557475F,
@@ -2085,7 +2098,9 @@ static const float vwin8192[4096] = {
   1.0000000000F, 1.0000000000F, 1.0000000000F, 1.0000000000F,
 };
 
-static const float *const vwin[8] = {
+static const float *const vwin[10] = {
+  vwin16,
+  vwin32,
   vwin64,
   vwin128,
   vwin256,
@@ -2096,8 +2111,10 @@ static const float *const vwin[8] = {
   vwin8192,
 };
 
+/* n is log2 of the blocksize less 6, as for the 64 sample window at
+   0; -1 and -2 are the smaller two */
 const float *_vorbis_window_get(int n){
-  return vwin[n];
+  return vwin[n+2];
 }
 
 void _vorbis_apply_window(float *d,int *winno,long *blocksizes,
@@ -2106,8 +2123,8 @@ void _vorbis_apply_window(float *d,int *winno,long *blocksizes,
   nW=(W?nW:0);
 
   {
-    const float *windowLW=vwin[winno[lW]];
-    const float *windowNW=vwin[winno[nW]];
+    const float *windowLW=_vorbis_window_get(winno[lW]);
+    const float *windowNW=_vorbis_window_get(winno[nW]);
 
     long n=blocksizes[W];
     long ln=blocksizes[lW];
@@ -0,0 +1,521 @@
+/********************************************************************
+ *                                                                  *
+ * THIS FILE IS PART OF THE OggVorbis SOFTWARE CODEC SOURCE CODE.   *
+ * USE, DISTRIBUTION AND REPRODUCTION OF THIS LIBRARY SOURCE IS     *
+ * GOVERNED BY A BSD-STYLE SOURCE LICENSE INCLUDED WITH THIS SOURCE *
+ * IN 'COPYING'. PLEASE READ THESE TERMS BEFORE DISTRIBUTING.       *
+ *                                                                  *
+ * THE OggVorbis SOURCE CODE IS (C) COPYRIGHT 1994-2009             *
+ * by the Xiph.Org Foundation http://www.xiph.org/                  *
+ *                                                                  *
+ ********************************************************************
+
+ function: planar float to interleaved PCM packing for ov_read
+
+ ********************************************************************/
+
+/* The SSE2 code converts four samples at a time with the same float
+   multiply and round-to-nearest conversion the C code uses, and clips
+   the same way, so the two produce identical bytes, NaN and infinite
+   input included.  Mono and stereo, the common cases, are interleaved
+   in registers and written whole; with more channels each channel is
+   converted four samples at a time and stored strided, like the C
+   code does. */
+
+#include <string.h>
+#include "vorbis/codec.h"
+
+#define OV_EXCLUDE_STATIC_CALLBACKS
+#include "vorbis/vorbisfile.h"
+#include "os.h"
+#include "cpu.h"
+#include "lap.h"
+#include "pcmpack.h"
+
+int _ov_pcm_width(int format){
+  switch(format&0xff){
+  case OV_FMT_S16:
+    return 2;
+  case OV_FMT_S24:
+    return 3;
+  case OV_FMT_S32:
+  case OV_FMT_FLOAT:
+    return 4;
+  }
+  return 0;
+}
+
+static int _host_is_big_endian(void){
+  ogg_int32_t pattern=0xfeedface;
+  return ((unsigned char *)&pattern)[0]==0xfe;
+}
+
+/**** C ********************************************************************/
+
+/* scaling and clipping, which the SIMD code must match exactly; NaN
+   clips to the negative limit, as the x86 conversions leave it */
+STIN int _s16(float f){
+  int val=vorbis_ftoi(f*32768.f);
+  if(val>32767)val=32767;
+  else if(val<-32768)val=-32768;
+  return val;
+}
+
+STIN int _s24(float f){
+  float g=f*8388608.f;
+  if(!(g>=-8388608.f))g=-8388608.f;
+  else if(g>8388607.f)g=8388607.f;
+  return vorbis_ftoi(g);
+}
+
+STIN ogg_int32_t _s32(float f){
+  float g=f*2147483648.f;
+  if(!(g>-2147483648.f))return -2147483647-1;
+  if(g>=2147483648.f)return 2147483647;
+  return vorbis_ftoi(g);
+}
+
+STIN ogg_uint32_t _sample(float f,int kind,int flip){
+  ogg_uint32_t u;
+  switch(kind){
+  case OV_FMT_S16:
+    return (ogg_uint32_t)(_s16(f)^flip);
+  case OV_FMT_S24:
+    return (ogg_uint32_t)_s24(f);
+  case OV_FMT_S32:
+    return (ogg_uint32_t)_s32(f);
+  default:
+    memcpy(&u,&f,sizeof(u));
+    return u;
+  }
+}
+
+STIN void _put(unsigned char *d,ogg_uint32_t val,int width,int big){
+  int i;
+  if(big)
+    for(i=width-1;i>=0;i--,val>>=8)d[i]=(unsigned char)val;
+  else
+    for(i=0;i<width;i++,val>>=8)d[i]=(unsigned char)val;
+}
+
+static void _pack_c(unsigned char *dst,float **src,int channels,long samples,
+                    int format){
+  int kind=format&0xff;
+  int big=(format&OV_FMT_BIGENDIAN)!=0;
+  int flip=(format&OV_PCM_UNSIGNED)?0x8000:0;
+  int width=_ov_pcm_width(format);
+  long stride=(long)width*channels;
+  vorbis_fpu_control fpu;
+  long j;
+  int i;
+
+  vorbis_fpu_setround(&fpu);
+  if(kind==OV_FMT_S16 && big==_host_is_big_endian()){
+    for(i=0;i<channels;i++){ /* It's faster in this order */
+      float *s=src[i];
+      ogg_int16_t *d=((ogg_int16_t *)dst)+i;
+      for(j=0;j<samples;j++){
+        *d=(ogg_int16_t)(_s16(s[j])^flip);
+        d+=channels;
+      }
+    }
+  }else{
+    for(i=0;i<channels;i++){
+      float *s=src[i];
+      unsigned char *d=dst+i*width;
+      for(j=0;j<samples;j++,d+=stride)
+        _put(d,_sample(s[j],kind,flip),width,big);
+    }
+  }
+  vorbis_fpu_restore(fpu);
+}
+
+#ifdef VORBIS_SIMD_X86
+
+#include <emmintrin.h>
+
+/**** SSE2 *****************************************************************/
+
+/* four samples as _sample() does them; 16 bit values are left in 32
+   bit lanes, unclipped, for the saturating pack to finish */
+VORBIS_TARGET_SSE2
+STIN __m128i sse_sample(__m128 x,int kind){
+  __m128i v;
+  switch(kind){
+  case OV_FMT_S16:
+    return _mm_cvtps_epi32(_mm_mul_ps(x,_mm_set1_ps(32768.f)));
+  case OV_FMT_S24:
+    /* maxps passes its second operand on NaN */
+    x=_mm_mul_ps(x,_mm_set1_ps(8388608.f));
+    x=_mm_max_ps(x,_mm_set1_ps(-8388608.f));
+    x=_mm_min_ps(x,_mm_set1_ps(8388607.f));
+    return _mm_cvtps_epi32(x);
+  case OV_FMT_S32:
+    /* out of range converts to 0x80000000; flip the positive ones */
+    x=_mm_mul_ps(x,_mm_set1_ps(2147483648.f));
+    v=_mm_cvtps_epi32(x);
+    return _mm_xor_si128(v,_mm_castps_si128(
+                           _mm_cmpge_ps(x,_mm_set1_ps(2147483648.f))));
+  default:
+    return _mm_castps_si128(x);
+  }
+}
+
+VORBIS_TARGET_SSE2
+STIN __m128i sse_swap16(__m128i v){
+  return _mm_or_si128(_mm_slli_epi16(v,8),_mm_srli_epi16(v,8));
+}
+
+VORBIS_TARGET_SSE2
+STIN __m128i sse_swap32(__m128i v){
+  v=_mm_shufflelo_epi16(v,_MM_SHUFFLE(2,3,0,1));
+  v=_mm_shufflehi_epi16(v,_MM_SHUFFLE(2,3,0,1));
+  return sse_swap16(v);
+}
+
+/* eight 16 bit samples from two vectors of four */
+VORBIS_TARGET_SSE2
+STIN __m128i sse_s16(__m128i a,__m128i b,__m128i flip,int big){
+  __m128i v=_mm_xor_si128(_mm_packs_epi32(a,b),flip);
+  return big?sse_swap16(v):v;
+}
+
+/* four 24 bit samples, packed into 12 bytes */
+VORBIS_TARGET_SSE2
+STIN void sse_put24(unsigned char *d,__m128i v,int big){
+  __m128i lo=_mm_set_epi32(0,-1,0,-1);
+  ogg_int32_t last;
+
+  if(big)v=_mm_srli_epi32(sse_swap32(v),8);
+  v=_mm_and_si128(v,_mm_set1_epi32(0xffffff));
+  /* pairs to six bytes per 64 bit half, then close the gap */
+  v=_mm_or_si128(_mm_and_si128(v,lo),
+                 _mm_srli_epi64(_mm_andnot_si128(lo,v),8));
+  v=_mm_or_si128(_mm_move_epi64(v),
+                 _mm_slli_si128(_mm_srli_si128(v,8),6));
+  _mm_storel_epi64((__m128i *)d,v);
+  last=_mm_cvtsi128_si32(_mm_srli_si128(v,8));
+  memcpy(d+8,&last,4);
+}
+
+/* four samples, one vector's worth, to memory */
+VORBIS_TARGET_SSE2
+STIN void sse_put4(unsigned char *d,__m128i v,int kind,int big,
+                   __m128i flip){
+  switch(kind){
+  case OV_FMT_S16:
+    _mm_storel_epi64((__m128i *)d,sse_s16(v,v,flip,big));
+    break;
+  case OV_FMT_S24:
+    sse_put24(d,v,big);
+    break;
+  default:
+    _mm_storeu_si128((__m128i *)d,big?sse_swap32(v):v);
+    break;
+  }
+}
+
+VORBIS_TARGET_SSE2
+static void _pack_sse2(unsigned char *dst,float **src,int channels,
+                       long samples,int format){
+  int kind=format&0xff;
+  int big=(format&OV_FMT_BIGENDIAN)!=0;
+  int width=_ov_pcm_width(format);
+  long stride=(long)width*channels;
+  long n=samples&~3L;
+  __m128i flip=_mm_set1_epi16((format&OV_PCM_UNSIGNED)?-32768:0);
+  float *tail[256];
+  long j;
+  int i;
+
+  if(channels==1){
+    float *s=src[0];
+    unsigned char *d=dst;
+    for(j=0;j<n;j+=4,d+=4*width)
+      sse_put4(d,sse_sample(_mm_loadu_ps(s+j),kind),kind,big,flip);
+
+  }else if(channels==2){
+    float *l=src[0];
+    float *r=src[1];
+    unsigned char *d=dst;
+    for(j=0;j<n;j+=4,d+=8*width){
+      __m128 x=_mm_loadu_ps(l+j);
+      __m128 y=_mm_loadu_ps(r+j);
+      __m128i a=sse_sample(_mm_unpacklo_ps(x,y),kind);
+      __m128i b=sse_sample(_mm_unpackhi_ps(x,y),kind);
+      if(kind==OV_FMT_S16){
+        _mm_storeu_si128((__m128i *)d,sse_s16(a,b,flip,big));
+      }else{
+        sse_put4(d,a,kind,big,flip);
+        sse_put4(d+4*width,b,kind,big,flip);
+      }
+    }
+
+  }else{
+    /* channel at a time into the strided frames; the lanes are
+       byte swapped in register so the stores below are native */
+    for(i=0;i<channels;i++){
+      float *s=src[i];
+      unsigned char *d=dst+i*width;
+      union { ogg_uint32_t u[4]; ogg_uint16_t h[8]; __m128i v; } q;
+      switch(kind){
+      case OV_FMT_S16:
+        for(j=0;j<n;j+=4,d+=4*stride){
+          q.v=sse_s16(sse_sample(_mm_loadu_ps(s+j),kind),
+                      _mm_setzero_si128(),flip,big);
+          memcpy(d,q.h,2);
+          memcpy(d+stride,q.h+1,2);
+          memcpy(d+2*stride,q.h+2,2);
+          memcpy(d+3*stride,q.h+3,2);
+        }
+        break;
+      case OV_FMT_S24:
+        for(j=0;j<n;j+=4,d+=4*stride){
+          int k;
+          q.v=sse_sample(_mm_loadu_ps(s+j),kind);
+          for(k=0;k<4;k++)_put(d+k*stride,q.u[k],3,big);
+        }
+        break;
+      default:
+        for(j=0;j<n;j+=4,d+=4*stride){
+          __m128i v=sse_sample(_mm_loadu_ps(s+j),kind);
+          q.v=big?sse_swap32(v):v;
+          memcpy(d,q.u,4);
+          memcpy(d+stride,q.u+1,4);
+          memcpy(d+2*stride,q.u+2,4);
+          memcpy(d+3*stride,q.u+3,4);
+        }
+        break;
+      }
+    }
+  }
+
+  if(n<samples){
+    for(i=0;i<channels;i++)tail[i]=src[i]+n;
+    _pack_c(dst+n*stride,tail,channels,samples-n,format);
+  }
+}
+
+/* four lapped samples, as _vorbis_lap() makes them */
+VORBIS_TARGET_SSE2
+STIN __m128 sse_lap(const float *pcm,const float *cur,const float *up,
+                    const float *down,long j){
+  __m128 w=_mm_loadu_ps(down-j-3);
+  w=_mm_shuffle_ps(w,w,_MM_SHUFFLE(0,1,2,3));
+  return _mm_add_ps(_mm_mul_ps(_mm_loadu_ps(pcm+j),w),
+                    _mm_mul_ps(_mm_loadu_ps(cur+j),_mm_loadu_ps(up+j)));
+}
+
+/* _pack_sse2(), lapping on the way in; returns how many samples it
+   did, a multiple of four */
+VORBIS_TARGET_SSE2
+static long _pack_lap_sse2(unsigned char *dst,float **pcm,float **cur,
+                           const float *up,const float *down,int channels,
+                           long samples,int format){
+  int kind=format&0xff;
+  int big=(format&OV_FMT_BIGENDIAN)!=0;
+  int width=_ov_pcm_width(format);
+  long n=samples&~3L;
+  __m128i flip=_mm_set1_epi16((format&OV_PCM_UNSIGNED)?-32768:0);
+  unsigned char *d=dst;
+  long j;
+
+  if(channels==1){
+    for(j=0;j<n;j+=4,d+=4*width)
+      sse_put4(d,sse_sample(sse_lap(pcm[0],cur[0],up,down,j),kind),
+               kind,big,flip);
+  }else if(channels>2){
+    /* as in _pack_sse2() */
+    long stride=(long)width*channels;
+    int i;
+    for(i=0;i<channels;i++){
+      float *s=pcm[i];
+      float *c=cur[i];
+      union { ogg_uint32_t u[4]; ogg_uint16_t h[8]; __m128i v; } q;
+      d=dst+i*width;
+      switch(kind){
+      case OV_FMT_S16:
+        for(j=0;j<n;j+=4,d+=4*stride){
+          q.v=sse_s16(sse_sample(sse_lap(s,c,up,down,j),kind),
+                      _mm_setzero_si128(),flip,big);
+          memcpy(d,q.h,2);
+          memcpy(d+stride,q.h+1,2);
+          memcpy(d+2*stride,q.h+2,2);
+          memcpy(d+3*stride,q.h+3,2);
+        }
+        break;
+      case OV_FMT_S24:
+        for(j=0;j<n;j+=4,d+=4*stride){
+          int k;
+          q.v=sse_sample(sse_lap(s,c,up,down,j),kind);
+          for(k=0;k<4;k++)_put(d+k*stride,q.u[k],3,big);
+        }
+        break;
+      default:
+        for(j=0;j<n;j+=4,d+=4*stride){
+          __m128i v=sse_sample(sse_lap(s,c,up,down,j),kind);
+          q.v=big?sse_swap32(v):v;
+          memcpy(d,q.u,4);
+          memcpy(d+stride,q.u+1,4);
+          memcpy(d+2*stride,q.u+2,4);
+          memcpy(d+3*stride,q.u+3,4);
+        }
+        break;
+      }
+    }
+  }else{
+    for(j=0;j<n;j+=4,d+=8*width){
+      __m128 x=sse_lap(pcm[0],cur[0],up,down,j);
+      __m128 y=sse_lap(pcm[1],cur[1],up,down,j);
+      __m128i a=sse_sample(_mm_unpacklo_ps(x,y),kind);
+      __m128i b=sse_sample(_mm_unpackhi_ps(x,y),kind);
+      if(kind==OV_FMT_S16){
+        _mm_storeu_si128((__m128i *)d,sse_s16(a,b,flip,big));
+      }else{
+        sse_put4(d,a,kind,big,flip);
+        sse_put4(d+4*width,b,kind,big,flip);
+      }
+    }
+  }
+  return n;
+}
+
+#endif
+
+/* Pack samples frames of channels planar float channels into dst,
+   interleaved, in the given format. */
+void _ov_pcm_pack(void *dst,float **src,int channels,long samples,
+                  int format){
+#ifdef VORBIS_SIMD_X86
+  if((_vorbis_cpu_flags()&VORBIS_CPU_SSE2) && channels<=256){
+    _pack_sse2(dst,src,channels,samples,format);
+    return;
+  }
+#endif
+  _pack_c(dst,src,channels,samples,format);
+}
+
+/* floats lapped at a time, which stay in the L1 cache for packing */
+#define LAP_CHUNK 2048
+
+/* The SSE2 code laps in register as it packs.  The C code laps in
+   runs short enough that the samples are still in the cache when they
+   are packed.  Either way they are not written back to the decoder's
+   buffer and read again.  Vorbis streams have at most 255 channels,
+   so a run is 8 samples or more. */
+void _ov_pcm_pack_lap(void *dst,float **pcm,float **cur,
+                      const float *up,const float *down,
+                      int channels,long samples,int format){
+  float buf[LAP_CHUNK];
+  float *src[256];
+  long run=(LAP_CHUNK/channels)&~3L;
+  long stride=(long)_ov_pcm_width(format)*channels;
+  unsigned char *d=dst;
+  long j=0,n;
+  int i;
+
+#ifdef VORBIS_SIMD_X86
+  if(_vorbis_cpu_flags()&VORBIS_CPU_SSE2){
+    j=_pack_lap_sse2(d,pcm,cur,up,down,channels,samples,format);
+    d+=j*stride;
+  }
+#endif
+  for(i=0;i<channels;i++)src[i]=buf+i*run;
+  for(;j<samples;j+=n,d+=n*stride){
+    n=samples-j;
+    if(n>run)n=run;
+    for(i=0;i<channels;i++)
+      _vorbis_lap(src[i],pcm[i]+j,cur[i]+j,up+j,down-j,n);
+    _ov_pcm_pack(d,src,channels,n,format);
+  }
+}
+
+#ifdef _V_SELFTEST
+
+/* Compare the SIMD packers with the C ones for every format, both
+   byte orders, one to eight channels and lengths that leave every
+   possible tail, on input that clips and includes NaN and infinity;
+   lapped, too, against lapping in C first. */
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <math.h>
+
+int main(void){
+#ifdef VORBIS_SIMD_X86
+  static const int formats[]={
+    OV_FMT_S16,OV_FMT_S16|OV_PCM_UNSIGNED,OV_FMT_S24,OV_FMT_S32,OV_FMT_FLOAT
+  };
+  float buf[8][64],cur[8][64],lap[8][64],w[64];
+  float *src[8],*csrc[8],*lsrc[8];
+  unsigned char a[8*64*4],b[8*64*4];
+  int f,big,ch,i,failed=0;
+  long n,j;
+
+  if(!(_vorbis_cpu_flags()&VORBIS_CPU_SSE2)){
+    fprintf(stderr,"no SSE2; nothing to test\n");
+    return 0;
+  }
+
+  srand(1);
+  for(i=0;i<8;i++){
+    src[i]=buf[i];
+    csrc[i]=cur[i];
+    lsrc[i]=lap[i];
+    for(j=0;j<64;j++){
+      buf[i][j]=(rand()/(float)RAND_MAX-.5f)*3.f;
+      cur[i][j]=(rand()/(float)RAND_MAX-.5f)*3.f;
+    }
+  }
+  for(j=0;j<64;j++)
+    w[j]=sin(.5*M_PI*sin(M_PI*(j+.5)/128)*sin(M_PI*(j+.5)/128));
+  buf[0][1]=1.f;
+  buf[0][2]=-1.f;
+  buf[0][3]=.5f/32768.f;   /* ties round to even */
+  buf[0][4]=1.5f/32768.f;
+  buf[1][1]=(float)HUGE_VAL;
+  buf[1][2]=-(float)HUGE_VAL;
+  buf[1][3]=sqrt(-1.);
+  buf[1][5]=1e10f;
+  buf[2][0]=-1e10f;
+  buf[2][7]=.99999994f;
+
+  for(f=0;f<(int)(sizeof(formats)/sizeof(*formats));f++)
+    for(big=0;big<2;big++)
+      for(ch=1;ch<=8;ch++)
+        for(n=0;n<=37;n++){
+          int format=formats[f]|(big?OV_FMT_BIGENDIAN:0);
+          long bytes=n*ch*_ov_pcm_width(format);
+          memset(a,0x55,sizeof(a));
+          memset(b,0x55,sizeof(b));
+          _pack_c(a,src,ch,n,format);
+          _pack_sse2(b,src,ch,n,format);
+          if(memcmp(a,b,sizeof(a))){
+            for(j=0;j<(long)sizeof(a) && a[j]==b[j];j++);
+            fprintf(stderr,"format %x, %d channels, %ld samples: "
+                    "differs at byte %ld of %ld\n",format,ch,n,j,bytes);
+            failed=1;
+          }
+
+          for(i=0;i<ch;i++)
+            for(j=0;j<n;j++)
+              lap[i][j]=buf[i][j]*w[63-j]+cur[i][j]*w[j];
+          memset(a,0x55,sizeof(a));
+          memset(b,0x55,sizeof(b));
+          _pack_c(a,lsrc,ch,n,format);
+          _ov_pcm_pack_lap(b,src,csrc,w,w+63,ch,n,format);
+          if(memcmp(a,b,sizeof(a))){
+            for(j=0;j<(long)sizeof(a) && a[j]==b[j];j++);
+            fprintf(stderr,"lapped format %x, %d channels, %ld samples: "
+                    "differs at byte %ld of %ld\n",format,ch,n,j,bytes);
+            failed=1;
+          }
+        }
+
+  if(failed)return 1;
+  fprintf(stderr,"SSE2 packing and lapping match C\n");
+#endif
+  return 0;
+}
+
+#endif
@@ -0,0 +1,32 @@
+/********************************************************************
+ *                                                                  *
+ * THIS FILE IS PART OF THE OggVorbis SOFTWARE CODEC SOURCE CODE.   *
+ * USE, DISTRIBUTION AND REPRODUCTION OF THIS LIBRARY SOURCE IS     *
+ * GOVERNED BY A BSD-STYLE SOURCE LICENSE INCLUDED WITH THIS SOURCE *
+ * IN 'COPYING'. PLEASE READ THESE TERMS BEFORE DISTRIBUTING.       *
+ *                                                                  *
+ * THE OggVorbis SOURCE CODE IS (C) COPYRIGHT 1994-2009             *
+ * by the Xiph.Org Foundation http://www.xiph.org/                  *
+ *                                                                  *
+ ********************************************************************
+
+ function: planar float to interleaved PCM packing for ov_read
+
+ ********************************************************************/
+
+#ifndef _OV_PCMPACK_H_
+#define _OV_PCMPACK_H_
+
+/* formats are the OV_FMT_* codes and flags of vorbisfile.h, plus
+   offset binary 16 bit samples for ov_read(..., sgned=0, ...) */
+#define OV_PCM_UNSIGNED 0x1000
+
+extern int  _ov_pcm_width(int format);
+extern void _ov_pcm_pack(void *dst,float **src,int channels,long samples,
+                         int format);
+/* the same for the lapped pcm[c][i]*down[-i]+cur[c][i]*up[i] */
+extern void _ov_pcm_pack_lap(void *dst,float **pcm,float **cur,
+                             const float *up,const float *down,
+                             int channels,long samples,int format);
+
+#endif
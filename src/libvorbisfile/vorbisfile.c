@@ -29,6 +29,22 @@
 
 #include "os.h"
 #include "misc.h"
+#include "thread.h"
+#include "profile.h"
+#include "lap.h"
+#include "pcmpack.h"
+
+#if defined(_WIN32)
+#  define WIN32_LEAN_AND_MEAN
+#  define NOMINMAX
+#  include <windows.h>
+#else
+#  include <sys/types.h>
+#  include <sys/stat.h>
+#  include <sys/mman.h>
+#  include <fcntl.h>
+#  include <unistd.h>
+#endif
 
 /* A 'chained bitstream' is a Vorbis bitstream that contains more than
    one logical bitstream arranged end to end (the only form of Ogg
@@ -63,14 +79,143 @@
 */
 #define CHUNKSIZE 65536 /* greater-than-page-size granularity seeking */
 #define READSIZE 2048 /* a smaller read size is needed for low-rate streaming. */
+#define READMAX 65536 /* default ceiling for sequential read-ahead */
+#define MEMWINDOW (1L<<29) /* most of a memory image attached at once */
+#define INDEXBYTES 65536 /* default memory cap for the seek index */
+#define PAGEMAX 65307 /* largest possible Ogg page */
+#define PAGEBODYMAX 65025 /* and its largest body */
+
+/* Files opened with ov_open_memory()/ov_open_mmap() are a datasource
+   of their own: callbacks that make the image look like a file to the
+   open/seek logic, but _get_data() attaches the ogg_sync_state to the
+   image rather than reading it, and pages go into the stream state by
+   reference, so packets are decoded in place. */
+
+typedef struct {
+  const unsigned char *data;
+  ogg_int64_t          size;
+  ogg_int64_t          pos;
+  int                  mapped;
+} ov_memsource;
+
+static size_t _ov_mem_read(void *ptr,size_t size,size_t nmemb,void *ds){
+  ov_memsource *m=ds;
+  ogg_int64_t left=m->size-m->pos;
+  size_t bytes;
+  if(size==0 || left<=0)return 0;
+  /* the image is in memory, so what is left of it fits a size_t */
+  bytes=(size_t)left;
+  if(nmemb>bytes/size)nmemb=bytes/size;
+  memcpy(ptr,m->data+m->pos,nmemb*size);
+  m->pos+=nmemb*size;
+  return nmemb;
+}
+
+static int _ov_mem_seek(void *ds,ogg_int64_t offset,int whence){
+  ov_memsource *m=ds;
+  switch(whence){
+  case SEEK_CUR:
+    offset+=m->pos;
+    break;
+  case SEEK_END:
+    offset+=m->size;
+    break;
+  }
+  if(offset<0)return -1;
+  m->pos=offset;
+  return 0;
+}
+
+static long _ov_mem_tell(void *ds){
+  return (long)((ov_memsource *)ds)->pos;
+}
+
+static int _ov_mem_close(void *ds){
+  ov_memsource *m=ds;
+  if(m->mapped){
+#if defined(_WIN32)
+    UnmapViewOfFile((void *)m->data);
+#else
+    munmap((void *)m->data,(size_t)m->size);
+#endif
+  }
+  _ogg_free(m);
+  return 0;
+}
+
+#define _ov_is_memory(vf) ((vf)->callbacks.read_func==_ov_mem_read)
+
+/* pages of memory images stay put; don't copy them into the stream */
+static int _ov_pagein(OggVorbis_File *vf,ogg_stream_state *os,ogg_page *og){
+  const ogg_allocator *prev=ogg_allocator_use(vf->allocator);
+  int ret;
+  if(_ov_is_memory(vf))
+    ret=ogg_stream_pagein_ref(os,og);
+  else
+    ret=ogg_stream_pagein(os,og);
+  ogg_allocator_use(prev);
+  return ret;
+}
+
+/* The read-ahead window starts at read_min after every seek, so
+   bisection probes stay cheap, and doubles each time a read comes
+   back full, up to read_max.  A short read means the source delivers
+   at its own pace (a live stream), so the window drops back.  A read
+   on a non-seekable source can block until it is satisfied, so there
+   the window is also held to about a quarter second of audio at the
+   nominal bitrate to keep latency as it was with fixed small reads. */
+static long _read_limit(OggVorbis_File *vf){
+  long max=vf->read_max;
+  long min=vf->read_min;
+
+  if(!vf->seekable){
+    long rate=0;
+    if(vf->ready_state>=STREAMSET && vf->vi){
+      vorbis_info *vi=vf->vi;
+      rate=vi->bitrate_nominal>0?vi->bitrate_nominal:vi->bitrate_upper;
+    }
+    if(rate<=0)return min;
+    if(max>rate/32)max=rate/32;
+  }
+  return max<min?min:max;
+}
 
 static long _get_data(OggVorbis_File *vf){
   errno=0;
   if(!(vf->callbacks.read_func))return(-1);
+  if(vf->datasource && _ov_is_memory(vf)){
+    /* widen the attached window past the bytes not yet consumed */
+    ov_memsource *m=vf->datasource;
+    long pending=vf->oy.fill-vf->oy.returned;
+    ogg_int64_t bytes=m->size-m->pos;
+    if(bytes<=0)return(0);
+    if(bytes>MEMWINDOW)bytes=MEMWINDOW;
+    if(ogg_sync_attach(&vf->oy,(const char *)m->data+m->pos-pending,
+                       pending+(long)bytes))return(-1);
+    m->pos+=bytes;
+    if(vf->buffer_end>=0)vf->buffer_end+=bytes;
+    return((long)bytes);
+  }
   if(vf->datasource){
-    char *buffer=ogg_sync_buffer(&vf->oy,READSIZE);
-    long bytes=(vf->callbacks.read_func)(buffer,1,READSIZE,vf->datasource);
-    if(bytes>0)ogg_sync_wrote(&vf->oy,bytes);
+    long min=vf->read_min;
+    long want=vf->read_window;
+    char *buffer=ogg_sync_buffer(&vf->oy,want);
+    long bytes;
+
+    if(!buffer)return(-1);
+    bytes=(vf->callbacks.read_func)(buffer,1,want,vf->datasource);
+    vf->iostats.read_calls++;
+    if(bytes>0){
+      ogg_sync_wrote(&vf->oy,bytes);
+      if(vf->buffer_end>=0)vf->buffer_end+=bytes;
+      vf->iostats.read_bytes+=bytes;
+      if(bytes==want){
+        long max=_read_limit(vf);
+        want=want>max/2?max:want*2;
+      }else
+        want=min;
+      vf->read_window=vf->iostats.window=want;
+    }
     if(bytes==0 && errno)return(-1);
     return(bytes);
   }else
@@ -80,11 +225,22 @@ static long _get_data(OggVorbis_File *vf){
 /* save a tiny smidge of verbosity to make the code more readable */
 static int _seek_helper(OggVorbis_File *vf,ogg_int64_t offset){
   if(vf->datasource){
+    /* the page search often steps back to a page it has just read
+       past; if the bytes are still in the sync buffer, reuse them
+       rather than going back to the source */
+    ogg_int64_t held=vf->buffer_end-vf->oy.fill;
+    if(vf->buffer_end>=0 && offset>=held && offset<vf->buffer_end &&
+       !ogg_sync_seek(&vf->oy,(long)(offset-held))){
+      vf->offset=offset;
+      return 0;
+    }
     if(!(vf->callbacks.seek_func)||
        (vf->callbacks.seek_func)(vf->datasource, offset, SEEK_SET) == -1)
       return OV_EREAD;
-    vf->offset=offset;
+    vf->offset=vf->buffer_end=offset;
     ogg_sync_reset(&vf->oy);
+    vf->iostats.seek_calls++;
+    vf->read_window=vf->iostats.window=vf->read_min;
   }else{
     /* shouldn't happen unless someone writes a broken callback */
     return OV_EFAULT;
@@ -92,6 +248,126 @@ static int _seek_helper(OggVorbis_File *vf,ogg_int64_t offset){
   return 0;
 }
 
+/* Every page with a granulepos that _get_next_page() returns from a
+   seekable file, whether during open, bisection or plain decode, is
+   noted in a sorted index.  ov_pcm_seek_page() brackets its search
+   with the nearest known pages on either side of the target, which
+   often leaves nothing to bisect.  When the index reaches its cap,
+   every other entry is dropped, so coverage stays even but coarser.
+   Pages of other logical streams muxed into a link are noted too (the
+   links are not known yet while opening); a seek looks only at the
+   pages of the stream it is in. */
+
+struct ov_seekentry {
+  ogg_int64_t  offset;
+  ogg_int64_t  granulepos;
+  ogg_uint32_t serialno;
+  ogg_uint32_t bytes;      /* page length; offset+bytes is the next page */
+};
+
+static void _index_add(OggVorbis_File *vf,ogg_int64_t offset,ogg_page *og){
+  struct ov_seekentry *e;
+  ogg_int64_t granulepos=ogg_page_granulepos(og);
+  long lo=0,hi=vf->index_fill;
+
+  if(granulepos==-1 || vf->index_max<=0)return;
+
+  /* sequential decode appends; anything else finds its place */
+  if(hi==0 || vf->index[hi-1].offset<offset){
+    lo=hi;
+  }else{
+    while(lo<hi){
+      long mid=(lo+hi)>>1;
+      if(vf->index[mid].offset<offset)lo=mid+1;
+      else hi=mid;
+    }
+    if(lo<vf->index_fill && vf->index[lo].offset==offset)return;
+  }
+
+  if(vf->index_fill>=vf->index_max){
+    long i,j;
+    if(vf->index_max<2)return;
+    for(i=j=0;i<vf->index_fill;i+=2)
+      vf->index[j++]=vf->index[i];
+    lo=(lo+1)>>1;
+    vf->index_fill=j;
+  }
+  if(vf->index_fill>=vf->index_storage){
+    long storage=vf->index_storage?vf->index_storage*2:64;
+    const ogg_allocator *prev=ogg_allocator_use(vf->allocator);
+    void *ret;
+    if(storage>vf->index_max)storage=vf->index_max;
+    ret=_ogg_realloc(vf->index,storage*sizeof(*vf->index));
+    ogg_allocator_use(prev);
+    if(!ret)return;
+    vf->index=ret;
+    vf->index_storage=storage;
+  }
+
+  e=vf->index+lo;
+  if(lo<vf->index_fill)
+    memmove(e+1,e,(vf->index_fill-lo)*sizeof(*e));
+  e->offset=offset;
+  e->granulepos=granulepos;
+  e->serialno=(ogg_uint32_t)ogg_page_serialno(og);
+  e->bytes=(ogg_uint32_t)(og->header_len+og->body_len);
+  vf->index_fill++;
+}
+
+/* narrow [*begin,*end) for a search in the link for serialno to the
+   known pages closest to target on either side; *best and *begintime
+   describe the lower page as ov_pcm_seek_page() expects */
+static void _index_bracket(OggVorbis_File *vf,long serialno,
+                           ogg_int64_t target,
+                           ogg_int64_t *begin,ogg_int64_t *end,
+                           ogg_int64_t *best,
+                           ogg_int64_t *begintime,ogg_int64_t *endtime){
+  struct ov_seekentry *idx=vf->index;
+  long lo=0,hi=vf->index_fill,first,last,i;
+
+  /* entries inside the link */
+  while(lo<hi){
+    long mid=(lo+hi)>>1;
+    if(idx[mid].offset<*begin)lo=mid+1;
+    else hi=mid;
+  }
+  first=lo;
+  hi=vf->index_fill;
+  while(lo<hi){
+    long mid=(lo+hi)>>1;
+    if(idx[mid].offset<*end)lo=mid+1;
+    else hi=mid;
+  }
+  last=lo;
+
+  /* granulepos rises with offset only within one stream, and other
+     streams may be muxed into the link, so walk the link's entries
+     for this one: the last page before the target and the first at
+     or past it.  Each side is used only if it really brackets the
+     target; otherwise that end is left to plain bisection */
+  lo=hi=-1;
+  for(i=first;i<last;i++){
+    if(idx[i].serialno!=(ogg_uint32_t)serialno)continue;
+    if(idx[i].granulepos>=target){
+      hi=i;
+      break;
+    }
+    lo=i;
+  }
+
+  if(lo>=0 && idx[lo].granulepos>=*begintime &&
+     idx[lo].granulepos<target && idx[lo].offset+idx[lo].bytes<=*end){
+    *best=idx[lo].offset;
+    *begin=idx[lo].offset+idx[lo].bytes;
+    *begintime=idx[lo].granulepos;
+  }
+  if(hi>=0 && idx[hi].granulepos>=target &&
+     idx[hi].granulepos<=*endtime && idx[hi].offset>=*begin){
+    *end=idx[hi].offset;
+    *endtime=idx[hi].granulepos;
+  }
+}
+
 /* The read/seek functions track absolute position within the stream */
 
 /* from the head of the stream, get the next page.  boundary specifies
@@ -131,6 +407,7 @@ static ogg_int64_t _get_next_page(OggVorbis_File *vf,ogg_page *og,
            advance the internal offset past the page end */
         ogg_int64_t ret=vf->offset;
         vf->offset+=more;
+        if(vf->seekable)_index_add(vf,ret,og);
         return(ret);
 
       }
@@ -278,9 +555,9 @@ static ogg_int64_t _get_prev_page_serial(OggVorbis_File *vf,
 
 /* uses the local ogg_stream storage in vf; this is important for
    non-streaming input sources */
-static int _fetch_headers(OggVorbis_File *vf,vorbis_info *vi,vorbis_comment *vc,
-                          long **serialno_list, int *serialno_n,
-                          ogg_page *og_ptr){
+static int _fetch_headers1(OggVorbis_File *vf,vorbis_info *vi,vorbis_comment *vc,
+                           long **serialno_list, int *serialno_n,
+                           ogg_page *og_ptr){
   ogg_page og;
   ogg_packet op;
   int i,ret;
@@ -318,7 +595,7 @@ static int _fetch_headers(OggVorbis_File *vf,vorbis_info *vi,vorbis_comment *vc,
       /* we don't have a vorbis stream in this link yet, so begin
          prospective stream setup. We need a stream to get packets */
       ogg_stream_reset_serialno(&vf->os,ogg_page_serialno(og_ptr));
-      ogg_stream_pagein(&vf->os,og_ptr);
+      _ov_pagein(vf,&vf->os,og_ptr);
 
       if(ogg_stream_packetout(&vf->os,&op) > 0 &&
          vorbis_synthesis_idheader(&op)){
@@ -346,7 +623,7 @@ static int _fetch_headers(OggVorbis_File *vf,vorbis_info *vi,vorbis_comment *vc,
       /* if this page also belongs to our vorbis stream, submit it and break */
       if(vf->ready_state==STREAMSET &&
          vf->os.serialno == ogg_page_serialno(og_ptr)){
-        ogg_stream_pagein(&vf->os,og_ptr);
+        _ov_pagein(vf,&vf->os,og_ptr);
         break;
       }
     }
@@ -385,7 +662,7 @@ static int _fetch_headers(OggVorbis_File *vf,vorbis_info *vi,vorbis_comment *vc,
 
         /* if this page belongs to the correct stream, go parse it */
         if(vf->os.serialno == ogg_page_serialno(og_ptr)){
-          ogg_stream_pagein(&vf->os,og_ptr);
+          _ov_pagein(vf,&vf->os,og_ptr);
           break;
         }
 
@@ -414,6 +691,16 @@ static int _fetch_headers(OggVorbis_File *vf,vorbis_info *vi,vorbis_comment *vc,
   return ret;
 }
 
+/* the headers of a link come from vf's allocator, whoever reads them */
+static int _fetch_headers(OggVorbis_File *vf,vorbis_info *vi,vorbis_comment *vc,
+                          long **serialno_list, int *serialno_n,
+                          ogg_page *og_ptr){
+  const ogg_allocator *prev=ogg_allocator_use(vf->allocator);
+  int ret=_fetch_headers1(vf,vi,vc,serialno_list,serialno_n,og_ptr);
+  ogg_allocator_use(prev);
+  return ret;
+}
+
 /* Starting from current cursor position, get initial PCM offset of
    next page.  Consumes the page in the process without decoding
    audio, however this is only called during stream parsing upon
@@ -434,7 +721,7 @@ static ogg_int64_t _initial_pcmoffset(OggVorbis_File *vf, vorbis_info *vi){
     if(ogg_page_serialno(&og)!=serialno) continue;
 
     /* count blocksizes of all frames in the page */
-    ogg_stream_pagein(&vf->os,&og);
+    _ov_pagein(vf,&vf->os,&og);
     while((result=ogg_stream_packetout(&vf->os,&op))){
       if(result>0){ /* ignore holes */
         long thisblock=vorbis_packet_blocksize(vi,&op);
@@ -596,20 +883,60 @@ static int _bisect_forward_serialno(OggVorbis_File *vf,
   return(0);
 }
 
+/* Reserve the worst case storage of decoding the current link, so
+   that reads stay clear of the heap; see ov_realtime().  Once a page
+   is in and its packets are out, the stream state holds at most the
+   start of a packet, and the sync buffer at most the start of a page;
+   _seek_helper() may leave a full read of bytes to reuse on top of
+   that. */
+static int _realtime_reserve(OggVorbis_File *vf){
+  long packet=vorbis_synthesis_reserve(&vf->vb);
+  const ogg_allocator *prev;
+  int ret=0;
+  if(packet<0)return OV_EFAULT;
+  if(ogg_sync_reserve(&vf->oy,2*vf->read_max+PAGEMAX))
+    return OV_EFAULT;
+
+  prev=ogg_allocator_use(vf->allocator);
+  if(ogg_stream_reserve(&vf->os,packet+PAGEBODYMAX,packet/255+1+255))
+    ret=OV_EFAULT;
+  else if(vf->seekable && vf->index_storage<vf->index_max){
+    void *index=_ogg_realloc(vf->index,vf->index_max*sizeof(*vf->index));
+    if(index){
+      vf->index=index;
+      vf->index_storage=vf->index_max;
+    }else
+      ret=OV_EFAULT;
+  }
+  ogg_allocator_use(prev);
+  return ret;
+}
+
 static int _make_decode_ready(OggVorbis_File *vf){
+  const ogg_allocator *prev;
+  vorbis_info *vi;
+  int ret;
   if(vf->ready_state>STREAMSET)return 0;
   if(vf->ready_state<STREAMSET)return OV_EFAULT;
-  if(vf->seekable){
-    if(vorbis_synthesis_init(&vf->vd,vf->vi+vf->current_link))
-      return OV_EBADLINK;
-  }else{
-    if(vorbis_synthesis_init(&vf->vd,vf->vi))
-      return OV_EBADLINK;
-  }
+  vi=vf->seekable?vf->vi+vf->current_link:vf->vi;
+  /* the decoder keeps vf's allocator for its own later allocations */
+  prev=ogg_allocator_use(vf->allocator);
+  ret=vorbis_synthesis_init(&vf->vd,vi);
+  ogg_allocator_use(prev);
+  if(ret)
+    return OV_EBADLINK;
+  /* the read calls do the overlap-add as they pack; see _ov_pack() */
+  _vorbis_synthesis_lazy(&vf->vd,1);
+  if(vf->pool)
+    _vorbis_synthesis_pool(&vf->vd,vf->pool);
+  if(vf->downmix && vi->channels==vf->downmix_in)
+    vorbis_synthesis_downmix(&vf->vd,vf->downmix_out,vf->downmix);
   vorbis_block_init(&vf->vd,&vf->vb);
   vf->ready_state=INITSET;
   vf->bittrack=0.f;
   vf->samptrack=0.f;
+  /* should this fail, decode goes on; it may just allocate */
+  if(vf->realtime)_realtime_reserve(vf);
   return 0;
 }
 
@@ -628,6 +955,7 @@ static int _open_seekable2(OggVorbis_File *vf){
   if(vf->callbacks.seek_func && vf->callbacks.tell_func){
     (vf->callbacks.seek_func)(vf->datasource,0,SEEK_END);
     vf->offset=vf->end=(vf->callbacks.tell_func)(vf->datasource);
+    vf->buffer_end=-1;
   }else{
     vf->offset=vf->end=-1;
   }
@@ -655,8 +983,32 @@ static int _open_seekable2(OggVorbis_File *vf){
   return(ov_raw_seek(vf,dataoffset));
 }
 
+#ifdef VORBIS_PROFILE
+static void _profile_add(vorbis_profile *to,const vorbis_profile *from){
+  vorbis_stage *t=(vorbis_stage *)to;
+  const vorbis_stage *f=(const vorbis_stage *)from;
+  int i;
+  for(i=0;i<(int)(sizeof(*to)/sizeof(*t));i++){
+    t[i].ns+=f[i].ns;
+    t[i].calls+=f[i].calls;
+  }
+}
+#endif
+
+/* keep the stage timings of a decoder that is about to go */
+static void _profile_fold(OggVorbis_File *vf){
+#ifdef VORBIS_PROFILE
+  vorbis_profile p;
+  if(vf->ready_state==INITSET && !vorbis_synthesis_profile(&vf->vd,&p,0))
+    _profile_add(&vf->profile.decode,&p);
+#else
+  (void)vf;
+#endif
+}
+
 /* clear out the current logical bitstream decoder */
 static void _decode_clear(OggVorbis_File *vf){
+  _profile_fold(vf);
   vorbis_dsp_clear(&vf->vd);
   vorbis_block_clear(&vf->vb);
   vf->ready_state=OPENED;
@@ -673,10 +1025,10 @@ static void _decode_clear(OggVorbis_File *vf){
             1) got a packet
 */
 
-static int _fetch_and_process_packet(OggVorbis_File *vf,
-                                     ogg_packet *op_in,
-                                     int readp,
-                                     int spanp){
+static int _fetch_and_process_packet1(OggVorbis_File *vf,
+                                      ogg_packet *op_in,
+                                      int readp,
+                                      int spanp){
   ogg_page og;
 
   /* handle one packet.  Try to fetch it from current stream state */
@@ -863,11 +1215,22 @@ static int _fetch_and_process_packet(OggVorbis_File *vf,
 
     /* the buffered page is the data we want, and we're ready for it;
        add it to the stream state */
-    ogg_stream_pagein(&vf->os,&og);
+    _ov_pagein(vf,&vf->os,&og);
 
   }
 }
 
+static int _fetch_and_process_packet(OggVorbis_File *vf,
+                                     ogg_packet *op_in,
+                                     int readp,
+                                     int spanp){
+  int ret;
+  VORBIS_CLOCK(t);
+  ret=_fetch_and_process_packet1(vf,op_in,readp,spanp);
+  VORBIS_STAGE(&vf->profile,packet,t);
+  return(ret);
+}
+
 /* if, eg, 64 bit stdio is configured by default, this will build with
    fseek64 */
 static int _fseek64_wrap(FILE *f,ogg_int64_t off,int whence){
@@ -883,8 +1246,14 @@ static int _ov_open1(void *f,OggVorbis_File *vf,const char *initial,
   int ret;
 
   memset(vf,0,sizeof(*vf));
+  vf->allocator=ogg_allocator_current();
   vf->datasource=f;
   vf->callbacks = callbacks;
+  vf->read_min=READSIZE;
+  vf->read_max=READMAX;
+  vf->read_window=vf->iostats.window=READSIZE;
+  vf->buffer_end=-1;
+  vf->index_max=INDEXBYTES/sizeof(*vf->index);
 
   /* init the framing state */
   ogg_sync_init(&vf->oy);
@@ -938,7 +1307,9 @@ static int _ov_open2(OggVorbis_File *vf){
   if(vf->ready_state != PARTOPEN) return OV_EINVAL;
   vf->ready_state=OPENED;
   if(vf->seekable){
+    const ogg_allocator *prev=ogg_allocator_use(vf->allocator);
     int ret=_open_seekable2(vf);
+    ogg_allocator_use(prev);
     if(ret){
       vf->datasource=NULL;
       ov_clear(vf);
@@ -957,6 +1328,7 @@ int ov_clear(OggVorbis_File *vf){
     vorbis_block_clear(&vf->vb);
     vorbis_dsp_clear(&vf->vd);
     ogg_stream_clear(&vf->os);
+    _vorbis_pool_destroy(vf->pool);
 
     if(vf->vi && vf->links){
       int i;
@@ -971,6 +1343,8 @@ int ov_clear(OggVorbis_File *vf){
     if(vf->pcmlengths)_ogg_free(vf->pcmlengths);
     if(vf->serialnos)_ogg_free(vf->serialnos);
     if(vf->offsets)_ogg_free(vf->offsets);
+    if(vf->index)_ogg_free(vf->index);
+    if(vf->downmix)_ogg_free(vf->downmix);
     ogg_sync_clear(&vf->oy);
     if(vf->datasource && vf->callbacks.close_func)
       (vf->callbacks.close_func)(vf->datasource);
@@ -1019,32 +1393,160 @@ int ov_fopen(const char *path,OggVorbis_File *vf){
 }
 
 
+/* Open a file image the app holds in memory.  The bytes are used in
+   place, not copied, and must stay valid and unchanged until
+   ov_clear(). */
+int ov_open_memory(const void *data,size_t bytes,OggVorbis_File *vf){
+  ov_callbacks callbacks = {
+    _ov_mem_read,
+    _ov_mem_seek,
+    _ov_mem_close,
+    _ov_mem_tell
+  };
+  ov_memsource *m;
+  int ret;
+
+  if(!data && bytes)return(OV_EFAULT);
+  m=_ogg_calloc(1,sizeof(*m));
+  if(!m)return(OV_EFAULT);
+  m->data=data;
+  m->size=bytes;
+
+  ret=ov_open_callbacks(m,vf,NULL,0,callbacks);
+  if(ret)_ogg_free(m);
+  return ret;
+}
+
+/* Like ov_fopen(), but maps the file into memory and decodes it in
+   place as ov_open_memory() does; the mapping is released by
+   ov_clear(). */
+int ov_open_mmap(const char *path,OggVorbis_File *vf){
+  ov_callbacks callbacks = {
+    _ov_mem_read,
+    _ov_mem_seek,
+    _ov_mem_close,
+    _ov_mem_tell
+  };
+  ov_memsource *m=_ogg_calloc(1,sizeof(*m));
+  void *map=NULL;
+  ogg_int64_t size=0;
+  int ret;
+
+  if(!m)return(OV_EFAULT);
+
+#if defined(_WIN32)
+  {
+    HANDLE file,mapping;
+    LARGE_INTEGER li;
+#if defined(WINAPI_FAMILY) && !WINAPI_FAMILY_PARTITION(WINAPI_PARTITION_DESKTOP)
+    WCHAR wpath[MAX_PATH];
+    if(!MultiByteToWideChar(CP_UTF8,0,path,-1,wpath,MAX_PATH)){
+      _ogg_free(m);
+      return -1;
+    }
+    file=CreateFile2(wpath,GENERIC_READ,FILE_SHARE_READ,OPEN_EXISTING,NULL);
+#else
+    file=CreateFileA(path,GENERIC_READ,FILE_SHARE_READ,NULL,OPEN_EXISTING,
+                     FILE_ATTRIBUTE_NORMAL,NULL);
+#endif
+    if(file==INVALID_HANDLE_VALUE){
+      _ogg_free(m);
+      return -1;
+    }
+    if(!GetFileSizeEx(file,&li) || li.QuadPart==0){
+      CloseHandle(file);
+      _ogg_free(m);
+      return -1;
+    }
+    size=li.QuadPart;
+#if defined(WINAPI_FAMILY) && !WINAPI_FAMILY_PARTITION(WINAPI_PARTITION_DESKTOP)
+    mapping=CreateFileMappingFromApp(file,NULL,PAGE_READONLY,0,NULL);
+    if(mapping)map=MapViewOfFileFromApp(mapping,FILE_MAP_READ,0,0);
+#else
+    mapping=CreateFileMappingA(file,NULL,PAGE_READONLY,0,0,NULL);
+    if(mapping)map=MapViewOfFile(mapping,FILE_MAP_READ,0,0,0);
+#endif
+    /* the view keeps the file open */
+    if(mapping)CloseHandle(mapping);
+    CloseHandle(file);
+    if(!map){
+      _ogg_free(m);
+      return -1;
+    }
+  }
+#else
+  {
+    struct stat st;
+    int fd=open(path,O_RDONLY);
+    if(fd<0){
+      _ogg_free(m);
+      return -1;
+    }
+    if(fstat(fd,&st) || st.st_size==0){
+      close(fd);
+      _ogg_free(m);
+      return -1;
+    }
+    size=st.st_size;
+    map=mmap(NULL,(size_t)size,PROT_READ,MAP_SHARED,fd,0);
+    close(fd);
+    if(map==MAP_FAILED){
+      _ogg_free(m);
+      return -1;
+    }
+  }
+#endif
+
+  m->data=map;
+  m->size=size;
+  m->mapped=1;
+  ret=ov_open_callbacks(m,vf,NULL,0,callbacks);
+  /* a failed open leaves the datasource open */
+  if(ret)_ov_mem_close(m);
+  return ret;
+}
+
 /* cheap hack for game usage where downsampling is desirable; there's
    no need for SRC as we can just do it cheaply in libvorbis. */
 
 int ov_halfrate(OggVorbis_File *vf,int flag){
-  int i;
+  return ov_rate_shift(vf,flag?1:0);
+}
+
+/* the same taken further, for previews and waveform overviews: decode
+   at 1/2, 1/4 or 1/8 of the rate (see vorbis_synthesis_rate_shift()).
+   Positions, seeks and lengths all stay in full rate samples; reads
+   return ov_info()->rate>>shift samples a second. */
+int ov_rate_shift(OggVorbis_File *vf,int shift){
+  int i,reseek=0,ret=0;
   if(vf->vi==NULL)return OV_EINVAL;
+  if(shift<0)return OV_EINVAL;
   if(vf->ready_state>STREAMSET){
     /* clear out stream state; dumping the decode machine is needed to
        reinit the MDCT lookups. */
+    _profile_fold(vf);
     vorbis_dsp_clear(&vf->vd);
     vorbis_block_clear(&vf->vb);
     vf->ready_state=STREAMSET;
-    if(vf->pcm_offset>=0){
-      ogg_int64_t pos=vf->pcm_offset;
-      vf->pcm_offset=-1; /* make sure the pos is dumped if unseekable */
-      ov_pcm_seek(vf,pos);
-    }
+    reseek=1;
   }
 
   for(i=0;i<vf->links;i++){
-    if(vorbis_synthesis_halfrate(vf->vi+i,flag)){
-      if(flag) ov_halfrate(vf,0);
-      return OV_EINVAL;
+    if(vorbis_synthesis_rate_shift(vf->vi+i,shift)){
+      for(i=0;i<vf->links;i++)
+        vorbis_synthesis_rate_shift(vf->vi+i,0);
+      ret=OV_EINVAL;
+      break;
     }
   }
-  return 0;
+
+  /* only now, so the decoder the seek builds has the new rate */
+  if(reseek && vf->pcm_offset>=0){
+    ogg_int64_t pos=vf->pcm_offset;
+    vf->pcm_offset=-1; /* make sure the pos is dumped if unseekable */
+    ov_pcm_seek(vf,pos);
+  }
+  return ret;
 }
 
 int ov_halfrate_p(OggVorbis_File *vf){
@@ -1052,6 +1554,193 @@ int ov_halfrate_p(OggVorbis_File *vf){
   return vorbis_synthesis_halfrate_p(vf->vi);
 }
 
+/* Spread each block's per channel synthesis over up to threads
+   threads (see vorbis_synthesis_threads()); 0 or 1 decodes on the
+   calling thread only, as by default.  The workers are started here
+   and kept, across links and seeks, until the thread count changes
+   or ov_clear(). */
+int ov_threads(OggVorbis_File *vf,int threads){
+  vorbis_pool *pool=NULL;
+  if(vf->ready_state<OPENED)return OV_EINVAL;
+  if(threads<1)threads=1;
+  if(threads==(vf->threads>1?vf->threads:1))return 0;
+
+  if(threads>1){
+    const ogg_allocator *prev=ogg_allocator_use(vf->allocator);
+    pool=_vorbis_pool_create(threads-1);
+    ogg_allocator_use(prev);
+    if(!pool)return OV_EFAULT;
+  }
+  if(vf->ready_state==INITSET)
+    _vorbis_synthesis_pool(&vf->vd,pool);
+  _vorbis_pool_destroy(vf->pool);
+  vf->pool=pool;
+  vf->threads=threads;
+  return 0;
+}
+
+/* Have the links with in_channels channels decode to channels
+   channels instead, mixed by matrix: channels rows of in_channels
+   gains, row o giving output channel o as a weighted sum of the
+   stream's channels in Vorbis order.  The mix is done on the spectra
+   in libvorbis (see vorbis_synthesis_downmix()), so only the output
+   channels go through the inverse MDCT.  Other links decode as they
+   are; ov_channels() says which is which.  OV_FMT_WAVEORDER leaves
+   mixed output in row order.  A NULL matrix turns mixing off.  Mid
+   stream, this reseeks to the current position as ov_halfrate()
+   does. */
+int ov_downmix(OggVorbis_File *vf,int in_channels,int channels,
+               const float *matrix){
+  float *copy=NULL;
+  if(vf->ready_state<OPENED)return OV_EINVAL;
+  if(matrix){
+    const ogg_allocator *prev;
+    if(channels<1 || channels>in_channels)return OV_EINVAL;
+    prev=ogg_allocator_use(vf->allocator);
+    copy=_ogg_malloc(sizeof(*copy)*channels*in_channels);
+    ogg_allocator_use(prev);
+    if(!copy)return OV_EFAULT;
+    memcpy(copy,matrix,sizeof(*copy)*channels*in_channels);
+  }
+  if(vf->downmix)_ogg_free(vf->downmix);
+  vf->downmix=copy;
+  vf->downmix_in=copy?in_channels:0;
+  vf->downmix_out=copy?channels:0;
+
+  if(vf->ready_state==INITSET){
+    /* the decoder's overlap is in the old layout */
+    _decode_clear(vf);
+    vf->ready_state=STREAMSET;
+    if(vf->pcm_offset>=0){
+      ogg_int64_t pos=vf->pcm_offset;
+      vf->pcm_offset=-1;
+      ov_pcm_seek(vf,pos);
+    }
+  }
+  return 0;
+}
+
+/* the number of channels the read calls return for link i (-1 for
+   the current one); the link's own unless ov_downmix() applies */
+int ov_channels(OggVorbis_File *vf,int i){
+  vorbis_info *vi=ov_info(vf,i);
+  if(vi==NULL)return OV_EINVAL;
+  if(vf->downmix && vi->channels==vf->downmix_in)return vf->downmix_out;
+  return vi->channels;
+}
+
+/* Reserve up front, from the setup headers, all the storage decoding
+   the current link can need (decoder blocks, stream and sync buffers,
+   the seek index up to its cap), so that from then on the read calls
+   make no heap allocations.  The reservation is redone whenever the
+   decoder is rebuilt, which itself allocates: on moving to another
+   link, and on ov_rate_shift(), ov_downmix() and the like.  Streamed
+   (unseekable) chains also read new headers at each link, and packets
+   longer than the setup allows for, which no encoder writes, may
+   still grow the stream buffer.  Turning this off keeps what has been
+   reserved. */
+int ov_realtime(OggVorbis_File *vf,int flag){
+  int ret;
+  if(vf->ready_state<OPENED)return OV_EINVAL;
+  vf->realtime=flag;
+  if(!flag || vf->ready_state<STREAMSET)return 0;
+  ret=_make_decode_ready(vf);
+  if(ret)return ret;
+  return _realtime_reserve(vf);
+}
+
+/* Set the range of read sizes _get_data() may use; 0 selects the
+   default for either bound.  To take effect during the open, use
+   ov_test_callbacks(), then this, then ov_test_open(). */
+int ov_readahead(OggVorbis_File *vf,long min_bytes,long max_bytes){
+  if(vf->ready_state<PARTOPEN)return OV_EINVAL;
+  if(min_bytes<0 || max_bytes<0)return OV_EINVAL;
+  if(min_bytes==0)min_bytes=READSIZE;
+  if(max_bytes==0)max_bytes=min_bytes>READMAX?min_bytes:READMAX;
+  if(max_bytes<min_bytes)return OV_EINVAL;
+
+  vf->read_min=min_bytes;
+  vf->read_max=max_bytes;
+  if(vf->read_window<min_bytes)vf->read_window=min_bytes;
+  if(vf->read_window>max_bytes)vf->read_window=max_bytes;
+  vf->iostats.window=vf->read_window;
+  if(vf->realtime && vf->ready_state==INITSET)
+    return _realtime_reserve(vf);
+  return 0;
+}
+
+/* Cap the memory used by the seek index; 0 turns it off and drops
+   what has been collected. */
+int ov_seek_index(OggVorbis_File *vf,long max_bytes){
+  long max;
+  if(vf->ready_state<PARTOPEN)return OV_EINVAL;
+  if(max_bytes<0)return OV_EINVAL;
+
+  max=max_bytes/sizeof(*vf->index);
+  if(max<2){
+    if(vf->index)_ogg_free(vf->index);
+    vf->index=NULL;
+    vf->index_fill=vf->index_storage=max=0;
+  }
+  while(vf->index_fill>max){
+    long i,j;
+    for(i=j=0;i<vf->index_fill;i+=2)
+      vf->index[j++]=vf->index[i];
+    vf->index_fill=j;
+  }
+  vf->index_max=max;
+  if(vf->realtime && vf->ready_state==INITSET)
+    return _realtime_reserve(vf);
+  return 0;
+}
+
+/* probes and bytes of the last seek call, and totals since the open
+   or the last reset */
+int ov_seek_stats(OggVorbis_File *vf,ov_seekstats *stats,int reset){
+  if(vf->ready_state<PARTOPEN)return OV_EINVAL;
+  if(stats)*stats=vf->seekstats;
+  if(reset)memset(&vf->seekstats,0,sizeof(vf->seekstats));
+  return 0;
+}
+
+/* Copy the decode stage timings since the open or the last reset to
+   stats (if not NULL), then zero them if reset is set.  The framing
+   share of stats->packet is what is left after stats->decode.synthesis
+   and stats->decode.blockin.  Only builds with VORBIS_PROFILE defined
+   keep timings; others return OV_EIMPL. */
+int ov_profile_stats(OggVorbis_File *vf,ov_profile *stats,int reset){
+  if(vf->ready_state<PARTOPEN)return OV_EINVAL;
+#ifdef VORBIS_PROFILE
+  if(stats){
+    vorbis_profile p;
+    *stats=vf->profile;
+    if(vf->ready_state==INITSET && !vorbis_synthesis_profile(&vf->vd,&p,0))
+      _profile_add(&stats->decode,&p);
+  }
+  if(reset){
+    memset(&vf->profile,0,sizeof(vf->profile));
+    if(vf->ready_state==INITSET)vorbis_synthesis_profile(&vf->vd,NULL,1);
+  }
+  return 0;
+#else
+  (void)stats;
+  (void)reset;
+  return OV_EIMPL;
+#endif
+}
+
+/* datasource I/O counters since the open or the last reset */
+int ov_io_stats(OggVorbis_File *vf,ov_iostats *stats,int reset){
+  if(vf->ready_state<PARTOPEN)return OV_EINVAL;
+  if(stats)*stats=vf->iostats;
+  if(reset){
+    vf->iostats.read_calls=0;
+    vf->iostats.read_bytes=0;
+    vf->iostats.seek_calls=0;
+  }
+  return 0;
+}
+
 /* Only partially open the vorbis file; test for Vorbisness, and load
    the headers for the first chain.  Do not seek (although test for
    seekability).  Use ov_test_open to finish opening the file, else
@@ -1223,6 +1912,23 @@ double ov_time_total(OggVorbis_File *vf,int i){
   }
 }
 
+/* Seek calls nest (ov_pcm_seek() uses ov_pcm_seek_page(), which may
+   finish with ov_raw_seek()), so only the outermost one is counted */
+static void _seekstats_begin(OggVorbis_File *vf){
+  if(!vf->seek_depth++)vf->seek_mark=vf->iostats;
+}
+
+static void _seekstats_end(OggVorbis_File *vf){
+  if(!--vf->seek_depth){
+    ov_seekstats *st=&vf->seekstats;
+    st->probes=(long)(vf->iostats.seek_calls-vf->seek_mark.seek_calls);
+    st->bytes=vf->iostats.read_bytes-vf->seek_mark.read_bytes;
+    st->seeks++;
+    st->total_probes+=st->probes;
+    st->total_bytes+=st->bytes;
+  }
+}
+
 /* seek to an offset relative to the *compressed* data. This also
    scans packets to update the PCM cursor. It will cross a logical
    bitstream boundary, but only if it can't get any packets out of the
@@ -1230,7 +1936,7 @@ double ov_time_total(OggVorbis_File *vf,int i){
 
    returns zero on success, nonzero on failure */
 
-int ov_raw_seek(OggVorbis_File *vf,ogg_int64_t pos){
+static int _ov_raw_seek(OggVorbis_File *vf,ogg_int64_t pos){
   ogg_stream_state work_os;
   int ret;
 
@@ -1379,8 +2085,8 @@ int ov_raw_seek(OggVorbis_File *vf,ogg_int64_t pos){
         firstflag=(pagepos<=vf->dataoffsets[link]);
       }
 
-      ogg_stream_pagein(&vf->os,&og);
-      ogg_stream_pagein(&work_os,&og);
+      _ov_pagein(vf,&vf->os,&og);
+      _ov_pagein(vf,&work_os,&og);
       lastflag=ogg_page_eos(&og);
 
     }
@@ -1399,13 +2105,22 @@ int ov_raw_seek(OggVorbis_File *vf,ogg_int64_t pos){
   return OV_EBADLINK;
 }
 
+int ov_raw_seek(OggVorbis_File *vf,ogg_int64_t pos){
+  int ret;
+  vf->fill_error=0;
+  _seekstats_begin(vf);
+  ret=_ov_raw_seek(vf,pos);
+  _seekstats_end(vf);
+  return ret;
+}
+
 /* Page granularity seek (faster than sample granularity because we
    don't do the last bit of decode to find a specific sample).
 
    Seek to the last [granule marked] page preceding the specified pos
    location, such that decoding past the returned point will quickly
    arrive at the requested position. */
-int ov_pcm_seek_page(OggVorbis_File *vf,ogg_int64_t pos){
+static int _ov_pcm_seek_page(OggVorbis_File *vf,ogg_int64_t pos){
   int link=-1;
   ogg_int64_t result=0;
   ogg_int64_t total=ov_pcm_total(vf,-1);
@@ -1435,21 +2150,78 @@ int ov_pcm_seek_page(OggVorbis_File *vf,ogg_int64_t pos){
     ogg_int64_t endtime = vf->pcmlengths[link*2+1]+begintime;
     ogg_int64_t target=pos-total+begintime;
     ogg_int64_t best=begin;
+    ogg_int64_t lastend=end,halfspan=0;
+    ogg_int64_t px[2]={0,0},pg[2]={0,0}; /* first page after each probe */
+    int probes=0,probed=0,fresh=0,overshot=0,stalls=0;
+    double wbegin=1.;
 
     ogg_page og;
+
+    /* start from what earlier reads have seen near the target */
+    _index_bracket(vf,vf->serialnos[link],target,
+                   &begin,&end,&best,&begintime,&endtime);
+
     while(begin<end){
       ogg_int64_t bisect;
 
+      /* Illinois step: after two overshoots running, begin is stuck;
+         halve its weight so the next guess is pulled toward it */
+      if(probed){
+        if(end!=lastend){
+          if(overshot)wbegin*=.5;
+          overshot=1;
+        }else{
+          overshot=0;
+          wbegin=1.;
+        }
+      }
+      lastend=end;
+
       if(end-begin<CHUNKSIZE){
         bisect=begin;
       }else{
-        /* take a (pretty decent) guess. */
-        bisect=begin +
-          (ogg_int64_t)((double)(target-begintime)*(end-begin)/(endtime-begintime))
-          - CHUNKSIZE;
+        /* interpolate between the bracketing pages.  Until a page has
+           been found in this link, measure from the first audio page
+           rather than the headers, which carry no audio.  Once two
+           probes have landed, the secant through them follows the
+           local bitrate better, as long as it stays in the bracket */
+        ogg_int64_t origin=begin;
+        double lo=wbegin*(target-begintime);
+        double hi=endtime-target;
+        ogg_int64_t guess,margin;
+
+        if(begin==vf->offsets[link] && vf->dataoffsets[link]<end)
+          origin=vf->dataoffsets[link];
+        guess=origin;
+        if(lo+hi>0)guess+=(ogg_int64_t)(lo*(end-origin)/(lo+hi));
+        if(probes>=2 && pg[1]!=pg[0]){
+          ogg_int64_t secant=px[1]+(ogg_int64_t)
+            ((double)(target-pg[1])*(px[1]-px[0])/(pg[1]-pg[0]));
+          if(secant>begin && secant<end)guess=secant;
+        }
+
+        /* aim short, so we usually land before the target and read
+           forward to it; overshooting costs another probe */
+        margin=(guess-origin)>>2;
+        if(margin<READSIZE)margin=READSIZE;
+        if(margin>CHUNKSIZE)margin=CHUNKSIZE;
+        bisect=guess-margin;
         if(bisect<begin+CHUNKSIZE)
           bisect=begin;
+
+        /* probes that keep failing to halve the bracket mean the
+           bitrate model is off; bisect instead */
+        if(bisect!=begin){
+          if(!halfspan || end-begin<=halfspan){
+            halfspan=(end-begin)>>1;
+            stalls=0;
+          }else if(++stalls>2){
+            bisect=begin+((end-begin)>>1);
+            stalls=0;
+          }
+        }
       }
+      probed=fresh=bisect!=begin;
 
       if(bisect!=vf->offset){
         result=_seek_helper(vf,bisect);
@@ -1477,6 +2249,14 @@ int ov_pcm_seek_page(OggVorbis_File *vf,ogg_int64_t pos){
 
           granulepos=ogg_page_granulepos(&og);
           if(granulepos==-1)continue;
+          if(fresh){
+            px[0]=px[1];
+            pg[0]=pg[1];
+            px[1]=vf->offset;
+            pg[1]=granulepos;
+            probes++;
+            fresh=0;
+          }
 
           if(granulepos<target){
             best=result;  /* raw offset of packet with granulepos */
@@ -1532,7 +2312,7 @@ int ov_pcm_seek_page(OggVorbis_File *vf,ogg_int64_t pos){
       }
 
       ogg_stream_reset_serialno(&vf->os,vf->current_serialno);
-      ogg_stream_pagein(&vf->os,&og);
+      _ov_pagein(vf,&vf->os,&og);
 
       /* pull out all but last packet; the one with granulepos */
       while(1){
@@ -1588,10 +2368,19 @@ int ov_pcm_seek_page(OggVorbis_File *vf,ogg_int64_t pos){
   return (int)result;
 }
 
+int ov_pcm_seek_page(OggVorbis_File *vf,ogg_int64_t pos){
+  int ret;
+  vf->fill_error=0;
+  _seekstats_begin(vf);
+  ret=_ov_pcm_seek_page(vf,pos);
+  _seekstats_end(vf);
+  return ret;
+}
+
 /* seek to a sample offset relative to the decompressed pcm stream
    returns zero on success, nonzero on failure */
 
-int ov_pcm_seek(OggVorbis_File *vf,ogg_int64_t pos){
+static int _ov_pcm_seek(OggVorbis_File *vf,ogg_int64_t pos){
   int thisblock,lastblock=0;
   int ret=ov_pcm_seek_page(vf,pos);
   if(ret<0)return(ret);
@@ -1614,7 +2403,8 @@ int ov_pcm_seek(OggVorbis_File *vf,ogg_int64_t pos){
       if(lastblock)vf->pcm_offset+=(lastblock+thisblock)>>2;
 
       if(vf->pcm_offset+((thisblock+
-                          vorbis_info_blocksize(vf->vi,1))>>2)>=pos)break;
+                          vorbis_info_blocksize(vf->vi+vf->current_link,1))
+                         >>2)>=pos)break;
 
       /* remove the packet from packet queue and track its granulepos */
       ogg_stream_packetout(&vf->os,NULL);
@@ -1661,7 +2451,7 @@ int ov_pcm_seek(OggVorbis_File *vf,ogg_int64_t pos){
         lastblock=0;
       }
 
-      ogg_stream_pagein(&vf->os,&og);
+      _ov_pagein(vf,&vf->os,&og);
     }
   }
 
@@ -1671,9 +2461,11 @@ int ov_pcm_seek(OggVorbis_File *vf,ogg_int64_t pos){
      logical bitstream boundary with abandon is OK. */
   {
     /* note that halfrate could be set differently in each link, but
-       vorbisfile encoforces all links are set or unset */
+       vorbisfile encoforces all links are set or unset.  Links need
+       not start on a multiple of 1<<hs, so stop when less than one
+       reduced rate sample remains rather than at a rounded pos */
     int hs=vorbis_synthesis_halfrate_p(vf->vi);
-    while(vf->pcm_offset<((pos>>hs)<<hs)){
+    while((pos-vf->pcm_offset)>>hs>0){
       ogg_int64_t target=(pos-vf->pcm_offset)>>hs;
       long samples=vorbis_synthesis_pcmout(&vf->vd,NULL);
 
@@ -1689,6 +2481,15 @@ int ov_pcm_seek(OggVorbis_File *vf,ogg_int64_t pos){
   return 0;
 }
 
+int ov_pcm_seek(OggVorbis_File *vf,ogg_int64_t pos){
+  int ret;
+  vf->fill_error=0;
+  _seekstats_begin(vf);
+  ret=_ov_pcm_seek(vf,pos);
+  _seekstats_end(vf);
+  return ret;
+}
+
 /* seek to a playback time relative to the decompressed pcm stream
    returns zero on success, nonzero on failure */
 int ov_time_seek(OggVorbis_File *vf,double seconds){
@@ -1827,13 +2628,6 @@ vorbis_comment *ov_comment(OggVorbis_File *vf,int link){
   }
 }
 
-static int host_is_big_endian() {
-  ogg_int32_t pattern = 0xfeedface; /* deadbeef */
-  unsigned char *bytewise = (unsigned char *)&pattern;
-  if (bytewise[0] == 0xfe) return 1;
-  return 0;
-}
-
 /* up to this point, everything could more or less hide the multiple
    logical bitstream nature of chaining from the toplevel application
    if the toplevel application didn't particularly care.  However, at
@@ -1870,22 +2664,16 @@ static int host_is_big_endian() {
 
             *section) set to the logical bitstream number */
 
-long ov_read_filter(OggVorbis_File *vf,char *buffer,int length,
-                    int bigendianp,int word,int sgned,int *bitstream,
-                    void (*filter)(float **pcm,long channels,long samples,void *filter_param),void *filter_param){
-  int i,j;
-  int host_endian = host_is_big_endian();
-  int hs;
-
-  float **pcm;
-  long samples;
-
+/* decode until there is PCM to hand out; returns the samples ready,
+   0 at end of file or an error.  pcm may be NULL, leaving the samples
+   for _ov_pack() to lap. */
+static long _ov_pcmout(OggVorbis_File *vf,float ***pcm){
   if(vf->ready_state<OPENED)return(OV_EINVAL);
 
   while(1){
     if(vf->ready_state==INITSET){
-      samples=vorbis_synthesis_pcmout(&vf->vd,&pcm);
-      if(samples)break;
+      long samples=vorbis_synthesis_pcmout(&vf->vd,pcm);
+      if(samples)return(samples);
     }
 
     /* suck in another packet */
@@ -1896,14 +2684,60 @@ long ov_read_filter(OggVorbis_File *vf,char *buffer,int length,
       if(ret<=0)
         return(ret);
     }
+  }
+}
 
+/* pack the next samples frames into buffer in format, taking channel
+   i from channel order[i] (or i, with order NULL), and doing the
+   overlap-add libvorbis left for us on the way; see lap.h */
+static void _ov_pack(OggVorbis_File *vf,char *buffer,int channels,
+                     const unsigned char *order,long samples,int format){
+  long bytespersample=(long)_ov_pcm_width(format)*channels;
+  float *pcm[256],*cur[256];
+  long pos=0;
+  VORBIS_CLOCK(t);
+
+  while(pos<samples){
+    vorbis_lapseg s;
+    long n=_vorbis_synthesis_lapseg(&vf->vd,pos,&s);
+    int i;
+    if(n<=0)break;
+    if(n>samples-pos)n=samples-pos;
+    for(i=0;i<channels;i++){
+      int c=order?order[i]:i;
+      pcm[i]=s.pcm[c]+s.off;
+      if(s.cur)cur[i]=s.cur[c]+s.curoff;
+    }
+    if(s.cur)
+      _ov_pcm_pack_lap(buffer,pcm,cur,s.up,s.down,channels,n,format);
+    else
+      _ov_pcm_pack(buffer,pcm,channels,n,format);
+    buffer+=n*bytespersample;
+    pos+=n;
   }
+  VORBIS_STAGE(&vf->profile,pack,t);
+}
+
+static void _ov_pcm_consumed(OggVorbis_File *vf,long samples,int *bitstream){
+  int hs=vorbis_synthesis_halfrate_p(vf->vi);
+  vorbis_synthesis_read(&vf->vd,samples);
+  vf->pcm_offset+=(samples<<hs);
+  if(bitstream)*bitstream=vf->current_link;
+}
+
+long ov_read_filter(OggVorbis_File *vf,char *buffer,int length,
+                    int bigendianp,int word,int sgned,int *bitstream,
+                    void (*filter)(float **pcm,long channels,long samples,void *filter_param),void *filter_param){
+  int i,j;
+
+  float **pcm;
+  long samples=_ov_pcmout(vf,NULL);
 
   if(samples>0){
 
     /* yay! proceed to pack data into the byte buffer */
 
-    long channels=ov_info(vf,-1)->channels;
+    long channels=ov_channels(vf,-1);
     long bytespersample=word * channels;
     vorbis_fpu_control fpu;
     if(samples>length/bytespersample)samples=length/bytespersample;
@@ -1911,97 +2745,37 @@ long ov_read_filter(OggVorbis_File *vf,char *buffer,int length,
     if(samples <= 0)
       return OV_EINVAL;
 
+    /* the filter and the 8 bit packing want the lapped floats */
+    if(filter || word==1)
+      vorbis_synthesis_pcmout(&vf->vd,&pcm);
+
     /* Here. */
     if(filter)
       filter(pcm,channels,samples,filter_param);
 
     /* a tight loop to pack each size */
-    {
+    if(word==1){
       int val;
-      if(word==1){
-        int off=(sgned?0:128);
-        vorbis_fpu_setround(&fpu);
-        for(j=0;j<samples;j++)
-          for(i=0;i<channels;i++){
-            val=vorbis_ftoi(pcm[i][j]*128.f);
-            if(val>127)val=127;
-            else if(val<-128)val=-128;
-            *buffer++=val+off;
-          }
-        vorbis_fpu_restore(fpu);
-      }else{
-        int off=(sgned?0:32768);
-
-        if(host_endian==bigendianp){
-          if(sgned){
-
-            vorbis_fpu_setround(&fpu);
-            for(i=0;i<channels;i++) { /* It's faster in this order */
-              float *src=pcm[i];
-              short *dest=((short *)buffer)+i;
-              for(j=0;j<samples;j++) {
-                val=vorbis_ftoi(src[j]*32768.f);
-                if(val>32767)val=32767;
-                else if(val<-32768)val=-32768;
-                *dest=val;
-                dest+=channels;
-              }
-            }
-            vorbis_fpu_restore(fpu);
-
-          }else{
-
-            vorbis_fpu_setround(&fpu);
-            for(i=0;i<channels;i++) {
-              float *src=pcm[i];
-              short *dest=((short *)buffer)+i;
-              for(j=0;j<samples;j++) {
-                val=vorbis_ftoi(src[j]*32768.f);
-                if(val>32767)val=32767;
-                else if(val<-32768)val=-32768;
-                *dest=val+off;
-                dest+=channels;
-              }
-            }
-            vorbis_fpu_restore(fpu);
-
-          }
-        }else if(bigendianp){
-
-          vorbis_fpu_setround(&fpu);
-          for(j=0;j<samples;j++)
-            for(i=0;i<channels;i++){
-              val=vorbis_ftoi(pcm[i][j]*32768.f);
-              if(val>32767)val=32767;
-              else if(val<-32768)val=-32768;
-              val+=off;
-              *buffer++=(val>>8);
-              *buffer++=(val&0xff);
-            }
-          vorbis_fpu_restore(fpu);
-
-        }else{
-          int val;
-          vorbis_fpu_setround(&fpu);
-          for(j=0;j<samples;j++)
-            for(i=0;i<channels;i++){
-              val=vorbis_ftoi(pcm[i][j]*32768.f);
-              if(val>32767)val=32767;
-              else if(val<-32768)val=-32768;
-              val+=off;
-              *buffer++=(val&0xff);
-              *buffer++=(val>>8);
-                  }
-          vorbis_fpu_restore(fpu);
-
+      int off=(sgned?0:128);
+      VORBIS_CLOCK(t);
+      vorbis_fpu_setround(&fpu);
+      for(j=0;j<samples;j++)
+        for(i=0;i<channels;i++){
+          val=vorbis_ftoi(pcm[i][j]*128.f);
+          if(val>127)val=127;
+          else if(val<-128)val=-128;
+          *buffer++=val+off;
         }
-      }
+      vorbis_fpu_restore(fpu);
+      VORBIS_STAGE(&vf->profile,pack,t);
+    }else{
+      _ov_pack(vf,buffer,channels,NULL,samples,
+               OV_FMT_S16|
+               (bigendianp?OV_FMT_BIGENDIAN:0)|
+               (sgned?0:OV_PCM_UNSIGNED));
     }
 
-    vorbis_synthesis_read(&vf->vd,samples);
-    hs=vorbis_synthesis_halfrate_p(vf->vi);
-    vf->pcm_offset+=(samples<<hs);
-    if(bitstream)*bitstream=vf->current_link;
+    _ov_pcm_consumed(vf,samples,bitstream);
     return(samples*bytespersample);
   }else{
     return(samples);
@@ -2013,6 +2787,152 @@ long ov_read(OggVorbis_File *vf,char *buffer,int length,
   return ov_read_filter(vf, buffer, length, bigendianp, word, sgned, bitstream, NULL, NULL);
 }
 
+/* WAVE/SMPTE slot of each Vorbis channel for the channel counts the
+   Vorbis I spec assigns positions to (section 4.3.9) */
+static const unsigned char wave_order[8][8]={
+  {0},
+  {0,1},
+  {0,2,1},
+  {0,1,2,3},
+  {0,2,1,3,4},
+  {0,2,1,5,3,4},
+  {0,2,1,6,5,3,4},
+  {0,2,1,7,5,6,3,4},
+};
+
+/* ov_read_format is ov_read for the wider formats: 16, 24 or 32 bit
+   signed integer, or float, in either byte order (see OV_FMT_* in
+   vorbisfile.h).  With OV_FMT_WAVEORDER, one to eight channel streams
+   come out in the order WAVE and SMPTE use instead; other channel
+   counts are left alone.  Interleaving, conversion and reordering are
+   all one pass over the decoded audio.
+
+   return values are as for ov_read; an unknown format is OV_EINVAL */
+
+long ov_read_format(OggVorbis_File *vf,char *buffer,int length,
+                    int format,int *bitstream){
+  int width=_ov_pcm_width(format);
+  long samples;
+
+  if(!width || (format&~(0xff|OV_FMT_BIGENDIAN|OV_FMT_WAVEORDER)))
+    return(OV_EINVAL);
+
+  samples=_ov_pcmout(vf,NULL);
+  if(samples>0){
+    int channels=ov_channels(vf,-1);
+    long bytespersample=(long)width*channels;
+    const unsigned char *order=NULL;
+
+    if(samples>length/bytespersample)samples=length/bytespersample;
+    if(samples<=0)
+      return OV_EINVAL;
+
+    if((format&OV_FMT_WAVEORDER) && channels<=8 &&
+       channels==ov_info(vf,-1)->channels)
+      order=wave_order[channels-1];
+    _ov_pack(vf,buffer,channels,order,samples,format&~OV_FMT_WAVEORDER);
+
+    _ov_pcm_consumed(vf,samples,bitstream);
+    return(samples*bytespersample);
+  }
+  return(samples);
+}
+
+/* ov_read_fill is ov_read_format that keeps going: it decodes and
+   packs packet after packet until buffer holds length bytes' worth of
+   whole frames, the stream ends, or the link changes, so that an
+   output buffer of any size takes one call.  A link boundary always
+   ends the call, leaving the new link's audio for the next one, so
+   everything returned is in the one format.
+
+   Instead of having the caller compare *bitstream and ov_info() from
+   call to call, *status (if not NULL) says what the next call will
+   see: OV_FILL_EOF when the stream has ended, OV_FILL_LINK when it
+   starts a new link, plus OV_FILL_FORMAT when that link's channel
+   count or rate differ.  ov_info(vf,-1) already describes the new
+   link on return.
+
+   A hole after some audio has been packed ends the call; OV_HOLE is
+   then returned by the next call.
+
+   return values are as for ov_read_format */
+
+long ov_read_fill(OggVorbis_File *vf,char *buffer,int length,
+                  int format,int *bitstream,int *status){
+  int width=_ov_pcm_width(format);
+  int link=vf->current_link;
+  int channels=0;
+  long rate=0;
+  long bytespersample=0;
+  long done=0;
+  long ret=0;
+
+  if(status)*status=0;
+  if(!width || (format&~(0xff|OV_FMT_BIGENDIAN|OV_FMT_WAVEORDER)))
+    return(OV_EINVAL);
+  if(vf->ready_state<OPENED)return(OV_EINVAL);
+  if(vf->fill_error){
+    ret=vf->fill_error;
+    vf->fill_error=0;
+    return(ret);
+  }
+
+  while(1){
+    if(vf->ready_state==INITSET){
+      long samples=vorbis_synthesis_pcmout(&vf->vd,NULL);
+
+      if(samples){
+        const unsigned char *order=NULL;
+        if(!done){
+          link=vf->current_link;
+          channels=ov_channels(vf,-1);
+          rate=ov_info(vf,-1)->rate;
+          bytespersample=(long)width*channels;
+        }
+        if(samples>(length-done)/bytespersample)
+          samples=(length-done)/bytespersample;
+        if(samples<=0){
+          if(!done)return(OV_EINVAL);
+          break;
+        }
+
+        if((format&OV_FMT_WAVEORDER) && channels<=8 &&
+           channels==ov_info(vf,-1)->channels)
+          order=wave_order[channels-1];
+        _ov_pack(vf,buffer+done,channels,order,samples,
+                 format&~OV_FMT_WAVEORDER);
+        _ov_pcm_consumed(vf,samples,NULL);
+        done+=samples*bytespersample;
+        continue;
+      }
+    }
+
+    /* suck in another packet */
+    ret=_fetch_and_process_packet(vf,NULL,1,1);
+    if(ret<=0){
+      if(ret==OV_EOF){
+        if(status)*status=OV_FILL_EOF;
+        ret=0;
+      }
+      if(!done)return(ret);
+      if(ret)vf->fill_error=(int)ret;
+      break;
+    }
+    if(done && vf->current_link!=link){
+      if(status){
+        vorbis_info *vi=ov_info(vf,-1);
+        *status=OV_FILL_LINK;
+        if(ov_channels(vf,-1)!=channels || vi->rate!=rate)
+          *status|=OV_FILL_FORMAT;
+      }
+      break;
+    }
+  }
+
+  if(bitstream)*bitstream=link;
+  return(done);
+}
+
 /* input values: pcm_channels) a float vector per channel of output
                  length) the sample length being read by the app
 
@@ -2058,6 +2978,240 @@ long ov_read_float(OggVorbis_File *vf,float ***pcm_channels,int length,
   }
 }
 
+/* segment parallel decode ******************************************/
+
+/* samples per segment: long enough that the seek and one packet of
+   pre-roll each segment costs are lost in the noise, short enough to
+   keep a few segments per thread in flight without much memory */
+#define SEGMENTSAMPLES (1L<<18)
+
+typedef struct {
+  ogg_int64_t pos;     /* absolute pcm position, as for ov_pcm_seek */
+  long        samples;
+  int         link;
+  long        bytes;
+  char       *pcm;
+  int         done;
+} ov_segment;
+
+typedef struct {
+  OggVorbis_File *vf;
+  int             format;
+  int           (*open_func)(void *arg,OggVorbis_File *vf);
+  void           *open_arg;
+
+  vorbis_mutex    lock;
+  vorbis_cond     cond;
+  ov_segment     *seg;
+  long            segs;
+  long            next;    /* next segment to hand to a worker */
+  long            written; /* segments passed to write_func */
+  long            window;  /* how far ahead of written workers may go */
+  int             error;
+} ov_parallel;
+
+static void _ov_parallel_fail(ov_parallel *p,int error){
+  vorbis_mutex_lock(&p->lock);
+  if(!p->error)p->error=error;
+  vorbis_cond_broadcast(&p->cond);
+  vorbis_mutex_unlock(&p->lock);
+}
+
+static void _ov_parallel_worker(void *arg){
+  ov_parallel *p=arg;
+  OggVorbis_File w;
+  int width=_ov_pcm_width(p->format);
+  int ret;
+
+  /* a decoder of our own on the same stream */
+  if(p->open_func)
+    ret=p->open_func(p->open_arg,&w);
+  else{
+    ov_memsource *m=p->vf->datasource;
+    ret=ov_open_memory(m->data,(size_t)m->size,&w);
+  }
+  if(ret){
+    _ov_parallel_fail(p,ret);
+    return;
+  }
+  if(p->vf->downmix &&
+     (ret=ov_downmix(&w,p->vf->downmix_in,p->vf->downmix_out,
+                     p->vf->downmix))){
+    _ov_parallel_fail(p,ret);
+    ov_clear(&w);
+    return;
+  }
+
+  while(1){
+    ov_segment *s;
+    long done=0;
+
+    vorbis_mutex_lock(&p->lock);
+    while(!p->error && p->next<p->segs && p->next>=p->written+p->window)
+      vorbis_cond_wait(&p->cond,&p->lock);
+    if(p->error || p->next>=p->segs){
+      vorbis_mutex_unlock(&p->lock);
+      break;
+    }
+    s=p->seg+p->next++;
+    vorbis_mutex_unlock(&p->lock);
+
+    s->bytes=s->samples*width*ov_channels(p->vf,s->link);
+    s->pcm=_ogg_malloc(s->bytes);
+    if(!s->pcm){
+      _ov_parallel_fail(p,OV_EFAULT);
+      break;
+    }
+
+    /* a worker that just did the segment before carries straight on;
+       otherwise ov_pcm_seek does the page seek and pre-roll */
+    if(ov_pcm_tell(&w)!=s->pos && (ret=ov_pcm_seek(&w,s->pos))){
+      _ov_parallel_fail(p,ret);
+      break;
+    }
+    while(done<s->bytes){
+      ret=ov_read_fill(&w,s->pcm+done,(int)(s->bytes-done),
+                       p->format,NULL,NULL);
+      if(ret<=0)break;
+      done+=ret;
+    }
+    if(done<s->bytes){
+      /* a hole, or the stream is shorter than its granulepos say;
+         either way the sequential decode would differ */
+      _ov_parallel_fail(p,ret<0?ret:OV_HOLE);
+      break;
+    }
+
+    vorbis_mutex_lock(&p->lock);
+    s->done=1;
+    vorbis_cond_broadcast(&p->cond);
+    vorbis_mutex_unlock(&p->lock);
+  }
+
+  ov_clear(&w);
+}
+
+/* ov_decode_parallel decodes the whole of a seekable stream on
+   several threads and passes the PCM, in order, to write_func.  The
+   stream is cut into segments which each worker decodes on a decoder
+   of its own after seeking there with ov_pcm_seek; as Vorbis output
+   depends on nothing but the packets either side, the result is bit
+   for bit what reading the stream through with ov_read_fill gives.
+
+   input values: threads) workers to run; <=0 for one per CPU
+                 format) OV_FMT_* as for ov_read_format
+                 open_func) opens a further OggVorbis_File on the same
+                            stream for a worker; NULL if vf came from
+                            ov_open_memory or ov_open_mmap, whose image
+                            the workers then share
+                 write_func) gets the PCM in order, each call all from
+                            one link; a nonzero return stops the decode
+
+   return values: 0) success
+                  OV_EINVAL) vf is not an open, seekable stream
+                  OV_EIMPL) vf decodes at a reduced rate, or needs
+                            open_func
+                  OV_HOLE) the stream is damaged; use ov_read
+                  otherwise what open_func or write_func returned
+
+   vf itself is not read from or moved; the workers take on its
+   ov_downmix() setting.  The workers' decoders and PCM come from
+   the allocator current on each worker thread, the heap, rather than
+   vf's, which need not be safe to call from several threads. */
+
+int ov_decode_parallel(OggVorbis_File *vf,int threads,int format,
+                       int (*open_func)(void *arg,OggVorbis_File *vf),
+                       void *open_arg,
+                       int (*write_func)(void *arg,const char *pcm,
+                                         long bytes,int link),
+                       void *write_arg){
+  ov_parallel p;
+  vorbis_thread **t;
+  ogg_int64_t pos=0;
+  long k;
+  int i,started=0;
+
+  if(vf->ready_state<OPENED || !vf->seekable)return(OV_EINVAL);
+  if(!_ov_pcm_width(format) ||
+     (format&~(0xff|OV_FMT_BIGENDIAN|OV_FMT_WAVEORDER)))
+    return(OV_EINVAL);
+  if(ov_halfrate_p(vf))return(OV_EIMPL);
+  if(!open_func && !_ov_is_memory(vf))return(OV_EIMPL);
+  if(threads<=0)threads=_vorbis_cpu_count();
+
+  memset(&p,0,sizeof(p));
+  p.vf=vf;
+  p.format=format;
+  p.open_func=open_func;
+  p.open_arg=open_arg;
+  p.window=threads*2;
+
+  /* segments never straddle links, so each has the one format */
+  for(i=0;i<vf->links;i++)
+    p.segs+=(long)((ov_pcm_total(vf,i)+SEGMENTSAMPLES-1)/SEGMENTSAMPLES);
+  p.seg=_ogg_calloc(p.segs+1,sizeof(*p.seg));
+  t=_ogg_calloc(threads,sizeof(*t));
+  if(!p.seg || !t){
+    if(p.seg)_ogg_free(p.seg);
+    if(t)_ogg_free(t);
+    return(OV_EFAULT);
+  }
+  for(k=0,i=0;i<vf->links;i++){
+    ogg_int64_t left=ov_pcm_total(vf,i);
+    while(left>0){
+      ov_segment *s=p.seg+k++;
+      s->pos=pos;
+      s->samples=(long)(left<SEGMENTSAMPLES?left:SEGMENTSAMPLES);
+      s->link=i;
+      pos+=s->samples;
+      left-=s->samples;
+    }
+  }
+
+  vorbis_mutex_init(&p.lock);
+  vorbis_cond_init(&p.cond);
+  for(i=0;i<threads;i++){
+    t[i]=_vorbis_thread_start(_ov_parallel_worker,&p);
+    if(t[i])started++;
+  }
+  if(!started)p.error=OV_EFAULT;
+
+  /* write out the segments in order as they come in */
+  for(k=0;k<p.segs;k++){
+    ov_segment *s=p.seg+k;
+    int ret;
+
+    vorbis_mutex_lock(&p.lock);
+    while(!s->done && !p.error)
+      vorbis_cond_wait(&p.cond,&p.lock);
+    vorbis_mutex_unlock(&p.lock);
+    if(!s->done)break;
+
+    ret=write_func(write_arg,s->pcm,s->bytes,s->link);
+    _ogg_free(s->pcm);
+    s->pcm=NULL;
+    if(ret){
+      _ov_parallel_fail(&p,ret);
+      break;
+    }
+
+    vorbis_mutex_lock(&p.lock);
+    p.written++;
+    vorbis_cond_broadcast(&p.cond);
+    vorbis_mutex_unlock(&p.lock);
+  }
+
+  for(i=0;i<threads;i++)
+    if(t[i])_vorbis_thread_join(t[i]);
+  for(k=0;k<p.segs;k++)
+    if(p.seg[k].pcm)_ogg_free(p.seg[k].pcm);
+  vorbis_cond_destroy(&p.cond);
+  vorbis_mutex_destroy(&p.lock);
+  _ogg_free(p.seg);
+  _ogg_free(t);
+  return(p.error);
+}
+
 extern const float *vorbis_window(vorbis_dsp_state *v,int W);
 
 static void _ov_splice(float **pcm,float **lappcm,
@@ -2129,7 +3283,7 @@ static int _ov_initprime(OggVorbis_File *vf){
 /* grab enough data for lapping from vf; this may be in the form of
    unreturned, already-decoded pcm, remaining PCM we will need to
    decode, or synthetic postextrapolation from last packets. */
-static void _ov_getlap(OggVorbis_File *vf,vorbis_info *vi,vorbis_dsp_state *vd,
+static void _ov_getlap(OggVorbis_File *vf,int channels,vorbis_dsp_state *vd,
                        float **lappcm,int lapsize){
   int lapcount=0,i;
   float **pcm;
@@ -2139,7 +3293,7 @@ static void _ov_getlap(OggVorbis_File *vf,vorbis_info *vi,vorbis_dsp_state *vd,
     int samples=vorbis_synthesis_pcmout(vd,&pcm);
     if(samples){
       if(samples>lapsize-lapcount)samples=lapsize-lapcount;
-      for(i=0;i<vi->channels;i++)
+      for(i=0;i<channels;i++)
         memcpy(lappcm[i]+lapcount,pcm[i],sizeof(**pcm)*samples);
       lapcount+=samples;
       vorbis_synthesis_read(vd,samples);
@@ -2155,12 +3309,12 @@ static void _ov_getlap(OggVorbis_File *vf,vorbis_info *vi,vorbis_dsp_state *vd,
        from the last packet */
     int samples=vorbis_synthesis_lapout(&vf->vd,&pcm);
     if(samples==0){
-      for(i=0;i<vi->channels;i++)
+      for(i=0;i<channels;i++)
         memset(lappcm[i]+lapcount,0,sizeof(**pcm)*lapsize-lapcount);
       lapcount=lapsize;
     }else{
       if(samples>lapsize-lapcount)samples=lapsize-lapcount;
-      for(i=0;i<vi->channels;i++)
+      for(i=0;i<channels;i++)
         memcpy(lappcm[i]+lapcount,pcm[i],sizeof(**pcm)*samples);
       lapcount+=samples;
     }
@@ -2174,7 +3328,7 @@ int ov_crosslap(OggVorbis_File *vf1, OggVorbis_File *vf2){
   float **lappcm;
   float **pcm;
   const float *w1,*w2;
-  int n1,n2,i,ret,hs1,hs2;
+  int n1,n2,ch1,ch2,i,ret,hs1,hs2;
 
   if(vf1==vf2)return(0); /* degenerate case */
   if(vf1->ready_state<OPENED)return(OV_EINVAL);
@@ -2193,17 +3347,21 @@ int ov_crosslap(OggVorbis_File *vf1, OggVorbis_File *vf2){
   vi2=ov_info(vf2,-1);
   hs1=ov_halfrate_p(vf1);
   hs2=ov_halfrate_p(vf2);
+  ch1=ov_channels(vf1,-1);
+  ch2=ov_channels(vf2,-1);
+  if(ch1<0)return(ch1);
+  if(ch2<0)return(ch2);
 
-  lappcm=alloca(sizeof(*lappcm)*vi1->channels);
+  lappcm=alloca(sizeof(*lappcm)*ch1);
   n1=vorbis_info_blocksize(vi1,0)>>(1+hs1);
   n2=vorbis_info_blocksize(vi2,0)>>(1+hs2);
   w1=vorbis_window(&vf1->vd,0);
   w2=vorbis_window(&vf2->vd,0);
 
-  for(i=0;i<vi1->channels;i++)
+  for(i=0;i<ch1;i++)
     lappcm[i]=alloca(sizeof(**lappcm)*n1);
 
-  _ov_getlap(vf1,vi1,&vf1->vd,lappcm,n1);
+  _ov_getlap(vf1,ch1,&vf1->vd,lappcm,n1);
 
   /* have a lapping buffer from vf1; now to splice it into the lapping
      buffer of vf2 */
@@ -2216,7 +3374,7 @@ int ov_crosslap(OggVorbis_File *vf1, OggVorbis_File *vf2){
 #endif
 
   /* splice */
-  _ov_splice(pcm,lappcm,n1,n2,vi1->channels,vi2->channels,w1,w2);
+  _ov_splice(pcm,lappcm,n1,n2,ch1,ch2,w1,w2);
 
   /* done */
   return(0);
@@ -2237,7 +3395,8 @@ static int _ov_64_seek_lap(OggVorbis_File *vf,ogg_int64_t pos,
   vi=ov_info(vf,-1);
   hs=ov_halfrate_p(vf);
 
-  ch1=vi->channels;
+  ch1=ov_channels(vf,-1);
+  if(ch1<0)return(ch1);
   n1=vorbis_info_blocksize(vi,0)>>(1+hs);
   w1=vorbis_window(&vf->vd,0);  /* window arrays from libvorbis are
                                    persistent; even if the decode state
@@ -2247,7 +3406,7 @@ static int _ov_64_seek_lap(OggVorbis_File *vf,ogg_int64_t pos,
   lappcm=alloca(sizeof(*lappcm)*ch1);
   for(i=0;i<ch1;i++)
     lappcm[i]=alloca(sizeof(**lappcm)*n1);
-  _ov_getlap(vf,vi,&vf->vd,lappcm,n1);
+  _ov_getlap(vf,ch1,&vf->vd,lappcm,n1);
 
   /* have lapping data; seek and prime the buffer */
   ret=localseek(vf,pos);
@@ -2257,7 +3416,8 @@ static int _ov_64_seek_lap(OggVorbis_File *vf,ogg_int64_t pos,
 
  /* Guard against cross-link changes; they're perfectly legal */
   vi=ov_info(vf,-1);
-  ch2=vi->channels;
+  ch2=ov_channels(vf,-1);
+  if(ch2<0)return(ch2);
   n2=vorbis_info_blocksize(vi,0)>>(1+hs);
   w2=vorbis_window(&vf->vd,0);
 
@@ -2298,7 +3458,8 @@ static int _ov_d_seek_lap(OggVorbis_File *vf,double pos,
   vi=ov_info(vf,-1);
   hs=ov_halfrate_p(vf);
 
-  ch1=vi->channels;
+  ch1=ov_channels(vf,-1);
+  if(ch1<0)return(ch1);
   n1=vorbis_info_blocksize(vi,0)>>(1+hs);
   w1=vorbis_window(&vf->vd,0);  /* window arrays from libvorbis are
                                    persistent; even if the decode state
@@ -2308,7 +3469,7 @@ static int _ov_d_seek_lap(OggVorbis_File *vf,double pos,
   lappcm=alloca(sizeof(*lappcm)*ch1);
   for(i=0;i<ch1;i++)
     lappcm[i]=alloca(sizeof(**lappcm)*n1);
-  _ov_getlap(vf,vi,&vf->vd,lappcm,n1);
+  _ov_getlap(vf,ch1,&vf->vd,lappcm,n1);
 
   /* have lapping data; seek and prime the buffer */
   ret=localseek(vf,pos);
@@ -2318,7 +3479,8 @@ static int _ov_d_seek_lap(OggVorbis_File *vf,double pos,
 
  /* Guard against cross-link changes; they're perfectly legal */
   vi=ov_info(vf,-1);
-  ch2=vi->channels;
+  ch2=ov_channels(vf,-1);
+  if(ch2<0)return(ch2);
   n2=vorbis_info_blocksize(vi,0)>>(1+hs);
   w2=vorbis_window(&vf->vd,0);
 
@@ -2339,3 +3501,597 @@ int ov_time_seek_lap(OggVorbis_File *vf,double pos){
 int ov_time_seek_page_lap(OggVorbis_File *vf,double pos){
   return _ov_d_seek_lap(vf,pos,ov_time_seek_page);
 }
+
+#ifdef _V_SELFTEST
+
+/* Checks the decode paths that have a plain one to compare against,
+   and that the read calls make no heap allocations once ov_realtime()
+   is on.  Build with -D_V_SELFTEST and link in bench/bench_corpus.c;
+   streams are encoded here, so nothing else is needed. */
+
+#include "codec_internal.h"
+#include "bench_corpus.h"
+
+#define TEST_SEEKS 61    /* seek targets per pass */
+#define TEST_READ  16384 /* bytes compared after each seek */
+
+static int  counting;
+static long allocations;
+
+static void *_test_alloc(void *ctx,size_t bytes){
+  (void)ctx;
+  if(counting)allocations++;
+  return malloc(bytes);
+}
+
+static void _test_free(void *ctx,void *ptr){
+  (void)ctx;
+  free(ptr);
+}
+
+static const ogg_allocator _test_counter={_test_alloc,_test_free,NULL};
+
+static const ov_callbacks _test_callbacks={
+  bench_source_read,bench_source_seek,NULL,bench_source_tell
+};
+
+static int _test_open(bench_source *src,const bench_buffer *b,
+                      OggVorbis_File *vf){
+  src->b=b;
+  src->pos=0;
+  return ov_open_callbacks(src,vf,NULL,0,_test_callbacks);
+}
+
+/* the rest of the stream read straight through, 16 bit */
+static int _test_pcm(OggVorbis_File *vf,bench_buffer *out){
+  char pcm[4096];
+  int  bs;
+  long ret;
+  out->bytes=0;
+  while((ret=ov_read(vf,pcm,sizeof(pcm),0,2,1,&bs))!=0){
+    if(ret<0)return -1;
+    bench_write(out,(unsigned char *)pcm,ret);
+  }
+  return 0;
+}
+
+
+/* Seeks to targets spread over the stream in no particular order and
+   compares what is read from there with ref, the whole stream read
+   through.  how is one of the TEST_* calls below; lapped seeks
+   crossfade from where the last read stopped over the first half
+   short block, so only what follows that is compared.  At reduced
+   rates the targets are whole output samples.  Returns the seeks
+   that failed. */
+enum { TEST_PCM, TEST_PAGE, TEST_TIME, TEST_LAP };
+
+static int _test_seeks(OggVorbis_File *vf,const bench_buffer *ref,int how,
+                       int shift,const char *what){
+  ogg_int64_t total=ov_pcm_total(vf,-1);
+  long        rate=ov_info(vf,-1)->rate;
+  int         frame=ov_channels(vf,-1)*2;
+  long        want=TEST_READ/frame*frame;
+  int         failed=0,i;
+
+  for(i=0;i<TEST_SEEKS;i++){
+    ogg_int64_t target=(total/TEST_SEEKS*((i*37)%TEST_SEEKS)+i*131)%total;
+    ogg_int64_t pos;
+    unsigned char pcm[TEST_READ];
+    long got=0,at,lap=0;
+    int  bs,ret;
+
+    target&=~(((ogg_int64_t)1<<shift)-1);
+    switch(how){
+    case TEST_PCM:
+      ret=ov_pcm_seek(vf,target);
+      break;
+    case TEST_PAGE:
+      ret=ov_pcm_seek_page(vf,target);
+      break;
+    case TEST_TIME:
+      ret=ov_time_seek(vf,(double)target/rate);
+      break;
+    default:
+      ret=ov_pcm_seek_lap(vf,target);
+      lap=(vorbis_info_blocksize(ov_info(vf,-1),0)>>(1+shift))*frame;
+      break;
+    }
+    pos=ov_pcm_tell(vf);
+    /* seconds convert back to within a sample */
+    if(how==TEST_TIME && (pos==target-1 || pos==target+1))target=pos;
+    if(ret || pos<0 || (how!=TEST_PAGE && pos!=target) ||
+       (pos>>shift)*frame>ref->bytes){
+      fprintf(stderr,"%s: seek to %ld failed\n",what,(long)target);
+      failed++;
+      continue;
+    }
+    at=(long)(pos>>shift)*frame;
+
+    while(got<want){
+      long n=ov_read(vf,(char *)pcm+got,want-got,0,2,1,&bs);
+      if(n<=0)break;
+      got+=n;
+    }
+    if(got>ref->bytes-at)got=ref->bytes-at;
+    if(lap>got)lap=got;
+    if(got<want && at+got<ref->bytes){
+      fprintf(stderr,"%s: read after %ld stopped short\n",
+              what,(long)target);
+      failed++;
+    }else if(memcmp(pcm+lap,ref->data+at+lap,got-lap)){
+      fprintf(stderr,"%s: wrong samples after %ld\n",what,(long)target);
+      failed++;
+    }
+  }
+  return failed;
+}
+
+/* Interleaves another logical stream into the Vorbis stream in b:
+   its first page right after the Vorbis one, then one of its pages
+   after every Vorbis page, with granulepos falling from granulepos
+   by step a page, so they cross the Vorbis ones. */
+static void _test_mux(const bench_buffer *b,ogg_int64_t granulepos,
+                      long step,bench_buffer *out){
+  ogg_sync_state   oy;
+  ogg_stream_state os;
+  ogg_page         og,fg;
+  ogg_packet       op;
+  unsigned char    body[300];
+  long             i;
+
+  for(i=0;i<(long)sizeof(body);i++)body[i]=(unsigned char)(i*7+1);
+  memset(&op,0,sizeof(op));
+  op.packet=body;
+  op.bytes=sizeof(body);
+  op.granulepos=granulepos;
+
+  ogg_sync_init(&oy);
+  ogg_stream_init(&os,0x7e57);
+  memcpy(ogg_sync_buffer(&oy,b->bytes),b->data,b->bytes);
+  ogg_sync_wrote(&oy,b->bytes);
+  while(ogg_sync_pageout(&oy,&og)==1){
+    bench_write(out,og.header,og.header_len);
+    bench_write(out,og.body,og.body_len);
+    op.b_o_s=op.packetno==0;
+    op.e_o_s=ogg_page_eos(&og);
+    ogg_stream_packetin(&os,&op);
+    while(ogg_stream_flush(&os,&fg)){
+      bench_write(out,fg.header,fg.header_len);
+      bench_write(out,fg.body,fg.body_len);
+    }
+    op.packetno++;
+    op.granulepos-=step;
+  }
+  ogg_stream_clear(&os);
+  ogg_sync_clear(&oy);
+}
+
+/* page seeks bracketed by the seek index must land where
+   plain bisection does, also with another stream muxed in */
+static int _test_index(void){
+  static const bench_link l={2,44100,.4f};
+  bench_buffer   plain={NULL,0,0},b={NULL,0,0},ref={NULL,0,0};
+  bench_source   src;
+  OggVorbis_File vf;
+  int            failed=0;
+
+  bench_encode(&l,1,10.,&plain);
+  _test_mux(&plain,10*l.rate,l.rate/8,&b);
+  if(_test_open(&src,&b,&vf) || _test_pcm(&vf,&ref)){
+    fprintf(stderr,"muxed stream: open failed\n");
+    return 1;
+  }
+  /* the read through has indexed every page */
+  failed+=_test_seeks(&vf,&ref,TEST_PCM,0,"muxed, indexed");
+  failed+=_test_seeks(&vf,&ref,TEST_PAGE,0,"muxed, indexed page seeks");
+  ov_seek_index(&vf,0);
+  failed+=_test_seeks(&vf,&ref,TEST_PCM,0,"muxed, no index");
+  ov_clear(&vf);
+
+  free(plain.data);
+  free(b.data);
+  free(ref.data);
+  return failed;
+}
+
+/* the secant page search, without the index to help it,
+   over a chain of two links whose bitrates differ */
+static int _test_search(void){
+  static const bench_link l[]={{2,44100,.9f},{2,44100,-.1f}};
+  bench_buffer   b={NULL,0,0},ref={NULL,0,0};
+  bench_source   src;
+  OggVorbis_File vf;
+  int            failed=0;
+
+  bench_encode(l,1,6.,&b);
+  bench_encode(l+1,2,6.,&b);
+  if(_test_open(&src,&b,&vf) || vf.links!=2 || _test_pcm(&vf,&ref)){
+    fprintf(stderr,"chain: open failed\n");
+    return 1;
+  }
+  ov_seek_index(&vf,0);
+  failed+=_test_seeks(&vf,&ref,TEST_PCM,0,"chain, pcm seeks");
+  failed+=_test_seeks(&vf,&ref,TEST_PAGE,0,"chain, page seeks");
+  failed+=_test_seeks(&vf,&ref,TEST_TIME,0,"chain, time seeks");
+  ov_clear(&vf);
+
+  free(b.data);
+  free(ref.data);
+  return failed;
+}
+
+/* nonzero if a and b hold different PCM */
+static int _test_same(const bench_buffer *a,const bench_buffer *b){
+  return a->bytes!=b->bytes || memcmp(a->data,b->data,a->bytes);
+}
+
+/* decoders on a cached setup, whether it is in use by
+   another or idle, decode as one that read its own */
+static int _test_setup_cache(void){
+  static const bench_link l={2,44100,.6f};
+  bench_buffer   b={NULL,0,0},ref={NULL,0,0},pcm={NULL,0,0};
+  bench_source   src[3];
+  OggVorbis_File vf[3];
+  struct vorbis_shared_setup *shared=NULL;
+  int            failed=0,i;
+
+  bench_encode(&l,1,3.,&b);
+  if(_test_open(src,&b,vf) || _test_pcm(vf,&ref)){
+    fprintf(stderr,"setup cache: open failed\n");
+    return 1;
+  }
+  ov_clear(vf);
+
+  vorbis_synthesis_setup_cache(1);
+  for(i=0;i<3;i++){
+    codec_setup_info *ci;
+    if(_test_open(src+i,&b,vf+i)){
+      fprintf(stderr,"setup cache: open failed\n");
+      return 1;
+    }
+    ci=vf[i].vi->codec_setup;
+    if(!i)shared=ci->shared;
+    if(!ci->shared || ci->shared!=shared){
+      fprintf(stderr,"setup cache: decoder %d does not share\n",i);
+      failed++;
+    }
+    if(_test_pcm(vf+i,&pcm) || _test_same(&pcm,&ref)){
+      fprintf(stderr,"setup cache: decoder %d differs\n",i);
+      failed++;
+    }
+    /* the last one opens on the setup the others left idle */
+    if(i==1){
+      failed+=_test_seeks(vf+1,&ref,TEST_PCM,0,"setup cache");
+      ov_clear(vf);
+      ov_clear(vf+1);
+    }
+  }
+  ov_clear(vf+2);
+  vorbis_synthesis_setup_cache(-1);
+
+  free(b.data);
+  free(ref.data);
+  free(pcm.data);
+  return failed;
+}
+
+static int _test_write(void *arg,const char *pcm,long bytes,int link){
+  (void)link;
+  bench_write(arg,(const unsigned char *)pcm,bytes);
+  return 0;
+}
+
+static int _test_reopen(void *arg,OggVorbis_File *vf){
+  const bench_buffer *b=arg;
+  return ov_open_memory(b->data,b->bytes,vf);
+}
+
+/* segment-parallel decoding gives what ov_read does, on
+   any number of threads and whether or not the workers open their
+   own decoders */
+static int _test_parallel(void){
+  static const bench_link l[]={{2,44100,.4f},{1,22050,.1f}};
+  static const int threads[]={1,2,3,8};
+  bench_buffer   b={NULL,0,0},ref={NULL,0,0},pcm={NULL,0,0};
+  OggVorbis_File vf;
+  int            failed=0,i;
+
+  bench_encode(l,1,4.,&b);
+  bench_encode(l+1,2,3.,&b);
+  if(ov_open_memory(b.data,b.bytes,&vf) || _test_pcm(&vf,&ref)){
+    fprintf(stderr,"parallel: open failed\n");
+    return 1;
+  }
+  for(i=0;i<(int)(sizeof(threads)/sizeof(*threads));i++){
+    int ret;
+    pcm.bytes=0;
+    ret=ov_decode_parallel(&vf,threads[i],OV_FMT_S16,i&1?_test_reopen:NULL,
+                           &b,_test_write,&pcm);
+    if(ret || _test_same(&pcm,&ref)){
+      fprintf(stderr,"parallel: %d threads differ from ov_read\n",
+              threads[i]);
+      failed++;
+    }
+  }
+  ov_clear(&vf);
+
+  free(b.data);
+  free(ref.data);
+  free(pcm.data);
+  return failed;
+}
+
+/* channels synthesized on the workers decode as on the
+   calling thread, and the workers last across seeks */
+static int _test_threads(void){
+  static const bench_link l={6,48000,.5f};
+  bench_buffer   b={NULL,0,0},ref={NULL,0,0},pcm={NULL,0,0};
+  bench_source   src;
+  OggVorbis_File vf;
+  vorbis_pool   *pool;
+  int            failed=0;
+
+  bench_encode(&l,1,3.,&b);
+  if(_test_open(&src,&b,&vf) || _test_pcm(&vf,&ref) ||
+     ov_pcm_seek(&vf,0) || ov_threads(&vf,3)){
+    fprintf(stderr,"threads: open failed\n");
+    return 1;
+  }
+  pool=vf.pool;
+  if(_test_pcm(&vf,&pcm) || _test_same(&pcm,&ref)){
+    fprintf(stderr,"threads: decode differs\n");
+    failed++;
+  }
+  failed+=_test_seeks(&vf,&ref,TEST_PCM,0,"threads");
+  if(!pool || vf.pool!=pool ||
+     ((private_state *)vf.vd.backend_state)->pool!=pool){
+    fprintf(stderr,"threads: workers not kept\n");
+    failed++;
+  }
+
+  /* changing the count mid stream */
+  if(ov_pcm_seek(&vf,0) || ov_threads(&vf,3) || vf.pool!=pool ||
+     ov_threads(&vf,1) || vf.pool || ov_threads(&vf,4) ||
+     _test_pcm(&vf,&pcm) || _test_same(&pcm,&ref)){
+    fprintf(stderr,"threads: changing the count failed\n");
+    failed++;
+  }
+  ov_clear(&vf);
+
+  free(b.data);
+  free(ref.data);
+  free(pcm.data);
+  return failed;
+}
+
+/* 5.1 mixed to stereo in the spectra seeks, lapped or
+   not, as the mixed stream reads straight through */
+static int _test_downmix(void){
+  static const bench_link l={6,44100,.4f};
+  static const float matrix[12]={
+    .5f,.35f,0,.35f,0,.35f,
+    0,.35f,.5f,0,.35f,.35f
+  };
+  bench_buffer   b={NULL,0,0},ref={NULL,0,0};
+  bench_source   src;
+  OggVorbis_File vf;
+  int            failed=0;
+
+  bench_encode(&l,1,4.,&b);
+  if(_test_open(&src,&b,&vf) || ov_downmix(&vf,6,2,matrix) ||
+     ov_channels(&vf,-1)!=2 || _test_pcm(&vf,&ref)){
+    fprintf(stderr,"downmix: open failed\n");
+    return 1;
+  }
+  failed+=_test_seeks(&vf,&ref,TEST_PCM,0,"downmix");
+  failed+=_test_seeks(&vf,&ref,TEST_LAP,0,"downmix, lapped");
+  ov_clear(&vf);
+
+  free(b.data);
+  free(ref.data);
+  return failed;
+}
+
+/* in dB, the power of ref (full rate) over that of what pcm, shift
+   times halved in rate, differs from it by at the same instants */
+static double _test_snr(const bench_buffer *pcm,const bench_buffer *ref,
+                        int channels,int shift){
+  double sig=0,err=0;
+  long   i;
+  for(i=0;i+1<pcm->bytes;i+=2){
+    long s=i>>1;
+    long j=((s/channels<<shift)*channels+s%channels)*2;
+    int  x,y;
+    if(j+1>=ref->bytes)break;
+    x=(short)(pcm->data[i]|pcm->data[i+1]<<8);
+    y=(short)(ref->data[j]|ref->data[j+1]<<8);
+    sig+=(double)y*y;
+    err+=(double)(x-y)*(x-y);
+  }
+  return err>0?10*log10(sig/err):999.;
+}
+
+/* decoding at 1/2, 1/4 and 1/8 rate keeps to the full rate
+   signal, seeks within itself, and survives changing rate mid stream */
+static int _test_rate(void){
+  static const bench_link l={2,44100,.4f};
+  bench_buffer   b={NULL,0,0},ref={NULL,0,0},low={NULL,0,0},
+                 pcm={NULL,0,0};
+  bench_source   src;
+  OggVorbis_File vf;
+  ogg_int64_t    total;
+  long           frame=l.channels*2;
+  int            failed=0,shift;
+
+  bench_encode(&l,1,4.,&b);
+  if(_test_open(&src,&b,&vf) || _test_pcm(&vf,&ref)){
+    fprintf(stderr,"rate shift: open failed\n");
+    return 1;
+  }
+  total=ov_pcm_total(&vf,-1);
+  ov_clear(&vf);
+
+  for(shift=1;shift<4;shift++){
+    double snr;
+    if(_test_open(&src,&b,&vf) || ov_rate_shift(&vf,shift) ||
+       _test_pcm(&vf,&low)){
+      fprintf(stderr,"rate shift %d: decode failed\n",shift);
+      failed++;
+      ov_clear(&vf);
+      continue;
+    }
+    snr=_test_snr(&low,&ref,l.channels,shift);
+    if(low.bytes!=(total>>shift)*frame || snr<10){
+      fprintf(stderr,"rate shift %d: %ld samples at %.1fdB\n",
+              shift,low.bytes/frame,snr);
+      failed++;
+    }
+    failed+=_test_seeks(&vf,&low,TEST_PCM,shift,"rate shift");
+
+    /* to full rate and back, each in the middle of a read */
+    if(ov_pcm_seek(&vf,total/3) || ov_rate_shift(&vf,0) ||
+       ov_pcm_tell(&vf)!=total/3 || _test_pcm(&vf,&pcm) ||
+       pcm.bytes!=ref.bytes-total/3*frame ||
+       memcmp(pcm.data,ref.data+total/3*frame,pcm.bytes) ||
+       ov_pcm_seek(&vf,total/2) || ov_rate_shift(&vf,shift) ||
+       _test_pcm(&vf,&pcm) ||
+       pcm.bytes!=low.bytes-(total/2>>shift)*frame ||
+       memcmp(pcm.data,low.data+(total/2>>shift)*frame,pcm.bytes)){
+      fprintf(stderr,"rate shift %d: changing rate mid stream failed\n",
+              shift);
+      failed++;
+    }
+    ov_clear(&vf);
+  }
+
+  /* shifts past 1/8 are refused, leaving the decoder at full rate */
+  if(_test_open(&src,&b,&vf) || ov_rate_shift(&vf,4)!=OV_EINVAL ||
+     ov_rate_shift(&vf,64)!=OV_EINVAL || ov_halfrate_p(&vf) ||
+     _test_pcm(&vf,&pcm) || _test_same(&pcm,&ref)){
+    fprintf(stderr,"rate shift: out of range shift not refused\n");
+    failed++;
+  }
+  ov_clear(&vf);
+
+  free(b.data);
+  free(ref.data);
+  free(low.data);
+  free(pcm.data);
+  return failed;
+}
+
+/* the fused decoupling and floor pass is bit exact */
+static int _test_fused(void){
+  static const bench_link tests[]={
+    {1,22050,.3f},{2,44100,.5f},{2,44100,1.f},{6,48000,.4f}
+  };
+  int i,failed=0;
+
+  for(i=0;i<(int)(sizeof(tests)/sizeof(*tests));i++){
+    bench_buffer   b={NULL,0,0},ref={NULL,0,0},pcm={NULL,0,0};
+    bench_source   src;
+    OggVorbis_File vf;
+
+    bench_encode(tests+i,1,2.,&b);
+    if(_test_open(&src,&b,&vf) || _test_pcm(&vf,&ref)){
+      fprintf(stderr,"fused: open failed\n");
+      return 1;
+    }
+    ov_clear(&vf);
+
+    /* the decoder of a fresh open is the one that reads through */
+    if(_test_open(&src,&b,&vf) || _ov_initset(&vf) ||
+       vorbis_synthesis_fused(&vf.vd,1) ||
+       !((private_state *)vf.vd.backend_state)->fused ||
+       _test_pcm(&vf,&pcm) || _test_same(&pcm,&ref)){
+      fprintf(stderr,"fused: %dch %ldHz q%g differs\n",tests[i].channels,
+              tests[i].rate,tests[i].quality*10);
+      failed++;
+    }
+    ov_clear(&vf);
+
+    free(b.data);
+    free(ref.data);
+    free(pcm.data);
+  }
+  return failed;
+}
+
+/* allocations made by reads to the end from pos; -1 on error */
+static long _test_reads(OggVorbis_File *vf,ogg_int64_t pos){
+  char pcm[4096];
+  int  bs;
+  long ret;
+  if(ov_pcm_seek(vf,pos))return -1;
+  allocations=0;
+  counting=1;
+  while((ret=ov_read(vf,pcm,sizeof(pcm),0,2,1,&bs))!=0)
+    if(ret<0 && ret!=OV_HOLE)break;
+  counting=0;
+  return ret<0?-1:allocations;
+}
+
+/* no allocations from the read calls in real-time mode */
+static int _test_realtime(void){
+  static const bench_link tests[]={
+    {2,44100,.4f},{1,22050,-.1f},{6,48000,.9f}
+  };
+  int i,memory,failed=0;
+
+  for(i=0;i<(int)(sizeof(tests)/sizeof(*tests));i++){
+    bench_buffer b={NULL,0,0};
+    bench_encode(tests+i,tests[i].channels,3.,&b);
+
+    for(memory=0;memory<2;memory++){
+      OggVorbis_File vf;
+      bench_source   src;
+      long whole,middle;
+      const ogg_allocator *prev=ogg_allocator_use(&_test_counter);
+      int ret=memory?ov_open_memory(b.data,b.bytes,&vf):
+        _test_open(&src,&b,&vf);
+      ogg_allocator_use(prev);
+      if(ret){
+        fprintf(stderr,"%dch %ldHz: open failed\n",
+                tests[i].channels,tests[i].rate);
+        return 1;
+      }
+      if(ov_realtime(&vf,1)){
+        fprintf(stderr,"%dch %ldHz: reservation failed\n",
+                tests[i].channels,tests[i].rate);
+        return 1;
+      }
+      whole=_test_reads(&vf,0);
+      middle=_test_reads(&vf,ov_pcm_total(&vf,-1)/2);
+      fprintf(stderr,"%dch %ldHz from %s: %ld and %ld allocations\n",
+              tests[i].channels,tests[i].rate,
+              memory?"memory":"callbacks",whole,middle);
+      if(whole || middle)failed++;
+      ov_clear(&vf);
+    }
+    free(b.data);
+  }
+  return failed;
+}
+
+int main(void){
+  int failed=0;
+
+  failed+=_test_index();
+  failed+=_test_search();
+  failed+=_test_setup_cache();
+  failed+=_test_parallel();
+  failed+=_test_threads();
+  failed+=_test_downmix();
+  failed+=_test_rate();
+  failed+=_test_fused();
+  failed+=_test_realtime();
+
+  if(failed){
+    fprintf(stderr,"%d checks failed\n",failed);
+    return 1;
+  }
+  fprintf(stderr,"OK\n");
+  return 0;
+}
+
+#endif
@@ -44,7 +44,7 @@ namespace Vorbisfile {
 
 
 		OggVorbisFile::OggVorbisFile()
-			: file_stream_(nullptr)
+			: file_stream_(nullptr), read_status_(0)
 		{ }
 
 		OggVorbisFile::~OggVorbisFile()
@@ -116,7 +116,7 @@ namespace Vorbisfile {
 			Windows::Storage::Streams::IBuffer^ buffer = ref new Windows::Storage::Streams::Buffer((unsigned)length);
 			uint8 *buffer_array = get_array(buffer);
 
-			long ret = ::ov_read(vf_, reinterpret_cast<char *>(buffer_array), length, 0, 2, 1, bitstream);
+			long ret = ::ov_read_fill(vf_, reinterpret_cast<char *>(buffer_array), length, OV_FMT_S16, bitstream, &read_status_);
 			if (ret < 0)
 				throw ref new Platform::COMException(ret);
 
@@ -124,6 +124,32 @@ namespace Vorbisfile {
 			return buffer;
 		}
 
+		unsigned int OggVorbisFile::ReadInto(Windows::Storage::Streams::IBuffer^ buffer)
+		{
+			int dummy;
+			return ReadInto(buffer, &dummy);
+		}
+
+		unsigned int OggVorbisFile::ReadInto(Windows::Storage::Streams::IBuffer^ buffer, int *bitstream)
+		{
+			assert(IsValid);
+
+			uint8 *buffer_array = get_array(buffer);
+			int length = buffer->Capacity > 0x7fffffffu ? 0x7fffffff : (int)buffer->Capacity;
+
+			long ret = ::ov_read_fill(vf_, reinterpret_cast<char *>(buffer_array), length, OV_FMT_S16, bitstream, &read_status_);
+			if (ret < 0)
+				throw ref new Platform::COMException(ret);
+
+			buffer->Length = (unsigned)ret;
+			return (unsigned)ret;
+		}
+
+		int OggVorbisFile::ReadStatus::get()
+		{
+			return read_status_;
+		}
+
 		void OggVorbisFile::Crosslap(OggVorbisFile^ oldFile, OggVorbisFile^ newFile)
 		{
 			assert(oldFile->IsValid);